@@ -0,0 +1,122 @@
+// compares walking the old unordered_map of fat game objects with walking the registry's
+// packed component arrays, doing the same per object work the render and light systems do.
+// Build and run with `make bench`
+#include "pve/pve_ecs.hpp"
+#include "pve/pve_game_object.hpp"
+
+// std
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+using namespace pve;
+
+// the layout PveGameObject::Map used to have
+struct LegacyGameObject {
+    glm::vec3 color{};
+    TransformComponent transform{};
+    std::string name;
+    std::shared_ptr<int> model{};  // stands in for the shared PveModel
+    std::unique_ptr<PointLightComponent> pointLight = nullptr;
+};
+
+static constexpr int REPETITIONS = 5;
+// one in this many objects is a light, the rest have a model
+static constexpr uint32_t LIGHT_EVERY = 16;
+
+static glm::vec3 positionFor(uint32_t i) {
+    return {static_cast<float>(i % 100), static_cast<float>((i / 100) % 100),
+            static_cast<float>(i / 10000)};
+}
+
+// best of a few runs, in nanoseconds per entity
+template <typename Func>
+static double timeLoop(uint32_t entityCount, Func &&func) {
+    double best = 1e30;
+    for (int r = 0; r < REPETITIONS; r++) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        auto end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        best = ns < best ? ns : best;
+    }
+    return best / entityCount;
+}
+
+static void runBenchmark(uint32_t entityCount) {
+    std::unordered_map<uint32_t, LegacyGameObject> legacy;
+    PveRegistry registry;
+    auto sharedModel = std::make_shared<int>(0);
+    for (uint32_t i = 0; i < entityCount; i++) {
+        LegacyGameObject obj{};
+        obj.transform.setTranslation(positionFor(i));
+        obj.name = "object";
+        if (i % LIGHT_EVERY == 0) {
+            obj.color = {1.f, .5f, .25f};
+            obj.pointLight = std::make_unique<PointLightComponent>();
+            auto entity = makePointLight(registry, 1.f, .1f, obj.color);
+            registry.get<TransformComponent>(entity).setTranslation(positionFor(i));
+        } else {
+            obj.model = sharedModel;
+            auto entity = registry.create();
+            registry.emplace<TransformComponent>(entity).setTranslation(positionFor(i));
+            registry.emplace<ModelComponent>(entity);
+            registry.emplace<NameComponent>(entity, "object");
+        }
+        legacy.emplace(i, std::move(obj));
+    }
+
+    // keeps the loops from being optimized away
+    volatile float sink = 0.f;
+
+    double legacyRender = timeLoop(entityCount, [&] {
+        float sum = 0.f;
+        for (auto &kv : legacy) {
+            auto &obj = kv.second;
+            if (obj.model == nullptr) continue;
+            sum += obj.transform.mat4()[3].x;
+        }
+        sink = sum;
+    });
+    double registryRender = timeLoop(entityCount, [&] {
+        float sum = 0.f;
+        registry.view<ModelComponent, TransformComponent>().each(
+            [&](PveEntity, ModelComponent &, TransformComponent &transform) {
+                sum += transform.mat4()[3].x;
+            });
+        sink = sum;
+    });
+
+    double legacyLights = timeLoop(entityCount, [&] {
+        float sum = 0.f;
+        for (auto &kv : legacy) {
+            auto &obj = kv.second;
+            if (obj.pointLight == nullptr) continue;
+            sum += obj.color.x * obj.pointLight->lightIntensity + obj.transform.getTranslation().y;
+        }
+        sink = sum;
+    });
+    double registryLights = timeLoop(entityCount, [&] {
+        float sum = 0.f;
+        registry.view<PointLightComponent, TransformComponent, ColorComponent>().each(
+            [&](PveEntity, PointLightComponent &pointLight, TransformComponent &transform,
+                ColorComponent &color) {
+                sum += color.color.x * pointLight.lightIntensity + transform.getTranslation().y;
+            });
+        sink = sum;
+    });
+
+    std::printf(
+        "%8u entities  render: map %7.2f ns, registry %7.2f ns  "
+        "lights: map %7.2f ns, registry %7.2f ns  (per entity)\n",
+        entityCount, legacyRender, registryRender, legacyLights, registryLights);
+}
+
+int main() {
+    for (uint32_t entityCount : {10000u, 100000u, 1000000u}) {
+        runBenchmark(entityCount);
+    }
+    return 0;
+}
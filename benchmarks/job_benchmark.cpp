@@ -0,0 +1,85 @@
+// measures what spawning a job costs, and how well a compute bound parallelFor scales with
+// the worker count. Counts past the machine's hardware threads are still run, they show what
+// oversubscription costs. Build and run with `make bench`
+#include "pve/pve_job_system.hpp"
+
+// std
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace pve;
+
+static constexpr int REPETITIONS = 5;
+static constexpr uint32_t SPAWN_JOBS = 100000;
+static constexpr uint32_t SCALING_ELEMENTS = 1 << 22;
+static constexpr uint32_t SCALING_GRAIN = 4096;
+
+// best of a few runs, in nanoseconds
+template <typename Func>
+static double bestOf(Func &&func) {
+    double best = 1e30;
+    for (int r = 0; r < REPETITIONS; r++) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        auto end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        best = ns < best ? ns : best;
+    }
+    return best;
+}
+
+// spawns empty jobs from the main thread and waits for them, and the same again with each
+// job spawning a child, which is how nested work fans out
+static void runSpawnBenchmark(uint32_t workerCount) {
+    PveJobSystem jobSystem{workerCount};
+    double flat = bestOf([&] {
+        PveJobCounter counter;
+        for (uint32_t i = 0; i < SPAWN_JOBS; i++) {
+            jobSystem.spawn([] {}, &counter);
+        }
+        jobSystem.wait(counter);
+    });
+    double nested = bestOf([&] {
+        PveJobCounter counter;
+        for (uint32_t i = 0; i < SPAWN_JOBS / 2; i++) {
+            jobSystem.spawn([&] { jobSystem.spawn([] {}, &counter); }, &counter);
+        }
+        jobSystem.wait(counter);
+    });
+    std::printf("%3u workers  spawn: flat %7.1f ns, nested %7.1f ns  (per job)\n", workerCount,
+                flat / SPAWN_JOBS, nested / SPAWN_JOBS);
+}
+
+// a few transcendental functions per element, about what a transform update costs
+static double scalingTime(uint32_t workerCount, std::vector<float> &values) {
+    PveJobSystem jobSystem{workerCount};
+    return bestOf([&] {
+        jobSystem.parallelFor(SCALING_ELEMENTS, SCALING_GRAIN, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                float x = static_cast<float>(i) * 1e-4f;
+                values[i] = std::sin(x) * std::cos(x * .5f) + std::sqrt(x);
+            }
+        });
+    });
+}
+
+int main() {
+    std::printf("%u hardware threads\n", std::thread::hardware_concurrency());
+    for (uint32_t workerCount : {1u, 4u, 8u, 16u, 32u}) {
+        runSpawnBenchmark(workerCount);
+    }
+
+    std::vector<float> values(SCALING_ELEMENTS);
+    double serial = scalingTime(1, values);
+    std::printf("  1 workers  parallelFor: %8.3f ms\n", serial * 1e-6);
+    for (uint32_t workerCount : {4u, 8u, 16u, 32u}) {
+        double parallel = scalingTime(workerCount, values);
+        std::printf("%3u workers  parallelFor: %8.3f ms, speedup %5.2fx, efficiency %5.1f%%\n",
+                    workerCount, parallel * 1e-6, serial / parallel,
+                    100. * serial / (parallel * workerCount));
+    }
+    return 0;
+}
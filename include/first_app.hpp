@@ -1,21 +1,56 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "pve/pve_descriptors.hpp"
+#include "pve/pve_asset_streamer.hpp"
 #include "pve/pve_device.hpp"
 #include "pve/pve_game_object.hpp"
+#include "pve/pve_geometry_arena.hpp"
+#include "pve/pve_job_system.hpp"
+#include "pve/pve_material_library.hpp"
+#include "pve/pve_profiler.hpp"
 #include "pve/pve_renderer.hpp"
+#include "pve/pve_upload_manager.hpp"
 #include "pve/pve_window.hpp"
 
 namespace pve {
+
+struct AppConfigInfo {
+    // render offscreen without a window, surface or vsync
+    bool headless = false;
+    // stop after this many frames, 0 runs until the window is closed
+    uint32_t frameCount = 0;
+    // headless only: write the last rendered frame to readbackPath
+    bool readback = false;
+    std::string readbackPath = "frame.ppm";
+    // load every model into one shared vertex and index buffer
+    bool geometryArena = false;
+    // cull and issue draws on the GPU, implies geometryArena
+    bool gpuDriven = false;
+    // extra small point lights scattered over the floor, to stress the light clusters
+    uint32_t extraLights = 0;
+    // record the render pass into secondary command buffers on this many threads,
+    // 0 records everything inline on the main thread
+    uint32_t recordThreads = 0;
+    // workers of the engine's job system, the main thread included. 0 uses one per hardware
+    // thread
+    uint32_t jobThreads = 0;
+    // print per zone frame time percentiles at exit and write the last frames to profilePath
+    // as a Chrome trace
+    bool profile = false;
+    std::string profilePath = "trace.json";
+};
+
 class FirstApp {
    public:
     static constexpr int WIDTH = 800;
     static constexpr int HEIGHT = 600;
 
-    FirstApp();
+    FirstApp(const AppConfigInfo &config = AppConfigInfo{});
     ~FirstApp();
 
     FirstApp(const FirstApp &) = delete;
@@ -25,12 +60,21 @@ class FirstApp {
 
    private:
     void loadGameObjects();
+    bool shouldStop(uint32_t framesRendered) const;
 
-    PveWindow pveWindow{WIDTH, HEIGHT, "Hello Vulkan!"};
+    AppConfigInfo config;
+    PveJobSystem jobSystem{config.jobThreads};
+    PveWindow pveWindow;
     PveDevice pveDevice{pveWindow};
     PveRenderer pveRenderer{pveWindow, pveDevice};
-
-    std::unique_ptr<PveDescriptorPool> globalPool{};
-    PveGameObject::Map gameObjects;
+    PveProfiler profiler{pveDevice};
+    // declared before anything it uploads into, so it's destroyed after them
+    PveUploadManager uploadManager{pveDevice};
+    std::unique_ptr<PveMaterialLibrary> materialLibrary{};
+    // declared before the registry so it outlives the models placed in it
+    std::unique_ptr<PveGeometryArena> geometryArena{};
+    // its models go into the arena, and the registry holds on to them
+    std::unique_ptr<PveAssetStreamer> assetStreamer{};
+    PveRegistry registry;
 };
 }  // namespace pve
@@ -0,0 +1,129 @@
+#pragma once
+
+// libs
+#include <vulkan/vulkan.h>
+
+// std
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace pve {
+
+// hands out sub-ranges of a fixed size range with a best fit free list.
+// It's unit agnostic: the allocator uses it for bytes, the geometry arena for vertices and indices
+class PveRangeAllocator {
+   public:
+    explicit PveRangeAllocator(VkDeviceSize size = 0);
+
+    void reset(VkDeviceSize size);
+
+    // on success offset is aligned and [offset - padding, offset + size) is reserved
+    bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset,
+                  VkDeviceSize &padding);
+    // offset and size of the whole reserved range, including any padding
+    void free(VkDeviceSize offset, VkDeviceSize size);
+
+    VkDeviceSize getSize() const { return size; }
+    VkDeviceSize getFreeBytes() const { return freeBytes; }
+    VkDeviceSize getLargestFreeRange() const;
+    bool isEmpty() const { return freeBytes == size; }
+
+   private:
+    void insertFreeRange(VkDeviceSize offset, VkDeviceSize size);
+    void eraseFreeRange(std::map<VkDeviceSize, VkDeviceSize>::iterator range);
+
+    VkDeviceSize size = 0;
+    VkDeviceSize freeBytes = 0;
+    // the same free ranges indexed both ways: by offset to coalesce neighbours on free,
+    // by size to find the best fit on allocate
+    std::map<VkDeviceSize, VkDeviceSize> freeByOffset;
+    std::multimap<VkDeviceSize, VkDeviceSize> freeBySize;
+};
+
+struct PveMemoryBlock;
+
+struct PveAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    // host visible blocks stay mapped for their whole lifetime, this already includes offset
+    void *mapped = nullptr;
+    uint32_t memoryTypeIndex = 0;
+    PveMemoryBlock *block = nullptr;
+};
+
+struct PveHeapStats {
+    VkDeviceSize bytesUsed = 0;    // requested by live allocations
+    VkDeviceSize bytesWasted = 0;  // alignment and atom size padding of live allocations
+    VkDeviceSize bytesFree = 0;    // reserved from the driver but not handed out
+    uint32_t blockCount = 0;
+    uint32_t allocationCount = 0;
+};
+
+// called once per allocation the defragmenter wants to move. The owner has to recreate its
+// resource at newAllocation, copy the contents over and return true, or return false to keep
+// it where it is. Only allocations made with a non null userData are ever moved
+using PveDefragmentationCallback = std::function<bool(
+    void *userData, const PveAllocation &oldAllocation, const PveAllocation &newAllocation)>;
+
+// pools device memory in large blocks per memory type and sub-allocates resources from them,
+// so the number of vkAllocateMemory calls stays far below maxMemoryAllocationCount
+class PveAllocator {
+   public:
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+    PveAllocator(VkDevice device, VkPhysicalDevice physicalDevice);
+    ~PveAllocator();
+
+    PveAllocator(const PveAllocator &) = delete;
+    PveAllocator &operator=(const PveAllocator &) = delete;
+
+    // linear is true for buffers and linear images, false for optimal tiling images.
+    // Both kinds are kept in separate blocks so bufferImageGranularity never applies
+    PveAllocation allocate(const VkMemoryRequirements &requirements, uint32_t memoryTypeIndex,
+                           bool linear, void *userData = nullptr);
+    void free(PveAllocation &allocation);
+
+    // offset and size are relative to the allocation and get expanded to nonCoherentAtomSize
+    VkResult flush(const PveAllocation &allocation, VkDeviceSize size = VK_WHOLE_SIZE,
+                   VkDeviceSize offset = 0);
+    VkResult invalidate(const PveAllocation &allocation, VkDeviceSize size = VK_WHOLE_SIZE,
+                        VkDeviceSize offset = 0);
+
+    // indexed by memory heap
+    std::vector<PveHeapStats> getHeapStats();
+
+    // packs movable allocations out of the emptiest blocks into fuller ones and releases the
+    // blocks that end up empty. Returns the number of bytes moved
+    VkDeviceSize defragment(const PveDefragmentationCallback &moveAllocation);
+    void freeEmptyBlocks();
+
+   private:
+    struct Pool {
+        uint32_t memoryTypeIndex;
+        std::vector<std::unique_ptr<PveMemoryBlock>> blocks;
+    };
+
+    PveMemoryBlock *createBlock(Pool &pool, VkDeviceSize size, bool dedicated);
+    void destroyBlock(Pool &pool, PveMemoryBlock *block);
+    bool allocateFromBlock(PveMemoryBlock &block, const VkMemoryRequirements &requirements,
+                           void *userData, PveAllocation &allocation);
+    void freeFromBlock(PveAllocation &allocation);
+    void releaseEmptyBlocks(Pool &pool);
+    Pool &getPool(uint32_t memoryTypeIndex, bool linear);
+    VkMappedMemoryRange alignedRange(const PveAllocation &allocation, VkDeviceSize size,
+                                     VkDeviceSize offset) const;
+
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    VkDeviceSize nonCoherentAtomSize;
+    // two pools per memory type, one for linear and one for optimal resources
+    std::vector<Pool> pools;
+    std::mutex mutex;
+};
+
+}  // namespace pve
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "pve_device.hpp"
+#include "pve_ecs.hpp"
+#include "pve_game_object.hpp"
+#include "pve_geometry_arena.hpp"
+#include "pve_model.hpp"
+#include "pve_upload_manager.hpp"
+
+// std
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace pve {
+
+using PveAssetHandle = uint32_t;
+
+// the entity's ModelComponent is filled in by the streamer once the asset is resident
+struct StreamedModelComponent {
+    PveAssetHandle asset = 0;
+};
+
+// loads models in the background. Worker threads parse and deduplicate the meshes, or read
+// their caches, and the frame thread only creates the models and queues their uploads.
+// The closest assets to the viewer load first. Once the resident geometry reaches the
+// memory budget, assets farther away than a new one are evicted to make room, and unused
+// assets are evicted first of all
+class PveAssetStreamer {
+   public:
+    struct Config {
+        // vertex and index bytes of every resident model together
+        VkDeviceSize memoryBudget = 256 * 1024 * 1024;
+        uint32_t workerCount = 2;
+    };
+
+    PveAssetStreamer(
+        PveDevice &device,
+        PveUploadManager &uploadManager,
+        PveGeometryArena *arena,
+        const Config &config);
+    // stops the workers, a mesh that's being parsed is finished first
+    ~PveAssetStreamer();
+
+    PveAssetStreamer(const PveAssetStreamer &) = delete;
+    PveAssetStreamer &operator=(const PveAssetStreamer &) = delete;
+
+    // the same path always gets the same handle. Nothing is loaded until an entity with a
+    // StreamedModelComponent uses it
+    PveAssetHandle request(const std::string &filepath);
+
+    // drawn in place of assets that aren't resident yet, null leaves them undrawn
+    void setPlaceholder(std::shared_ptr<PveModel> model) { placeholder = std::move(model); }
+
+    // once per frame, on the thread that records the frames. Reprioritizes the requests by
+    // distance to the viewer, turns finished meshes into models, evicts to stay in budget and
+    // points every streamed entity's ModelComponent at its model or the placeholder
+    void update(PveRegistry &registry, const glm::vec3 &viewerPosition);
+
+    // whether bytes more fit in the budget once freeable of the resident bytes are evicted.
+    // The resident bytes can be over the budget, so nothing is subtracted from them
+    static bool fitsBudget(VkDeviceSize residentBytes, VkDeviceSize freeable,
+                           VkDeviceSize bytes, VkDeviceSize budget) {
+        return residentBytes + bytes <= budget + freeable;
+    }
+
+    VkDeviceSize getResidentBytes() const { return residentBytes; }
+    uint32_t getResidentCount() const { return residentCount; }
+    // every model evicted so far, each one left a hole in device memory
+    uint32_t getEvictionCount() const { return evictionCount; }
+
+   private:
+    enum class AssetState { Unloaded, Queued, Loading, Parsed, Resident, Failed };
+
+    struct Asset {
+        std::string filepath;
+        AssetState state = AssetState::Unloaded;
+        // distance from the viewer to the closest entity using the asset, infinite if none
+        float priority = 0.f;
+        // written by the worker that parsed it, taken by update()
+        std::unique_ptr<PveModel::Builder> builder;
+        std::string error;
+        std::shared_ptr<PveModel> model;
+        VkDeviceSize bytes = 0;
+    };
+
+    // evicted models live on until the frames that may still draw them are done
+    struct RetiredModel {
+        std::shared_ptr<PveModel> model;
+        uint32_t framesLeft;
+    };
+
+    void workerLoop();
+    void makeResident(PveAssetHandle handle);
+    // evicts assets farther than priority until bytes fit, false if they can't
+    bool makeRoom(VkDeviceSize bytes, float priority);
+    void evict(Asset &asset);
+
+    PveDevice &pveDevice;
+    PveUploadManager &uploadManager;
+    PveGeometryArena *geometryArena;
+    Config config;
+    std::shared_ptr<PveModel> placeholder;
+
+    // the workers read assets and their state under the mutex, everything else belongs to
+    // the frame thread
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    bool stopping = false;
+    std::vector<Asset> assets;
+    std::vector<PveAssetHandle> queued;
+    std::vector<PveAssetHandle> parsed;
+    std::vector<std::thread> workers;
+
+    std::unordered_map<std::string, PveAssetHandle> handles;
+    std::vector<float> nearestUsers;
+    std::vector<PveAssetHandle> parsedScratch;
+    // resident assets farthest first, with the bytes of everything up to and including them
+    std::vector<std::pair<float, VkDeviceSize>> evictableBytes;
+    std::vector<RetiredModel> retiredModels;
+    VkDeviceSize residentBytes = 0;
+    uint32_t residentCount = 0;
+    uint32_t evictionCount = 0;
+};
+
+}  // namespace pve
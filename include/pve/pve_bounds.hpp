@@ -0,0 +1,19 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS  // No matter what system i'm in, angles are in radians, not degrees
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE  // Forces GLM to expect depth buffer values to range from 0 to 1 instead of -1 to 1 (the opengl standard)
+#include <glm/glm.hpp>
+
+namespace pve {
+
+// model space bounding volumes of a mesh, computed once at load time.
+// Plain data so it can be stored as is in the mesh cache
+struct PveBounds {
+    glm::vec3 aabbMin{};
+    glm::vec3 aabbMax{};
+    // centered on the box, so it's not the tightest sphere but close enough for culling
+    glm::vec3 sphereCenter{};
+    float sphereRadius = 0.f;
+};
+
+}  // namespace pve
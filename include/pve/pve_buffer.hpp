@@ -12,7 +12,8 @@ class PveBuffer {
         uint32_t instanceCount,
         VkBufferUsageFlags usageFlags,
         VkMemoryPropertyFlags memoryPropertyFlags,
-        VkDeviceSize minOffsetAlignment = 1);
+        VkDeviceSize minOffsetAlignment = 1,
+        bool relocatable = false);
     ~PveBuffer();
 
     PveBuffer(const PveBuffer&) = delete;
@@ -31,6 +32,11 @@ class PveBuffer {
     VkDescriptorBufferInfo descriptorInfoForIndex(int index);
     VkResult invalidateIndex(int index);
 
+    // only for buffers created relocatable, called by PveDevice::defragmentMemory() while the
+    // device is idle. Recreates the buffer at newAllocation and copies the contents over, the
+    // handle changes so it has to be fetched again with getBuffer()
+    bool relocate(const PveAllocation& newAllocation);
+
     VkBuffer getBuffer() const { return buffer; }
     void* getMappedMemory() const { return mapped; }
     uint32_t getInstanceCount() const { return instanceCount; }
@@ -46,7 +52,7 @@ class PveBuffer {
     PveDevice& pveDevice;
     void* mapped = nullptr;
     VkBuffer buffer = VK_NULL_HANDLE;
-    VkDeviceMemory memory = VK_NULL_HANDLE;
+    PveAllocation allocation{};
 
     VkDeviceSize bufferSize;
     uint32_t instanceCount;
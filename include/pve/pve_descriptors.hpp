@@ -3,32 +3,43 @@
 #include "pve_device.hpp"
 
 // std
+#include <cstdint>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
 namespace pve {
 
+// layouts come from the device's PveDescriptorSetLayoutCache, so builders asking for the same
+// bindings get the same layout
 class PveDescriptorSetLayout {
    public:
     class Builder {
        public:
         Builder(PveDevice &pveDevice) : pveDevice{pveDevice} {}
 
+        // flags are VkDescriptorBindingFlags from descriptor indexing. A binding that can be
+        // updated after bind needs its set allocated from a pool created with
+        // VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT
         Builder &addBinding(
             uint32_t binding,
             VkDescriptorType descriptorType,
             VkShaderStageFlags stageFlags,
-            uint32_t count = 1);
-        std::unique_ptr<PveDescriptorSetLayout> build() const;
+            uint32_t count = 1,
+            VkDescriptorBindingFlags flags = 0);
+        std::shared_ptr<PveDescriptorSetLayout> build() const;
 
        private:
         PveDevice &pveDevice;
         std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings{};
+        std::unordered_map<uint32_t, VkDescriptorBindingFlags> bindingFlags{};
     };
 
     PveDescriptorSetLayout(
-        PveDevice &pveDevice, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings);
+        PveDevice &pveDevice,
+        std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings,
+        const std::unordered_map<uint32_t, VkDescriptorBindingFlags> &bindingFlags = {});
     ~PveDescriptorSetLayout();
     PveDescriptorSetLayout(const PveDescriptorSetLayout &) = delete;
     PveDescriptorSetLayout &operator=(const PveDescriptorSetLayout &) = delete;
@@ -43,6 +54,44 @@ class PveDescriptorSetLayout {
     friend class PveDescriptorWriter;
 };
 
+// the device's descriptor set layouts, shared by every system that asks for the same bindings.
+// Layouts are looked up by a hash of their bindings and binding flags, and destroyed along
+// with their last user. Safe to use from several threads at once
+class PveDescriptorSetLayoutCache {
+   public:
+    explicit PveDescriptorSetLayoutCache(PveDevice &device) : pveDevice{device} {}
+
+    PveDescriptorSetLayoutCache(const PveDescriptorSetLayoutCache &) = delete;
+    PveDescriptorSetLayoutCache &operator=(const PveDescriptorSetLayoutCache &) = delete;
+
+    std::shared_ptr<PveDescriptorSetLayout> getLayout(
+        const std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> &bindings,
+        const std::unordered_map<uint32_t, VkDescriptorBindingFlags> &bindingFlags);
+
+    // how many getLayout() calls created a layout and how many found one to share
+    uint32_t getCreatedCount() const { return createdCount; }
+    uint32_t getSharedCount() const { return sharedCount; }
+
+   private:
+    // the bindings in binding order, with each one's flags
+    struct Key {
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        std::vector<VkDescriptorBindingFlags> flags;
+
+        bool operator==(const Key &other) const;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const;
+    };
+
+    PveDevice &pveDevice;
+    std::mutex mutex;
+    std::unordered_map<Key, std::weak_ptr<PveDescriptorSetLayout>, KeyHash> layouts;
+    uint32_t createdCount = 0;
+    uint32_t sharedCount = 0;
+};
+
 class PveDescriptorPool {
    public:
     class Builder {
@@ -84,19 +133,73 @@ class PveDescriptorPool {
     friend class PveDescriptorWriter;
 };
 
+// hands out descriptor sets from a chain of pools and never runs out. When a pool is full
+// the next one is made, each twice the size of the last up to MAX_SETS_PER_POOL. A pool's
+// descriptor counts are its set count times the ratio of each type, the average number a set
+// uses. reset() returns every set at once and keeps the pools for reuse, which is how a
+// frame's transient sets are freed. Safe to use from several threads at once
+class PveDescriptorAllocator {
+   public:
+    static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+    struct PoolSizeRatio {
+        VkDescriptorType descriptorType;
+        float ratio;
+    };
+
+    // enough of every type the engine's layouts use
+    static std::vector<PoolSizeRatio> defaultRatios();
+
+    PveDescriptorAllocator(
+        PveDevice &pveDevice,
+        uint32_t initialSetsPerPool = 64,
+        const std::vector<PoolSizeRatio> &ratios = defaultRatios(),
+        VkDescriptorPoolCreateFlags poolFlags = 0);
+    ~PveDescriptorAllocator();
+    PveDescriptorAllocator(const PveDescriptorAllocator &) = delete;
+    PveDescriptorAllocator &operator=(const PveDescriptorAllocator &) = delete;
+
+    // throws only if the layout needs more descriptors than a whole new pool has
+    VkDescriptorSet allocate(VkDescriptorSetLayout descriptorSetLayout);
+    // every set allocated so far must no longer be in use by the GPU
+    void reset();
+
+    uint32_t getPoolCount() const;
+
+   private:
+    // with the mutex held
+    VkDescriptorPool nextPool();
+
+    PveDevice &pveDevice;
+    std::vector<PoolSizeRatio> ratios;
+    VkDescriptorPoolCreateFlags poolFlags;
+
+    mutable std::mutex mutex;
+    VkDescriptorPool currentPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorPool> fullPools;
+    // reset pools waiting to be used again
+    std::vector<VkDescriptorPool> readyPools;
+    uint32_t setsPerPool;
+};
+
 class PveDescriptorWriter {
    public:
     PveDescriptorWriter(PveDescriptorSetLayout &setLayout, PveDescriptorPool &pool);
+    PveDescriptorWriter(PveDescriptorSetLayout &setLayout, PveDescriptorAllocator &allocator);
 
     PveDescriptorWriter &writeBuffer(uint32_t binding, VkDescriptorBufferInfo *bufferInfo);
-    PveDescriptorWriter &writeImage(uint32_t binding, VkDescriptorImageInfo *imageInfo);
+    // arrayElement picks one descriptor of an array binding
+    PveDescriptorWriter &writeImage(
+        uint32_t binding, VkDescriptorImageInfo *imageInfo, uint32_t arrayElement = 0);
 
     bool build(VkDescriptorSet &set);
     void overwrite(VkDescriptorSet &set);
 
    private:
     PveDescriptorSetLayout &setLayout;
-    PveDescriptorPool &pool;
+    // sets come from one or the other
+    PveDescriptorPool *pool = nullptr;
+    PveDescriptorAllocator *allocator = nullptr;
     std::vector<VkWriteDescriptorSet> writes;
 };
 
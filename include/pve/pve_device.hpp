@@ -1,13 +1,20 @@
 #pragma once
 
+#include "pve_allocator.hpp"
+#include "pve_pipeline_registry.hpp"
 #include "pve_window.hpp"
 
 // std lib headers
+#include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
 namespace pve {
 
+class PveBuffer;
+class PveDescriptorSetLayoutCache;
+
 struct SwapChainSupportDetails {
     VkSurfaceCapabilitiesKHR capabilities;
     std::vector<VkSurfaceFormatKHR> formats;
@@ -17,6 +24,8 @@ struct SwapChainSupportDetails {
 struct QueueFamilyIndices {
     uint32_t graphicsFamily;
     uint32_t presentFamily;
+    // a transfer only family when the device has one, the graphics family otherwise
+    uint32_t transferFamily;
     bool graphicsFamilyHasValue = false;
     bool presentFamilyHasValue = false;
     bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
@@ -44,6 +53,21 @@ class PveDevice {
     VkSurfaceKHR surface() { return surface_; }
     VkQueue graphicsQueue() { return graphicsQueue_; }
     VkQueue presentQueue() { return presentQueue_; }
+    // the same queue as graphicsQueue() when the device has no transfer only family
+    VkQueue transferQueue() { return transferQueue_; }
+    bool isHeadless() const { return window.isHeadless(); }
+    PveAllocator &getAllocator() { return *allocator; }
+    // waits for the device, then moves relocatable buffers into the fullest memory blocks and
+    // releases the blocks left empty. Returns the bytes moved. Handles of moved buffers change,
+    // so nothing may hold on to them across the call. Images are never moved, descriptors
+    // refer to their views
+    VkDeviceSize defragmentMemory();
+    PvePipelineRegistry &getPipelineRegistry() { return *pipelineRegistry; }
+    PveDescriptorSetLayoutCache &getDescriptorSetLayoutCache() { return *descriptorSetLayoutCache; }
+    const VkPhysicalDeviceFeatures &getEnabledFeatures() const { return enabledFeatures; }
+    bool isExtensionEnabled(const std::string &extensionName) const {
+        return enabledExtensions.count(extensionName) > 0;
+    }
 
     SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice); }
     uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
@@ -52,15 +76,23 @@ class PveDevice {
         const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
     // Buffer Helper Functions
+    // memory comes from the pooled allocator, release it with getAllocator().free().
+    // relocationHandle is the PveBuffer that owns the buffer if defragmentMemory() may move it
     void createBuffer(
         VkDeviceSize size,
         VkBufferUsageFlags usage,
         VkMemoryPropertyFlags properties,
         VkBuffer &buffer,
-        VkDeviceMemory &bufferMemory);
+        PveAllocation &bufferAllocation,
+        PveBuffer *relocationHandle = nullptr);
     VkCommandBuffer beginSingleTimeCommands();
     void endSingleTimeCommands(VkCommandBuffer commandBuffer);
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+    void copyBuffer(
+        VkBuffer srcBuffer,
+        VkBuffer dstBuffer,
+        VkDeviceSize size,
+        VkDeviceSize srcOffset = 0,
+        VkDeviceSize dstOffset = 0);
     void copyBufferToImage(
         VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
 
@@ -68,7 +100,7 @@ class PveDevice {
         const VkImageCreateInfo &imageInfo,
         VkMemoryPropertyFlags properties,
         VkImage &image,
-        VkDeviceMemory &imageMemory);
+        PveAllocation &imageAllocation);
 
     VkPhysicalDeviceProperties properties;
 
@@ -79,6 +111,9 @@ class PveDevice {
     void pickPhysicalDevice();
     void createLogicalDevice();
     void createCommandPool();
+    void createAllocator();
+    void createPipelineRegistry();
+    void createDescriptorSetLayoutCache();
 
     // helper functions
     bool isDeviceSuitable(VkPhysicalDevice device);
@@ -97,12 +132,23 @@ class PveDevice {
     VkCommandPool commandPool;
 
     VkDevice device_;
-    VkSurfaceKHR surface_;
+    VkSurfaceKHR surface_ = VK_NULL_HANDLE;
     VkQueue graphicsQueue_;
     VkQueue presentQueue_;
+    VkQueue transferQueue_;
+    std::unique_ptr<PveAllocator> allocator;
+    std::unique_ptr<PvePipelineRegistry> pipelineRegistry;
+    std::unique_ptr<PveDescriptorSetLayoutCache> descriptorSetLayoutCache;
+    VkPhysicalDeviceFeatures enabledFeatures{};
+    std::set<std::string> enabledExtensions;
 
     const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
-    const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    // the swapchain extension is added unless the device is headless and has nothing to
+    // present to
+    std::vector<const char *> deviceExtensions = {VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME};
+    // enabled only when the device supports them, check with isExtensionEnabled()
+    const std::vector<const char *> optionalDeviceExtensions = {
+        VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME};
 };
 
 }  // namespace pve
\ No newline at end of file
@@ -0,0 +1,235 @@
+#pragma once
+
+// std
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace pve {
+
+// an entity is just an id: the low bits index the sparse arrays and the high bits count how
+// many times that index has been reused, so a stale handle never matches a new entity
+using PveEntity = uint32_t;
+
+static constexpr uint32_t PVE_ENTITY_INDEX_BITS = 24;
+static constexpr uint32_t PVE_ENTITY_INDEX_MASK = (1u << PVE_ENTITY_INDEX_BITS) - 1;
+static constexpr PveEntity PVE_NULL_ENTITY = ~0u;
+
+inline uint32_t entityIndex(PveEntity entity) { return entity & PVE_ENTITY_INDEX_MASK; }
+inline uint32_t entityGeneration(PveEntity entity) { return entity >> PVE_ENTITY_INDEX_BITS; }
+
+class PveComponentPoolBase {
+   public:
+    virtual ~PveComponentPoolBase() = default;
+    virtual void remove(PveEntity entity) = 0;
+};
+
+// sparse set: the components are packed in a dense array in no particular order, with a
+// sparse array from entity index to dense slot. Iterating touches only the dense arrays
+template <typename T>
+class PveComponentPool : public PveComponentPoolBase {
+   public:
+    bool contains(PveEntity entity) const {
+        uint32_t index = entityIndex(entity);
+        return index < sparse.size() && sparse[index] != INVALID_SLOT &&
+               entities[sparse[index]] == entity;
+    }
+
+    // references into the pool are invalidated by the next emplace or remove
+    template <typename... Args>
+    T &emplace(PveEntity entity, Args &&...args) {
+        assert(!contains(entity) && "Entity already has this component");
+        uint32_t index = entityIndex(entity);
+        if (index >= sparse.size()) {
+            sparse.resize(index + 1, INVALID_SLOT);
+        }
+        sparse[index] = static_cast<uint32_t>(entities.size());
+        entities.push_back(entity);
+        version++;
+        components.push_back(T{std::forward<Args>(args)...});
+        return components.back();
+    }
+
+    // the last component is moved into the hole so the arrays stay packed
+    void remove(PveEntity entity) override {
+        if (!contains(entity)) return;
+        uint32_t slot = sparse[entityIndex(entity)];
+        uint32_t last = static_cast<uint32_t>(entities.size() - 1);
+        if (slot != last) {
+            entities[slot] = entities[last];
+            components[slot] = std::move(components[last]);
+            sparse[entityIndex(entities[slot])] = slot;
+        }
+        entities.pop_back();
+        components.pop_back();
+        sparse[entityIndex(entity)] = INVALID_SLOT;
+        version++;
+    }
+
+    T &get(PveEntity entity) {
+        assert(contains(entity) && "Entity doesn't have this component");
+        return components[sparse[entityIndex(entity)]];
+    }
+
+    T *tryGet(PveEntity entity) {
+        return contains(entity) ? &components[sparse[entityIndex(entity)]] : nullptr;
+    }
+
+    uint32_t size() const { return static_cast<uint32_t>(entities.size()); }
+    const std::vector<PveEntity> &getEntities() const { return entities; }
+    std::vector<T> &getComponents() { return components; }
+    // changes whenever a component is added or removed, i.e. whenever pointers into the
+    // pool or the order of its arrays may have changed
+    uint64_t getVersion() const { return version; }
+
+   private:
+    static constexpr uint32_t INVALID_SLOT = ~0u;
+
+    std::vector<uint32_t> sparse;
+    std::vector<PveEntity> entities;
+    std::vector<T> components;
+    uint64_t version = 0;
+};
+
+class PveRegistry;
+
+// iterates every entity that has all of the components. The first component's pool drives
+// the loop, so put the rarest one first
+template <typename First, typename... Rest>
+class PveView {
+   public:
+    explicit PveView(PveRegistry &registry);
+
+    // calls func(entity, First &, Rest &...) for every match
+    template <typename Func>
+    void each(Func &&func);
+
+   private:
+    PveComponentPool<First> &first;
+    std::tuple<PveComponentPool<Rest> &...> rest;
+};
+
+class PveRegistry {
+   public:
+    PveRegistry() = default;
+
+    PveRegistry(const PveRegistry &) = delete;
+    PveRegistry &operator=(const PveRegistry &) = delete;
+
+    PveEntity create() {
+        if (!freeIndices.empty()) {
+            uint32_t index = freeIndices.back();
+            freeIndices.pop_back();
+            return (generations[index] << PVE_ENTITY_INDEX_BITS) | index;
+        }
+        uint32_t index = static_cast<uint32_t>(generations.size());
+        assert(index <= PVE_ENTITY_INDEX_MASK && "Out of entity indices");
+        generations.push_back(0);
+        return index;
+    }
+
+    void destroy(PveEntity entity) {
+        if (!valid(entity)) return;
+        for (auto &pool : pools) {
+            if (pool != nullptr) pool->remove(entity);
+        }
+        uint32_t index = entityIndex(entity);
+        generations[index] = (generations[index] + 1) & (~0u >> PVE_ENTITY_INDEX_BITS);
+        freeIndices.push_back(index);
+    }
+
+    bool valid(PveEntity entity) const {
+        uint32_t index = entityIndex(entity);
+        return entity != PVE_NULL_ENTITY && index < generations.size() &&
+               generations[index] == entityGeneration(entity);
+    }
+
+    uint32_t size() const {
+        return static_cast<uint32_t>(generations.size() - freeIndices.size());
+    }
+
+    template <typename T, typename... Args>
+    T &emplace(PveEntity entity, Args &&...args) {
+        assert(valid(entity) && "Entity was destroyed");
+        return pool<T>().emplace(entity, std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    void remove(PveEntity entity) {
+        pool<T>().remove(entity);
+    }
+
+    template <typename T>
+    bool has(PveEntity entity) {
+        return pool<T>().contains(entity);
+    }
+
+    template <typename T>
+    T &get(PveEntity entity) {
+        return pool<T>().get(entity);
+    }
+
+    template <typename T>
+    T *tryGet(PveEntity entity) {
+        return pool<T>().tryGet(entity);
+    }
+
+    template <typename T>
+    PveComponentPool<T> &pool() {
+        uint32_t id = componentTypeId<T>();
+        if (id >= pools.size()) {
+            pools.resize(id + 1);
+        }
+        if (pools[id] == nullptr) {
+            pools[id] = std::make_unique<PveComponentPool<T>>();
+        }
+        return static_cast<PveComponentPool<T> &>(*pools[id]);
+    }
+
+    template <typename First, typename... Rest>
+    PveView<First, Rest...> view() {
+        return PveView<First, Rest...>{*this};
+    }
+
+   private:
+    // a small dense id per component type, handed out the first time a type is used
+    static uint32_t nextComponentTypeId() {
+        static uint32_t nextId = 0;
+        return nextId++;
+    }
+
+    template <typename T>
+    static uint32_t componentTypeId() {
+        static const uint32_t id = nextComponentTypeId();
+        return id;
+    }
+
+    std::vector<uint32_t> generations;
+    std::vector<uint32_t> freeIndices;
+    std::vector<std::unique_ptr<PveComponentPoolBase>> pools;
+};
+
+template <typename First, typename... Rest>
+PveView<First, Rest...>::PveView(PveRegistry &registry)
+    : first{registry.pool<First>()}, rest{registry.pool<Rest>()...} {}
+
+template <typename First, typename... Rest>
+template <typename Func>
+void PveView<First, Rest...>::each(Func &&func) {
+    auto &entities = first.getEntities();
+    auto &components = first.getComponents();
+    for (uint32_t i = 0; i < entities.size(); i++) {
+        PveEntity entity = entities[i];
+        if (!std::apply([&](auto &...pools) { return (pools.contains(entity) && ...); },
+                        rest)) {
+            continue;
+        }
+        std::apply([&](auto &...pools) { func(entity, components[i], pools.get(entity)...); },
+                   rest);
+    }
+}
+
+}  // namespace pve
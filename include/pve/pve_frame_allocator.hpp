@@ -0,0 +1,72 @@
+#pragma once
+
+#include "pve_buffer.hpp"
+#include "pve_device.hpp"
+
+// std
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace pve {
+
+// transient per frame data: uniforms, storage and vertex data written by the CPU and read by
+// the GPU only in the frame that wrote it. One persistently mapped, coherent buffer is split
+// into a region per frame in flight, and allocating is bumping an offset in the current
+// frame's region. Nothing is freed, the whole region is reset once its frame's fence has
+// signaled.
+// Descriptors point at offset 0 of the buffer and are bound with an allocation's offset as
+// their dynamic offset, so they're written once and never updated.
+// allocate() is safe to call from several threads at once, beginFrame() is not
+class PveFrameAllocator {
+   public:
+    static constexpr VkDeviceSize DEFAULT_FRAME_CAPACITY = 4 * 1024 * 1024;
+
+    struct Allocation {
+        void *mapped;
+        // from the start of the buffer, usable as a dynamic offset as it is
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    // capacity is per frame in flight, rounded up to the offset alignments
+    PveFrameAllocator(PveDevice &device, VkDeviceSize capacity = DEFAULT_FRAME_CAPACITY);
+
+    PveFrameAllocator(const PveFrameAllocator &) = delete;
+    PveFrameAllocator &operator=(const PveFrameAllocator &) = delete;
+
+    // right after the renderer begins the frame, which waited on the fence of the last frame
+    // that used frameIndex. Everything allocated back then is free again
+    void beginFrame(int frameIndex);
+
+    // throws once the frame's region is full, its capacity bounds what a frame can stream
+    Allocation allocate(VkDeviceSize size, VkDeviceSize alignment);
+    // aligned for binding through a uniform or storage buffer descriptor
+    Allocation allocateUniform(VkDeviceSize size) { return allocate(size, uniformAlignment); }
+    Allocation allocateStorage(VkDeviceSize size) { return allocate(size, storageAlignment); }
+
+    // a range for a dynamic descriptor, range is the size of what every allocation bound
+    // through it holds
+    VkDescriptorBufferInfo descriptorInfo(VkDeviceSize range) const {
+        return {buffer->getBuffer(), 0, range};
+    }
+
+    VkBuffer getBuffer() const { return buffer->getBuffer(); }
+    VkDeviceSize getFrameCapacity() const { return frameCapacity; }
+    // bytes allocated in the current frame so far
+    VkDeviceSize getUsedBytes() const { return head.load(std::memory_order_relaxed) - frameStart; }
+
+   private:
+    PveDevice &pveDevice;
+    VkDeviceSize uniformAlignment;
+    VkDeviceSize storageAlignment;
+    VkDeviceSize frameCapacity;
+    std::unique_ptr<PveBuffer> buffer;
+    char *mapped = nullptr;
+
+    // the current frame's region is [frameStart, frameStart + frameCapacity)
+    VkDeviceSize frameStart = 0;
+    std::atomic<VkDeviceSize> head{0};
+};
+
+}  // namespace pve
@@ -3,15 +3,17 @@
 #include <vulkan/vulkan.h>
 
 #include "pve_camera.hpp"
+#include "pve_descriptors.hpp"
+#include "pve_frame_allocator.hpp"
 #include "pve_game_object.hpp"
+#include "pve_job_system.hpp"
 
 namespace pve {
 
-#define MAX_LIGHTS 10
-
+// one element of the point light storage buffer, mirrored in the shaders
 struct PointLight {
-    glm::vec4 position{};
-    glm::vec4 color{};
+    glm::vec4 position{};  // w is how far the light reaches
+    glm::vec4 color{};     // w is intensity
 };
 
 struct GlobalUbo {
@@ -21,8 +23,13 @@ struct GlobalUbo {
     // also, we can transform a value from camera to world space
     glm::mat4 inverseView{1.f};
     glm::vec4 ambientLightColor{1.f, 1.f, 1.f, .02f};
-    PointLight pointLights[MAX_LIGHTS];
-    int numLights;
+    // x, y and z are the size of the light cluster grid, w is the number of point lights
+    glm::uvec4 clusterCounts{};
+    // x and y are a cluster's size in pixels, z and w turn a view depth into a depth slice
+    glm::vec4 clusterParams{};
+    // x and y are the framebuffer's size in pixels, the last clusters of a row or column are
+    // cut off by it
+    glm::vec4 framebufferSize{};
 };
 
 struct FrameInfo {
@@ -31,6 +38,14 @@ struct FrameInfo {
     VkCommandBuffer commandBuffer;
     PveCamera &camera;
     VkDescriptorSet globalDescriptorSet;
-    PveGameObject::Map &gameObjects;
+    PveRegistry &registry;
+    // systems fan their work out on it, null runs everything on the calling thread
+    PveJobSystem *jobSystem = nullptr;
+    // transient data for this frame only
+    PveFrameAllocator *frameAllocator = nullptr;
+    // descriptor sets for this frame only, all freed at once when the frame comes around again
+    PveDescriptorAllocator *frameDescriptors = nullptr;
+    // dynamic offset of the GlobalUbo, binding 0 of the global set
+    uint32_t globalUboOffset = 0;
 };
 }  // namespace pve
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS  // No matter what system i'm in, angles are in radians, not degrees
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE  // Forces GLM to expect depth buffer values to range from 0 to 1 instead of -1 to 1 (the opengl standard)
+#include <glm/glm.hpp>
+
+#include "pve_camera.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace pve {
+
+// the six planes of a view volume in world space. Every plane's normal points inwards,
+// so a point is inside when dot(plane.xyz, point) + plane.w >= 0 for all of them
+struct PveFrustum {
+    enum Plane { LEFT = 0, RIGHT, BOTTOM, TOP, NEAR, FAR, PLANE_COUNT };
+
+    glm::vec4 planes[PLANE_COUNT];
+
+    // extracted straight from projection * view, expects a 0 to 1 depth range
+    static PveFrustum fromMatrix(const glm::mat4 &projectionView);
+    static PveFrustum fromCamera(const PveCamera &camera);
+
+    bool intersectsSphere(const glm::vec3 &center, float radius) const;
+};
+
+struct PveCullingStats {
+    uint32_t visibleCount = 0;
+    uint32_t culledCount = 0;
+};
+
+// tests a batch of world space bounding spheres against a frustum. The spheres are packed
+// as a structure of arrays so the SSE path tests four of them per plane at once
+class PveFrustumCuller {
+   public:
+    void clear();
+    // returns the index to ask isVisible() with after cull()
+    uint32_t addSphere(const glm::vec3 &center, float radius);
+    PveCullingStats cull(const PveFrustum &frustum);
+
+    bool isVisible(uint32_t index) const { return visible[index] != 0; }
+    uint32_t getSphereCount() const { return static_cast<uint32_t>(radii.size()); }
+
+   private:
+    std::vector<float> centersX;
+    std::vector<float> centersY;
+    std::vector<float> centersZ;
+    std::vector<float> radii;
+    std::vector<uint8_t> visible;
+};
+
+}  // namespace pve
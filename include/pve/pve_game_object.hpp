@@ -3,92 +3,110 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <memory>
 #include <string>
-#include <unordered_map>
 
+#include "pve_ecs.hpp"
 #include "pve_model.hpp"
 
 namespace pve {
-struct TransformComponent {
-    glm::vec3 translation{};  // move objects up, down, left, right
-    glm::vec3 scale{1.f, 1.f, 1.f};
-    glm::vec3 rotation{};
+// the matrices are cached and only rebuilt after the translation, rotation or scale change.
+// TransformSystem rebuilds every dirty transform once per frame in a batch, mat4() and
+// normalMatrix() fall back to rebuilding a single one if they're asked first.
+// The translation, rotation and scale are relative to the parent, if there is one, while
+// mat4() and normalMatrix() are always in world space
+class TransformComponent {
+   public:
+    const glm::vec3 &getTranslation() const { return translation; }
+    const glm::vec3 &getRotation() const { return rotation; }
+    const glm::vec3 &getScale() const { return scale; }
+
+    void setTranslation(const glm::vec3 &value) {
+        translation = value;
+        dirty = true;
+    }
+    void setRotation(const glm::vec3 &value) {
+        rotation = value;
+        dirty = true;
+    }
+    void setScale(const glm::vec3 &value) {
+        scale = value;
+        dirty = true;
+    }
+
+    bool isDirty() const { return dirty; }
+    bool hasParent() const { return parented; }
+    // changes whenever mat4() may return something new, read it after calling mat4() so a
+    // pending rebuild is counted
+    uint32_t getWorldVersion() const { return worldVersion; }
 
     // Matrix corrsponds to Translate * Ry * Rx * Rz * Scale
     // Rotations correspond to Tait-bryan angles of Y(1), X(2), Z(3)
     // https://en.wikipedia.org/wiki/Euler_angles#Rotation_matrix
-    glm::mat4 mat4();
-    glm::mat3 normalMatrix();
+    const glm::mat4 &mat4();
+    const glm::mat3 &normalMatrix();
+    // the same matrices without the parent's transform
+    const glm::mat4 &localMatrix();
+    const glm::mat3 &localNormalMatrix();
+
+    // rebuilds the cached matrices from the sines and cosines of the rotation's x, y and z,
+    // so callers can compute those for many transforms at once
+    void updateMatrices(const glm::vec3 &sines, const glm::vec3 &cosines);
+
+   private:
+    // the scene graph owns the world matrices of transforms with a parent
+    friend class PveSceneGraph;
+
+    glm::vec3 translation{};  // move objects up, down, left, right
+    glm::vec3 scale{1.f, 1.f, 1.f};
+    glm::vec3 rotation{};
+
+    glm::mat4 cachedMatrix{1.f};
+    glm::mat3 cachedNormalMatrix{1.f};
+    bool dirty = true;
+    // bumped every time the cached matrices are rebuilt, so the scene graph can tell which
+    // nodes changed since it last looked
+    uint32_t version = 0;
+
+    // only used when parented, otherwise the world matrices are the local ones
+    glm::mat4 worldMatrix{1.f};
+    glm::mat3 worldNormalMatrix{1.f};
+    bool parented = false;
+    uint32_t worldVersion = 0;
+};
+
+// puts an entity under another one in the scene graph. Set it with
+// PveSceneGraph::setParent, which keeps the hierarchy free of cycles
+struct ParentComponent {
+    PveEntity parent = PVE_NULL_ENTITY;
 };
 
 struct PointLightComponent {
     float lightIntensity = 1.0f;
 };
 
-// a Game Object is anything in the game with a collection of properties and
-// methods
-class PveGameObject {
-   public:
-    using id_t = unsigned int;
-    using Map = std::unordered_map<id_t, PveGameObject>;
-
-    static PveGameObject createGameObject() {
-        static id_t currentId = 0;
-        return PveGameObject{currentId++};
-    }
-
-    static PveGameObject makePointLight(
-        float intensity = 10.0f, float radius = 0.1f, glm::vec3 color = glm::vec3(1.0f));
-
-    // The PveGameObject class uses a unique ID (id_t) to identify objects.
-    // Allowing copies or assignments could result in two objects sharing the
-    // same id, breaking the uniqueness constraint. Deleting these methods
-    // ensures that each PveGameObject remains distinct.
-
-    // this deletes the copy constructor.
-    // prevents creating a new PveGameObject by copying an existing one.
-    // Ex: PveGameObject obj1 = PveGameObject::createGameObject();
-    //     PveGameObject obj2 = obj1; // Error: copy constructor is deleted
-    PveGameObject(const PveGameObject &) = delete;
-
-    // This deletes the copy assignment operator.
-    // Prevents assigning one PveGameObject to another.
-    // Ex: PveGameObject obj1 = PveGameObject::createGameObject();
-    //     PveGameObject obj2 = PveGameObject::createGameObject();
-    //     obj2 = obj1; // Error: copy assignment operator is deleted
-    PveGameObject &operator=(const PveGameObject &) = delete;
-
-    // Moving avoids the cost of copying and ensures the uniqueness of the id is
-    // maintained. The default move constructor and assignment operator are
-    // sufficient since the class manages no complex resources like dynamic
-    // memory or file handles.
-
-    // This uses the default move constructor. Allows moving an object instead
-    // of copying it. Moving transfers ownership of the resource (here, the ID)
-    // from the source to the destination without duplication. Ex: PveGameObject
-    // obj1 = PveGameObject::createGameObject();
-    //     PveGameObject obj2 = std::move(obj1); // Move constructor
-    PveGameObject(PveGameObject &&) = default;
-
-    // This uses the default move assignment operator. Allows moving an object
-    // during assignment. Similar to the move constructor, it transfers
-    // ownership without creating a duplicate. Ex: PveGameObject obj1 =
-    // PveGameObject::createGameObject();
-    //     PveGameObject obj2 = PveGameObject::createGameObject();
-    //     obj2 = std::move(obj1); // Move assignment operator
-    PveGameObject &operator=(PveGameObject &&) = default;
-
-    const id_t getId() { return id; }
+struct ModelComponent {
+    std::shared_ptr<PveModel> model{};
+};
 
+struct ColorComponent {
     glm::vec3 color{};
-    TransformComponent transform{};
-    std::string name;
+};
 
-    // Optional pointer components
-    std::shared_ptr<PveModel> model{};
-    std::unique_ptr<PointLightComponent> pointLight = nullptr;
+// an index into the PveMaterialLibrary's materials. Models without one get its default
+// material
+struct MaterialComponent {
+    uint32_t materialIndex = 0;
+};
 
-   private:
-    PveGameObject(id_t objId) : id{objId} {}
-    id_t id;
+struct NameComponent {
+    std::string name;
 };
+
+// a game object is now an entity in a PveRegistry with any of the components above.
+// A point light is its transform, color and PointLightComponent, with the radius in the
+// transform's scale.x
+PveEntity makePointLight(
+    PveRegistry &registry,
+    float intensity = 10.0f,
+    float radius = 0.1f,
+    glm::vec3 color = glm::vec3(1.0f));
 }  // namespace pve
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "pve_allocator.hpp"
+#include "pve_buffer.hpp"
+#include "pve_device.hpp"
+#include "pve_upload_manager.hpp"
+
+// std
+#include <future>
+#include <memory>
+
+namespace pve {
+
+// one large device local vertex buffer and one large index buffer shared by many models.
+// A frame binds both once and every model draws with its own vertexOffset and firstIndex
+class PveGeometryArena {
+   public:
+    struct Range {
+        uint32_t firstVertex = 0;
+        uint32_t vertexCount = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+    };
+
+    PveGeometryArena(PveDevice &device, VkDeviceSize vertexStride, uint32_t maxVertexCount,
+                     uint32_t maxIndexCount);
+    ~PveGeometryArena();
+
+    PveGeometryArena(const PveGeometryArena &) = delete;
+    PveGeometryArena &operator=(const PveGeometryArena &) = delete;
+
+    // returns false when the arena has no room left, the caller should fall back to its own buffers
+    bool allocate(uint32_t vertexCount, uint32_t indexCount, Range &range);
+    void free(const Range &range);
+    // without an upload manager the copy finishes before this returns and the future is
+    // left empty
+    std::shared_future<void> upload(const Range &range, const void *vertices,
+                                    const uint32_t *indices,
+                                    PveUploadManager *uploadManager = nullptr);
+
+    void bind(VkCommandBuffer commandBuffer);
+
+    VkBuffer getVertexBuffer() const { return vertexBuffer->getBuffer(); }
+    VkBuffer getIndexBuffer() const { return indexBuffer->getBuffer(); }
+
+   private:
+    PveDevice &pveDevice;
+    VkDeviceSize vertexStride;
+
+    std::unique_ptr<PveBuffer> vertexBuffer;
+    std::unique_ptr<PveBuffer> indexBuffer;
+    // both allocators count elements, not bytes
+    PveRangeAllocator vertexRanges;
+    PveRangeAllocator indexRanges;
+};
+
+}  // namespace pve
@@ -0,0 +1,127 @@
+#pragma once
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pve {
+
+// counts the unfinished jobs spawned with it. Waiting on it is how jobs are joined, and a
+// job that depends on others waits on their counter first
+class PveJobCounter {
+   public:
+    bool isDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+   private:
+    friend class PveJobSystem;
+    std::atomic<uint32_t> pending{0};
+};
+
+// a fixed pool of worker threads, each with a lock free Chase-Lev work stealing deque. A
+// thread pushes and pops jobs at the bottom of its own deque, newest first so its caches stay
+// warm, and idle workers steal the oldest jobs from the top of the others'.
+// The thread that creates the job system is worker 0: it runs jobs while it waits on a
+// counter. Jobs may only be spawned from that thread or from inside other jobs, spawn() and
+// wait() throw on any other thread
+class PveJobSystem {
+   public:
+    using JobFunction = std::function<void()>;
+
+    // 0 uses one worker per hardware thread, the creating thread included
+    explicit PveJobSystem(uint32_t workerCount = 0);
+    ~PveJobSystem();
+
+    PveJobSystem(const PveJobSystem &) = delete;
+    PveJobSystem &operator=(const PveJobSystem &) = delete;
+
+    // the counter is optional, without one there's no way to know when the job is done
+    void spawn(JobFunction function, PveJobCounter *counter);
+    // runs other jobs until every job spawned with the counter has finished
+    void wait(PveJobCounter &counter);
+
+    // calls func(begin, end) on contiguous chunks of [0, count), at least grainSize long
+    // except for the last one, and returns once they're all done. The calling thread takes a
+    // chunk too
+    template <typename Func>
+    void parallelFor(uint32_t count, uint32_t grainSize, Func &&func);
+
+    uint32_t getWorkerCount() const { return static_cast<uint32_t>(workers.size()); }
+
+   private:
+    // a power of two. A full deque makes spawn() run the job inline instead
+    static constexpr int64_t DEQUE_CAPACITY = 4096;
+
+    struct Job {
+        JobFunction function;
+        PveJobCounter *counter = nullptr;
+        // the slot is only reused once its previous job has run
+        std::atomic<bool> finished{true};
+    };
+
+    // owner: push() and pop() at the bottom. Anyone: steal() from the top
+    class Deque {
+       public:
+        bool push(Job *job);
+        Job *pop();
+        Job *steal();
+
+       private:
+        // apart, so the owner and the thieves don't keep taking the cache line from each other
+        alignas(64) std::atomic<int64_t> top{0};
+        alignas(64) std::atomic<int64_t> bottom{0};
+        std::unique_ptr<std::atomic<Job *>[]> buffer{new std::atomic<Job *>[DEQUE_CAPACITY]};
+    };
+
+    struct Worker {
+        Deque deque;
+        // the jobs this worker spawned, handed out round robin
+        std::unique_ptr<Job[]> jobs{new Job[DEQUE_CAPACITY]};
+        uint32_t nextJob = 0;
+        uint32_t randomState = 0;
+    };
+
+    void workerLoop(uint32_t index);
+    uint32_t currentWorker() const;
+    // its own deque first, then the others' in a random order
+    Job *findJob(uint32_t index);
+    void execute(Job &job);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    // jobs sitting in any deque. Workers sleep while it's zero
+    std::atomic<int64_t> queuedJobs{0};
+    std::atomic<uint32_t> sleepingWorkers{0};
+    std::mutex sleepMutex;
+    std::condition_variable jobAvailable;
+    std::atomic<bool> stopping{false};
+};
+
+template <typename Func>
+void PveJobSystem::parallelFor(uint32_t count, uint32_t grainSize, Func &&func) {
+    if (count == 0) return;
+    grainSize = std::max(grainSize, 1u);
+    // a few chunks per worker, so stealing can even out chunks that take longer than others
+    uint32_t chunkCount = std::min((count - 1) / grainSize + 1, getWorkerCount() * 4);
+    auto chunkEnd = [&](uint32_t chunk) {
+        return static_cast<uint32_t>(static_cast<uint64_t>(count) * (chunk + 1) / chunkCount);
+    };
+
+    PveJobCounter counter;
+    for (uint32_t chunk = 1; chunk < chunkCount; chunk++) {
+        uint32_t begin = chunkEnd(chunk - 1);
+        uint32_t end = chunkEnd(chunk);
+        spawn([&func, begin, end] { func(begin, end); }, &counter);
+    }
+    func(0u, chunkEnd(0));
+    wait(counter);
+}
+
+}  // namespace pve
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "pve_buffer.hpp"
+#include "pve_descriptors.hpp"
+#include "pve_device.hpp"
+#include "pve_texture.hpp"
+
+// libs
+#define GLM_FORCE_RADIANS            // No matter what system i'm in, angles are in radians, not degrees
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE  // Forces GLM to expect depth buffer values to range from 0 to 1 instead of -1 to 1 (the opengl standard)
+#include <glm/glm.hpp>
+
+// std
+#include <memory>
+#include <vector>
+
+namespace pve {
+
+// one element of the material storage buffer, mirrored in the shaders
+struct PveMaterial {
+    glm::vec4 baseColorFactor{1.f};
+    // index into the library's texture array
+    uint32_t baseColorTexture = 0;
+    uint32_t padding[3]{};
+};
+
+// every texture and material in one descriptor set, bound once per pipeline. Textures go
+// into a large array of combined image samplers that shaders index with the material's
+// texture indices, materials into a storage buffer indexed with a per draw material index,
+// so switching materials between draws binds nothing.
+// New textures are written into their slot of the array while frames using it are still in
+// flight, through descriptor indexing's update after bind. Textures and materials are never
+// removed. Not thread safe
+class PveMaterialLibrary {
+   public:
+    // must match MAX_TEXTURES in the shaders
+    static constexpr uint32_t MAX_TEXTURES = 4096;
+    static constexpr uint32_t MAX_MATERIALS = 4096;
+    // a white texel, and a white material using it
+    static constexpr uint32_t DEFAULT_TEXTURE = 0;
+    static constexpr uint32_t DEFAULT_MATERIAL = 0;
+
+    explicit PveMaterialLibrary(PveDevice &device);
+    ~PveMaterialLibrary();
+
+    PveMaterialLibrary(const PveMaterialLibrary &) = delete;
+    PveMaterialLibrary &operator=(const PveMaterialLibrary &) = delete;
+
+    // returns the texture's index, the library keeps it alive
+    uint32_t addTexture(std::shared_ptr<PveTexture> texture);
+    // returns the material's index. Its textures have to be in the library already
+    uint32_t addMaterial(const PveMaterial &material);
+
+    VkDescriptorSetLayout getSetLayout() const { return setLayout->getDescriptorSetLayout(); }
+    VkDescriptorSet getDescriptorSet() const { return descriptorSet; }
+    uint32_t getTextureCount() const { return static_cast<uint32_t>(textures.size()); }
+    uint32_t getMaterialCount() const { return materialCount; }
+
+   private:
+    void createSampler();
+    void createDescriptors();
+
+    PveDevice &pveDevice;
+    // shared by every texture
+    VkSampler sampler = VK_NULL_HANDLE;
+    std::unique_ptr<PveDescriptorPool> descriptorPool;
+    std::shared_ptr<PveDescriptorSetLayout> setLayout;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+    std::vector<std::shared_ptr<PveTexture>> textures;
+    // host visible, a material is written once into a slot no frame has read yet
+    std::unique_ptr<PveBuffer> materialBuffer;
+    uint32_t materialCount = 0;
+};
+
+}  // namespace pve
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "pve_bounds.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace pve {
+
+// on-disk layout of a cooked mesh. The vertex and index arrays follow the header
+// already deduplicated, so they can be copied to a staging buffer as they are
+struct PveMeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexStride;  // rejects caches written with a different vertex layout
+    uint32_t indexStride;   // 2 when every index fits 16 bits, 4 otherwise
+    uint64_t sourceSize;          // size and modification time of the .obj the cache was
+    int64_t sourceModifiedTimeNs;  // built from, a mismatch means the cache is stale
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t vertexOffset;  // byte offsets from the start of the file
+    uint64_t indexOffset;
+    PveBounds bounds;
+};
+
+// a read only memory mapping of the cache that belongs to a source mesh file
+class PveMeshCache {
+   public:
+    static constexpr uint32_t MAGIC = 0x48534d50;  // "PMSH"
+    static constexpr uint32_t VERSION = 3;
+
+    // maps <sourcePath>.pvemesh if it exists and still matches the source, otherwise
+    // the cache is left invalid and the caller has to load the source itself
+    PveMeshCache(const std::string &sourcePath, uint32_t vertexStride);
+    ~PveMeshCache();
+
+    PveMeshCache(const PveMeshCache &) = delete;
+    PveMeshCache &operator=(const PveMeshCache &) = delete;
+
+    bool isValid() const { return header != nullptr; }
+
+    const void *getVertexData() const;
+    uint32_t getVertexCount() const { return static_cast<uint32_t>(header->vertexCount); }
+    const void *getIndexData() const;
+    uint32_t getIndexCount() const { return static_cast<uint32_t>(header->indexCount); }
+    uint32_t getIndexStride() const { return header->indexStride; }
+    const PveBounds &getBounds() const { return header->bounds; }
+
+    static std::string cachePathFor(const std::string &sourcePath);
+
+    // returns false if the cache could not be written, e.g. for a read only asset directory
+    static bool write(const std::string &sourcePath, const void *vertices, uint32_t vertexCount,
+                      uint32_t vertexStride, const void *indices, uint32_t indexCount,
+                      uint32_t indexStride, const PveBounds &bounds);
+
+   private:
+    void *mapped = nullptr;
+    size_t mappedSize = 0;
+    const PveMeshCacheHeader *header = nullptr;
+};
+
+}  // namespace pve
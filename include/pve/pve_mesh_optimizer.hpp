@@ -0,0 +1,85 @@
+#pragma once
+
+#include "pve_vertex.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace pve {
+
+// reorders an indexed triangle list so the GPU does less work drawing it, without changing
+// what is drawn. Runs on loaded meshes after deduplication, before they are packed and cached
+class PveMeshOptimizer {
+   public:
+    // entries of the post transform vertex cache that is modelled, a FIFO. Small enough that
+    // the order holds up on GPUs with bigger caches
+    static constexpr uint32_t CACHE_SIZE = 16;
+
+    struct Options {
+        bool vertexCache = true;
+        // needs vertexCache, its clusters are what gets sorted
+        bool overdraw = true;
+        // how much worse than the cache order's ACMR a cluster may get so there are more
+        // clusters to sort
+        float overdrawThreshold = 1.05f;
+        bool vertexFetch = true;
+        uint32_t cacheSize = CACHE_SIZE;
+    };
+
+    // ACMR is the vertex shader invocations per triangle, 0.5 at best and 3 at worst. ATVR is
+    // the invocations per vertex, 1 at best
+    struct CacheStats {
+        float acmr = 0.f;
+        float atvr = 0.f;
+    };
+
+    struct Report {
+        CacheStats before;
+        CacheStats after;
+    };
+
+    // all the enabled passes in order, then the indices fit 16 bits if fitsUint16 says so
+    static Report optimize(std::vector<PveVertex> &vertices, std::vector<uint32_t> &indices,
+                           const Options &options);
+
+    // Tipsify (Sander et al. 2007): fans around vertices still in the cache, and jumps to a
+    // recently used vertex when it runs out. Returns the first triangle of every cluster,
+    // which start where it had to jump
+    static std::vector<uint32_t> optimizeVertexCache(std::vector<uint32_t> &indices,
+                                                     uint32_t vertexCount,
+                                                     uint32_t cacheSize = CACHE_SIZE);
+
+    // splits the clusters further where that costs little cache efficiency, then draws the
+    // clusters facing away from the mesh's center first, since they tend to occlude the rest
+    static void optimizeOverdraw(std::vector<uint32_t> &indices,
+                                 const std::vector<uint32_t> &clusters,
+                                 const std::vector<PveVertex> &vertices,
+                                 uint32_t cacheSize = CACHE_SIZE, float threshold = 1.05f);
+
+    // renumbers the vertices in the order the indices first use them and drops the unused
+    // ones, so vertex fetches walk the buffer forward
+    template <typename VertexT>
+    static void optimizeVertexFetch(std::vector<VertexT> &vertices,
+                                    std::vector<uint32_t> &indices) {
+        std::vector<uint32_t> order =
+            remapVertexFetch(indices, static_cast<uint32_t>(vertices.size()));
+        std::vector<VertexT> remapped(order.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            remapped[i] = vertices[order[i]];
+        }
+        vertices.swap(remapped);
+    }
+
+    // rewrites the indices in first use order and returns the old index of every new vertex
+    static std::vector<uint32_t> remapVertexFetch(std::vector<uint32_t> &indices,
+                                                  uint32_t vertexCount);
+
+    static CacheStats analyzeVertexCache(const std::vector<uint32_t> &indices,
+                                         uint32_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+
+    // primitive restart is never enabled, so every 16 bit value is a usable index
+    static bool fitsUint16(uint32_t vertexCount) { return vertexCount <= 65536; }
+};
+
+}  // namespace pve
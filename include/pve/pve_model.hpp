@@ -1,7 +1,13 @@
 #pragma once
 
+#include "pve_bounds.hpp"
 #include "pve_buffer.hpp"
 #include "pve_device.hpp"
+#include "pve_geometry_arena.hpp"
+#include "pve_mesh_cache.hpp"
+#include "pve_mesh_optimizer.hpp"
+#include "pve_upload_manager.hpp"
+#include "pve_vertex.hpp"
 
 // libs
 #define GLM_FORCE_RADIANS            // No matter what system i'm in, angles are in radians, not degrees
@@ -9,6 +15,7 @@
 #include <glm/glm.hpp>
 
 // std
+#include <future>
 #include <memory>
 #include <vector>
 
@@ -17,44 +24,81 @@ namespace pve {
 // and allocate the memory and copy the data to the GPU so it can be rendered efficiently
 class PveModel {
    public:
-    struct Vertex {
-        glm::vec3 position{};
-        glm::vec3 color{};
-        glm::vec3 normal{};
-        glm::vec2 uv{};
-
-        static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
-        static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
-
-        bool operator==(const Vertex &other) const {
-            return position == other.position && color == other.color && normal == other.normal && uv == other.uv;
-        }
-    };
+    using Vertex = PveVertex;
+    // what the vertex buffers hold, see pve_vertex.hpp
+    using GpuVertex = PveGpuVertex;
 
     struct Builder {
         std::vector<Vertex> vertices{};
         std::vector<uint32_t> indices{};
+        PveBounds bounds{};
+        // the vertices in the GPU layout, filled by the loaders. Left empty, the model packs
+        // the vertices itself
+        std::vector<GpuVertex> packedVertices{};
 
+        // parses the .obj, runs PveMeshOptimizer on it, computes its bounds and writes a binary
+        // cache next to it for the next load
         void loadModel(const std::string &filepath);
+        // copies the binary cache in when it's up to date, otherwise parses like loadModel.
+        // The cache only holds packed vertices, so vertices is left empty when it's used
+        void loadCachedModel(const std::string &filepath);
+        // only needed when vertices are filled in by hand, packed positions are relative to it
+        void computeBounds();
     };
 
-    PveModel(PveDevice &device, const PveModel::Builder &builder);
+    // with an arena the geometry is placed in its shared buffers when there's room,
+    // otherwise the model gets buffers of its own.
+    // With an upload manager the constructor returns before the geometry reaches the GPU,
+    // check isReady() before drawing the model
+    PveModel(PveDevice &device, const PveModel::Builder &builder, PveGeometryArena *arena = nullptr,
+             PveUploadManager *uploadManager = nullptr);
+    PveModel(PveDevice &device, const PveMeshCache &meshCache, PveGeometryArena *arena = nullptr,
+             PveUploadManager *uploadManager = nullptr);
     ~PveModel();
 
     PveModel(const PveModel &) = delete;
     PveModel &operator=(const PveModel &) = delete;
 
-    static std::unique_ptr<PveModel> createModelFromFile(PveDevice &device, const std::string &filepath);
+    // uses the binary mesh cache when it is up to date and only falls back to parsing the .obj
+    static std::unique_ptr<PveModel> createModelFromFile(
+        PveDevice &device, const std::string &filepath, PveGeometryArena *arena = nullptr,
+        PveUploadManager *uploadManager = nullptr);
+
+    static std::vector<VkVertexInputBindingDescription> getBindingDescriptions() {
+        return PveVertexLayout<GpuVertex>::getBindingDescriptions();
+    }
+    static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions() {
+        return PveVertexLayout<GpuVertex>::getAttributeDescriptions();
+    }
 
     void bind(VkCommandBuffer commandBuffer);
-    void draw(VkCommandBuffer commandBuffer);
+    void draw(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+
+    // null when the model owns its buffers. Models sharing an arena only need it bound once
+    PveGeometryArena *getGeometryArena() const { return geometryArena; }
+    const PveGeometryArena::Range &getGeometryRange() const { return geometryRange; }
+    const PveBounds &getBounds() const { return bounds; }
+    // has to reach the vertex shader with every draw of the model
+    const PvePositionDequantization &getDequantization() const { return dequantization; }
+    // false while the geometry is still being uploaded
+    bool isReady();
+    // 16 bit only for models with buffers of their own, the arena's indices are 32 bit
+    VkIndexType getIndexType() const { return indexType; }
+    // the vertex and index bytes the model uploaded, in its own buffers or in the arena
+    VkDeviceSize getGeometryBytes() const;
 
     // the buffer and its assigned memory are two separate objects
     // memory is not automatically assigned to the buffer
     // the programmer controls memory management
    private:
-    void createVertexBuffers(const std::vector<Vertex> &vertices);
-    void createIndexBuffers(const std::vector<uint32_t> &indices);
+    void createBuffers(
+        const GpuVertex *vertices, uint32_t vertexCount, const void *indices,
+        uint32_t indexCount, VkIndexType indexType, PveGeometryArena *arena,
+        PveUploadManager *uploadManager);
+    void createVertexBuffers(
+        const GpuVertex *vertices, uint32_t vertexCount, PveUploadManager *uploadManager);
+    void createIndexBuffers(const void *indices, uint32_t indexCount, VkIndexType indexType,
+                            PveUploadManager *uploadManager);
 
     PveDevice &pveDevice;
 
@@ -64,5 +108,16 @@ class PveModel {
     bool hasIndexBuffer = false;
     std::unique_ptr<PveBuffer> indexBuffer;
     uint32_t indexCount;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+
+    PveBounds bounds{};
+    PvePositionDequantization dequantization{};
+
+    PveGeometryArena *geometryArena = nullptr;
+    PveGeometryArena::Range geometryRange{};
+
+    // the model's last upload, futures become ready in order so it covers the earlier ones.
+    // Empty once it's ready
+    std::shared_future<void> uploadsDone;
 };
 }  // namespace pve
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "pve_device.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace pve {
+
+// lets several threads record the swap chain render pass at once. Every worker owns one
+// command pool per frame in flight, so no two threads ever share a pool, and records
+// secondary command buffers that continue the render pass begun on the primary buffer.
+// The render pass has to be begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, and
+// then everything inside it, from every system, goes through here
+class PveParallelRecorder {
+   public:
+    PveParallelRecorder(PveDevice &device, uint32_t workerCount);
+    ~PveParallelRecorder();
+
+    PveParallelRecorder(const PveParallelRecorder &) = delete;
+    PveParallelRecorder &operator=(const PveParallelRecorder &) = delete;
+
+    uint32_t getWorkerCount() const { return workerCount; }
+
+    // resets the frame's command pools, so its fence must already have signaled
+    void beginFrame(int frameIndex, VkRenderPass renderPass, VkFramebuffer framebuffer,
+                    VkExtent2D extent);
+
+    // begins a secondary command buffer from the worker's pool with the viewport and scissor
+    // already set. Only one thread at a time may record for a given worker
+    VkCommandBuffer beginSecondary(uint32_t worker);
+    void endSecondary(VkCommandBuffer commandBuffer);
+
+    // main thread only: the secondaries are executed in the order they're queued
+    void queue(VkCommandBuffer commandBuffer);
+    void execute(VkCommandBuffer primaryCommandBuffer);
+
+   private:
+    struct WorkerPool {
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        // allocated on demand and reused every time the pool is reset
+        std::vector<VkCommandBuffer> commandBuffers;
+        uint32_t usedCount = 0;
+    };
+
+    PveDevice &pveDevice;
+    uint32_t workerCount;
+    // frame major: the pools of frame f are [f * workerCount, (f + 1) * workerCount)
+    std::vector<WorkerPool> workerPools;
+
+    int frameIndex = 0;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;
+    VkExtent2D extent{};
+    std::vector<VkCommandBuffer> queued;
+};
+
+}  // namespace pve
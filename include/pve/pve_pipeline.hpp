@@ -1,9 +1,11 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "pve_device.hpp"
+#include "pve_pipeline_registry.hpp"
 
 namespace pve {
 struct PipelineConfigInfo {
@@ -28,10 +30,15 @@ struct PipelineConfigInfo {
     uint32_t subpass = 0;
 };
 
+// a pipeline from the device's pipeline registry. Creating one with the same shaders and
+// config as a pipeline that's still alive shares it instead of compiling again.
+// Pipelines may be created from several threads at once
 class PvePipeline {
    public:
     PvePipeline(PveDevice &device, const std::string &vertFilepath,
                 const std::string &fragFilepath, const PipelineConfigInfo &configInfo);
+    // compute pipelines only need a shader and a layout
+    PvePipeline(PveDevice &device, const std::string &compFilepath, VkPipelineLayout pipelineLayout);
     ~PvePipeline();
 
     PvePipeline(const PvePipeline &) = delete;
@@ -43,16 +50,18 @@ class PvePipeline {
     static void enableAlphaBlending(PipelineConfigInfo &configInfo);
 
    private:
-    static std::vector<char> readFile(const std::string &filepath);
+    // everything about the pipeline's state that goes into its registry key
+    static std::string graphicsPipelineKey(uint64_t vertHash, uint64_t fragHash,
+                                           const PipelineConfigInfo &configInfo);
+
     void createGraphicsPipeline(const std::string &vertFilepath,
                                 const std::string &fragFilepath,
                                 const PipelineConfigInfo &configInfo);
-
-    void createShaderModule(const std::vector<char> &code, VkShaderModule *shaderModule);
+    void createComputePipeline(const std::string &compFilepath, VkPipelineLayout pipelineLayout);
 
     PveDevice &pveDevice;
-    VkPipeline graphicsPipeline;
-    VkShaderModule vertShaderModule;
-    VkShaderModule fragShaderModule;
+    std::shared_ptr<PvePipelineRegistry::SharedPipeline> sharedPipeline;
+    VkPipeline pipeline;
+    VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 };
 }  // namespace pve
\ No newline at end of file
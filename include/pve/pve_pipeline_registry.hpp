@@ -0,0 +1,97 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+// std
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace pve {
+
+class PveDevice;
+
+// on-disk layout of the pipeline cache. The driver's own cache data follows the header, and
+// is only handed back to a device with the same driver and cache UUID
+struct PvePipelineCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+};
+
+// the device's pipelines and shader modules, shared between everything that creates them.
+// Shader modules are read once per file and shared by content hash. Pipelines are shared by a
+// key describing their whole state, and are compiled through a VkPipelineCache that is
+// loaded from disk at startup and saved back at shutdown, so a later run, or a pipeline that
+// only differs by its render pass, skips most of the compile.
+// Safe to use from several threads at once
+class PvePipelineRegistry {
+   public:
+    static constexpr uint32_t MAGIC = 0x43505650;  // "PVPC"
+    static constexpr uint32_t VERSION = 1;
+
+    // destroyed when the last PvePipeline using it goes away
+    struct SharedPipeline {
+        SharedPipeline(VkDevice device, VkPipeline pipeline) : device{device}, pipeline{pipeline} {}
+        ~SharedPipeline();
+
+        SharedPipeline(const SharedPipeline &) = delete;
+        SharedPipeline &operator=(const SharedPipeline &) = delete;
+
+        VkDevice device;
+        VkPipeline pipeline;
+    };
+
+    // a missing, stale or foreign cache file just starts an empty cache
+    PvePipelineRegistry(PveDevice &device, const std::string &cacheFilepath);
+    // saves the cache
+    ~PvePipelineRegistry();
+
+    PvePipelineRegistry(const PvePipelineRegistry &) = delete;
+    PvePipelineRegistry &operator=(const PvePipelineRegistry &) = delete;
+
+    // the module stays alive as long as the registry. contentHash identifies the code, two
+    // files with the same code get the same module
+    VkShaderModule getShaderModule(const std::string &filepath, uint64_t &contentHash);
+
+    // the pipeline made for key if one is still alive, otherwise create(cache) compiles a new
+    // one. The compile runs outside the lock, so other threads can compile meanwhile
+    std::shared_ptr<SharedPipeline> getPipeline(
+        const std::string &key, const std::function<VkPipeline(VkPipelineCache)> &create);
+
+    // returns false if the cache could not be written, e.g. for a read only directory
+    bool save();
+
+    VkPipelineCache getPipelineCache() const { return pipelineCache; }
+    // how many getPipeline() calls compiled and how many found a pipeline to share
+    uint32_t getCompiledCount() const { return compiledCount; }
+    uint32_t getSharedCount() const { return sharedCount; }
+
+   private:
+    struct ShaderModule {
+        VkShaderModule module;
+        uint64_t contentHash;
+    };
+
+    void loadCache();
+
+    PveDevice &pveDevice;
+    std::string cacheFilepath;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
+    std::mutex mutex;
+    std::unordered_map<std::string, ShaderModule> shaderModulesByPath;
+    std::unordered_map<uint64_t, VkShaderModule> shaderModulesByHash;
+    std::unordered_map<std::string, std::weak_ptr<SharedPipeline>> pipelines;
+    uint32_t compiledCount = 0;
+    uint32_t sharedCount = 0;
+};
+
+}  // namespace pve
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "pve_device.hpp"
+#include "pve_swap_chain.hpp"
+
+// std
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// times the enclosing scope on the calling thread. The name has to be a string literal
+#define PVE_PROFILE_ZONE_CONCAT_(a, b) a##b
+#define PVE_PROFILE_ZONE_CONCAT(a, b) PVE_PROFILE_ZONE_CONCAT_(a, b)
+#define PVE_PROFILE_ZONE(name) \
+    ::pve::PveProfiler::CpuZone PVE_PROFILE_ZONE_CONCAT(pveProfileZone, __LINE__) { name }
+
+namespace pve {
+
+// CPU zones and GPU timestamps for the last FRAME_HISTORY frames. A CPU zone costs two clock
+// reads and an uncontended lock on its thread's own event list, so they stay in release
+// builds. GPU zones are timestamp queries written into the frame's command buffer, read back
+// once the frame's fence has signaled, MAX_FRAMES_IN_FLIGHT frames later.
+// CPU zones on any thread go to the most recently created profiler, there's one per process
+class PveProfiler {
+   public:
+    static constexpr uint32_t FRAME_HISTORY = 512;
+    static constexpr uint32_t MAX_GPU_ZONES = 32;
+
+    struct CpuEvent {
+        const char *name;
+        uint32_t thread;  // in the order threads first recorded a zone
+        int64_t startNs;
+        int64_t endNs;
+    };
+
+    struct GpuEvent {
+        const char *name;
+        int64_t startNs;  // on the CPU clock, see endFrame()
+        int64_t endNs;
+    };
+
+    struct FrameRecord {
+        uint64_t frameNumber = ~0ull;
+        int64_t startNs = 0;
+        int64_t endNs = 0;
+        std::vector<CpuEvent> cpuEvents;
+        std::vector<GpuEvent> gpuEvents;
+    };
+
+    class CpuZone {
+       public:
+        explicit CpuZone(const char *name);
+        ~CpuZone();
+
+        CpuZone(const CpuZone &) = delete;
+        CpuZone &operator=(const CpuZone &) = delete;
+
+       private:
+        PveProfiler *profiler;
+        const char *name;
+        int64_t startNs;
+    };
+
+    // only in the frame's primary command buffer, on the thread that records it. Zones can be
+    // inside a render pass too, but not around commands recorded into secondary buffers
+    class GpuZone {
+       public:
+        GpuZone(PveProfiler &profiler, VkCommandBuffer commandBuffer, const char *name);
+        ~GpuZone();
+
+        // ends the zone before the scope does, e.g. before the command buffer is ended
+        void end();
+
+        GpuZone(const GpuZone &) = delete;
+        GpuZone &operator=(const GpuZone &) = delete;
+
+       private:
+        PveProfiler &profiler;
+        VkCommandBuffer commandBuffer;
+        uint32_t zone;
+    };
+
+    explicit PveProfiler(PveDevice &device);
+    ~PveProfiler();
+
+    PveProfiler(const PveProfiler &) = delete;
+    PveProfiler &operator=(const PveProfiler &) = delete;
+
+    // right after the renderer begins a frame: picks up the GPU times of the last frame that
+    // used frameIndex and resets its queries. commandBuffer must be outside a render pass
+    void beginFrame(int frameIndex, VkCommandBuffer commandBuffer);
+    // once per iteration of the frame loop, after the frame was submitted. Everything the CPU
+    // zones recorded since the previous call goes into this frame's record
+    void endFrame();
+
+    // returns the zone for endGpuZone(), ~0u once the frame's queries run out
+    uint32_t beginGpuZone(VkCommandBuffer commandBuffer, const char *name);
+    void endGpuZone(VkCommandBuffer commandBuffer, uint32_t zone);
+
+    // every frame still in the history, as Chrome trace / Perfetto JSON. Returns false if the
+    // file could not be written
+    bool writeChromeTrace(const std::string &filepath) const;
+    // p50, p95 and p99 of each zone's total time per frame, over the frames in the history
+    void printSummary(std::ostream &out) const;
+
+    static int64_t now();
+
+   private:
+    struct ThreadEvents {
+        std::mutex mutex;
+        std::vector<CpuEvent> events;
+        uint32_t thread;
+    };
+
+    struct GpuFrame {
+        VkQueryPool queryPool = VK_NULL_HANDLE;
+        std::vector<const char *> zoneNames;
+        uint64_t frameNumber = ~0ull;
+        int64_t submitNs = 0;
+    };
+
+    void recordCpuEvent(const char *name, int64_t startNs, int64_t endNs);
+    ThreadEvents &threadEvents();
+    void collectGpuTimes(GpuFrame &gpuFrame);
+    // null once the frame has dropped out of the history
+    FrameRecord *findRecord(uint64_t frameNumber);
+
+    static std::atomic<PveProfiler *> current;
+    static std::atomic<uint64_t> nextId;
+
+    PveDevice &pveDevice;
+    // tells a thread's cached event list apart from one of an earlier profiler
+    uint64_t id;
+    bool gpuTimestamps = false;
+    float timestampPeriod = 1.f;  // nanoseconds per tick
+
+    std::mutex threadsMutex;
+    std::vector<std::unique_ptr<ThreadEvents>> threads;
+
+    std::vector<GpuFrame> gpuFrames;
+    int currentGpuFrame = -1;
+
+    std::vector<FrameRecord> records;
+    uint64_t frameNumber = 0;
+    int64_t frameStartNs = 0;
+};
+
+}  // namespace pve
@@ -19,8 +19,14 @@ class PveRenderer {
 
     VkRenderPass getSwapChainRenderPass() const { return pveSwapChain->getRenderPass(); }
     float getAspectRatio() const { return pveSwapChain->extentAspectRatio(); }
+    VkExtent2D getSwapChainExtent() const { return pveSwapChain->getSwapChainExtent(); }
     bool isFrameInProgress() const { return isFrameStarted; }
 
+    VkFramebuffer getCurrentFramebuffer() const {
+        assert(isFrameStarted && "Cannot get frame buffer when frame not in progress");
+        return pveSwapChain->getFrameBuffer(currentImageIndex);
+    }
+
     VkCommandBuffer getCurrentCommandBuffer() const {
         assert(isFrameStarted && "Cannot get command buffer when frame not in progress");
         return commandBuffers[currentFrameIndex];
@@ -33,9 +39,17 @@ class PveRenderer {
 
     VkCommandBuffer beginFrame();
     void endFrame();
-    void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
+    // with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS the whole pass has to come from
+    // secondary command buffers, which set their own viewport and scissor
+    void beginSwapChainRenderPass(
+        VkCommandBuffer commandBuffer,
+        VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
     void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
 
+    // headless only: the callback receives every finished frame once its fence has signaled
+    void setFrameReadback(PveSwapChain::ReadbackCallback callback);
+    void flushPendingReadbacks();
+
    private:
     // Renderer: swapchain, command buffers and draw frame
     void createCommandBuffers();
@@ -47,6 +61,7 @@ class PveRenderer {
     PveDevice &pveDevice;
     std::unique_ptr<PveSwapChain> pveSwapChain;
     std::vector<VkCommandBuffer> commandBuffers;
+    PveSwapChain::ReadbackCallback frameReadback;
 
     uint32_t currentImageIndex;
     int currentFrameIndex{0};
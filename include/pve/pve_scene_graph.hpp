@@ -0,0 +1,57 @@
+#pragma once
+
+#include "pve_ecs.hpp"
+#include "pve_game_object.hpp"
+#include "pve_job_system.hpp"
+
+// std
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace pve {
+
+// the parent/child hierarchy of the transforms, flattened into arrays sorted depth first so
+// every parent comes before its children and every subtree is one contiguous range.
+// Propagating the world matrices is then a single linear pass without recursion, and
+// separate roots can be handed to separate threads.
+// Only entities with a ParentComponent, and their parents, are part of the graph
+class PveSceneGraph {
+   public:
+    // PVE_NULL_ENTITY detaches the child. Cycles are only detected by the next propagate()
+    static void setParent(PveRegistry &registry, PveEntity child, PveEntity parent);
+
+    // recomputes the world matrices of every node whose local transform, or one of its
+    // ancestors', changed since the last call. The local matrices should already be current.
+    // Large graphs split their roots between the job system's workers
+    void propagate(PveRegistry &registry, PveJobSystem *jobSystem = nullptr);
+
+    uint32_t getNodeCount() const { return static_cast<uint32_t>(transforms.size()); }
+    // nodes whose world matrix was recomputed by the most recent propagate()
+    uint32_t getUpdatedCount() const { return updatedCount; }
+
+   private:
+    void rebuild(PveRegistry &registry);
+    // returns how many world matrices were recomputed
+    uint32_t propagateRange(uint32_t begin, uint32_t end);
+
+    // parallel to each other, in depth first order
+    std::vector<TransformComponent *> transforms;
+    std::vector<int32_t> parents;  // index into the arrays above, -1 for roots
+    std::vector<uint32_t> seenVersions;
+    std::vector<uint8_t> changed;
+
+    // where each root's subtree begins, followed by the node count
+    std::vector<uint32_t> rootOffsets;
+    // node ranges of whole roots handed to the workers, and how many each one updated
+    std::vector<std::pair<uint32_t, uint32_t>> chunks;
+    std::vector<uint32_t> chunkUpdatedCounts;
+
+    // the arrays hold pointers into these pools, so they're rebuilt when either changes
+    uint64_t transformPoolVersion = ~0ull;
+    uint64_t parentPoolVersion = ~0ull;
+    bool forceUpdate = true;
+    uint32_t updatedCount = 0;
+};
+
+}  // namespace pve
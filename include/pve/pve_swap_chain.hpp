@@ -1,11 +1,13 @@
 #pragma once
 
+#include "pve_buffer.hpp"
 #include "pve_device.hpp"
 
 // vulkan headers
 #include <vulkan/vulkan.h>
 
 // std lib headers
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
@@ -16,6 +18,10 @@ class PveSwapChain {
    public:
     static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
 
+    // called with the pixels of a finished headless frame once its fence has signaled
+    using ReadbackCallback =
+        std::function<void(const void *pixels, VkExtent2D extent, VkFormat format)>;
+
     PveSwapChain(PveDevice &deviceRef, VkExtent2D windowExtent);
     PveSwapChain(PveDevice &deviceRef, VkExtent2D windowExtent,
                  std::shared_ptr<PveSwapChain> previous);
@@ -42,6 +48,12 @@ class PveSwapChain {
     VkResult acquireNextImage(uint32_t *imageIndex);
     VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex);
 
+    // headless swap chains own a ring of MAX_FRAMES_IN_FLIGHT offscreen images and never present
+    bool isHeadless() const { return device.isHeadless(); }
+    void setReadbackCallback(ReadbackCallback callback) { readbackCallback = std::move(callback); }
+    void recordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    void flushReadbacks();
+
     bool compareSwapFormats(const PveSwapChain &swapChain) const {
         return swapChain.swapChainDepthFormat == swapChainDepthFormat &&
                swapChain.swapChainImageFormat == swapChainImageFormat;
@@ -50,6 +62,9 @@ class PveSwapChain {
    private:
     void init();
     void createSwapChain();
+    void createOffscreenImages();
+    void createReadbackBuffers();
+    void deliverReadback(size_t frameIndex);
     void createImageViews();
     void createDepthResources();
     void createRenderPass();
@@ -71,15 +86,22 @@ class PveSwapChain {
     VkRenderPass renderPass;
 
     std::vector<VkImage> depthImages;
-    std::vector<VkDeviceMemory> depthImageMemorys;
+    std::vector<PveAllocation> depthImageMemorys;
     std::vector<VkImageView> depthImageViews;
     std::vector<VkImage> swapChainImages;
     std::vector<VkImageView> swapChainImageViews;
 
+    // headless only: memory backing the offscreen color images, and one host visible
+    // buffer per frame in flight that finished frames get copied into
+    std::vector<PveAllocation> offscreenImageMemorys;
+    std::vector<std::unique_ptr<PveBuffer>> readbackBuffers;
+    std::vector<bool> readbackPending;
+    ReadbackCallback readbackCallback;
+
     PveDevice &device;
     VkExtent2D windowExtent;
 
-    VkSwapchainKHR swapChain;
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
     std::shared_ptr<PveSwapChain> oldSwapChain;
 
     std::vector<VkSemaphore> imageAvailableSemaphores;
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "pve_device.hpp"
+#include "pve_texture_cooker.hpp"
+
+// std
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pve {
+
+class PveJobSystem;
+
+// one mip level as it's copied into the image, already in the texture's format
+struct PveTextureLevel {
+    const void *data;
+    VkDeviceSize size;
+};
+
+// a sampled 2D image in device local memory, ready to be read by shaders once constructed
+class PveTexture {
+   public:
+    // pixels are tightly packed rows of 4 byte texels. The upload waits for the GPU, so
+    // textures are meant to be created while loading, not every frame
+    PveTexture(
+        PveDevice &device,
+        uint32_t width,
+        uint32_t height,
+        const void *pixels,
+        VkFormat format = VK_FORMAT_R8G8B8A8_SRGB);
+    // levels largest first, all of them uploaded in one submission
+    PveTexture(
+        PveDevice &device,
+        uint32_t width,
+        uint32_t height,
+        VkFormat format,
+        const std::vector<PveTextureLevel> &levels);
+    PveTexture(PveDevice &device, const PveCookedTexture &texture);
+    ~PveTexture();
+
+    PveTexture(const PveTexture &) = delete;
+    PveTexture &operator=(const PveTexture &) = delete;
+
+    // a .ktx2 file is uploaded as it is. Any other image is cooked, unless the cache next to
+    // it is still up to date, and the cache is written for the next run
+    static std::unique_ptr<PveTexture> createTextureFromFile(
+        PveDevice &device,
+        const std::string &filepath,
+        const PveTextureCooker::Options &options,
+        PveJobSystem *jobSystem);
+    // the options with block compression turned off on a device that can't sample it
+    static PveTextureCooker::Options supportedOptions(
+        const PveDevice &device, const PveTextureCooker::Options &options);
+
+    VkImage getImage() const { return image; }
+    VkImageView getImageView() const { return imageView; }
+    VkFormat getFormat() const { return format; }
+    uint32_t getWidth() const { return width; }
+    uint32_t getHeight() const { return height; }
+    uint32_t getMipLevels() const { return mipLevels; }
+
+   private:
+    void createImage();
+    void upload(const std::vector<PveTextureLevel> &levels);
+    void createImageView();
+
+    PveDevice &pveDevice;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+    VkFormat format;
+    VkImage image = VK_NULL_HANDLE;
+    PveAllocation allocation{};
+    VkImageView imageView = VK_NULL_HANDLE;
+};
+
+}  // namespace pve
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+// std
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace pve {
+
+class PveJobSystem;
+
+// decoded pixels, tightly packed rows of RGBA8 texels
+struct PveImage {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// how a cooked texture is stored. BC1 takes 4 bits per texel and has no alpha, BC3 takes 8
+// with alpha, and BC5 takes 8 for the two channels of a normal map. RGBA8 is for devices
+// without BC support
+enum class PveTextureEncoding : uint32_t { Auto, Rgba8, Bc1, Bc3, Bc5 };
+
+// a texture ready to upload, with its mip levels largest first
+struct PveCookedTexture {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<std::vector<uint8_t>> levels;
+};
+
+// turns source images into textures the GPU samples directly: decodes them, builds their mip
+// chains and block compresses every level. Doesn't touch the device, so it runs on any thread
+// and in the offline cooker. The job system is optional, with one the rows of a level are
+// filtered and encoded in parallel
+class PveTextureCooker {
+   public:
+    // bumped whenever cooking changes, so files cooked by an older version are cooked again
+    static constexpr uint32_t VERSION = 1;
+
+    struct Options {
+        // Auto picks BC1 for opaque images and BC3 for the others
+        PveTextureEncoding encoding = PveTextureEncoding::Auto;
+        // color is averaged in linear space and sampled through an sRGB format. Off for data
+        // like normal maps
+        bool srgb = true;
+        bool mipmaps = true;
+    };
+
+    // binary PPM (P6), or TGA, uncompressed or RLE, true color or grayscale. Throws if the
+    // file can't be read or decoded
+    static PveImage loadImage(const std::string &filepath);
+
+    // every level down to 1x1, each one a 2x2 box filter of the previous one. Level 0 is a
+    // copy of the image
+    static std::vector<PveImage> buildMipChain(const PveImage &image, bool srgb,
+                                               PveJobSystem *jobSystem);
+
+    static PveCookedTexture cook(const PveImage &image, const Options &options,
+                                 PveJobSystem *jobSystem);
+
+    // Auto isn't a format, resolve it first
+    static VkFormat formatFor(PveTextureEncoding encoding, bool srgb);
+    static bool isBlockCompressed(VkFormat format);
+    // bytes per 4x4 block of a compressed format, per texel otherwise. 0 for formats the
+    // cooker doesn't write
+    static uint32_t blockBytes(VkFormat format);
+    static VkDeviceSize levelSize(VkFormat format, uint32_t width, uint32_t height);
+    static uint32_t mipLevelCount(uint32_t width, uint32_t height);
+};
+
+}  // namespace pve
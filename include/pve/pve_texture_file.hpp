@@ -0,0 +1,91 @@
+#pragma once
+
+#include "pve_texture_cooker.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace pve {
+
+// the fixed part of a KTX2 file, followed by one PveKtx2Level per mip level
+struct PveKtx2Header {
+    uint8_t identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+
+struct PveKtx2Level {
+    uint64_t byteOffset;  // from the start of the file
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+// the value of the file's "PVEsource" key, ties a cooked file to the source image and the
+// options it was cooked from
+struct PveTextureSource {
+    uint64_t sourceSize;
+    int64_t sourceModifiedTimeNs;
+    uint32_t cookerVersion;
+    uint32_t encoding;
+    uint32_t srgb;
+    uint32_t mipmaps;
+};
+
+// a read only memory mapping of a KTX2 file written by the cooker: a single 2D image, no
+// supercompression, in one of the formats PveTextureCooker writes. Levels can be copied to a
+// staging buffer straight from the mapping
+class PveTextureFile {
+   public:
+    // the file is left invalid if it can't be mapped or isn't a texture the cooker could have
+    // written
+    explicit PveTextureFile(const std::string &filepath);
+    ~PveTextureFile();
+
+    PveTextureFile(const PveTextureFile &) = delete;
+    PveTextureFile &operator=(const PveTextureFile &) = delete;
+
+    bool isValid() const { return header != nullptr; }
+    // whether the file was cooked from the source as it is now, with these options
+    bool isCookedFrom(const std::string &sourcePath,
+                      const PveTextureCooker::Options &options) const;
+
+    VkFormat getFormat() const { return static_cast<VkFormat>(header->vkFormat); }
+    uint32_t getWidth() const { return header->pixelWidth; }
+    uint32_t getHeight() const { return header->pixelHeight; }
+    uint32_t getLevelCount() const { return header->levelCount; }
+    const void *getLevelData(uint32_t level) const;
+    VkDeviceSize getLevelSize(uint32_t level) const { return levels[level].byteLength; }
+
+    // where the texture cooked from a source image is kept, next to it
+    static std::string cachePathFor(const std::string &sourcePath);
+
+    // sourcePath may be empty for a texture that wasn't cooked from a file. Returns false if
+    // the file could not be written, e.g. for a read only asset directory
+    static bool write(const std::string &filepath, const PveCookedTexture &texture,
+                      const std::string &sourcePath, const PveTextureCooker::Options &options);
+
+   private:
+    void *mapped = nullptr;
+    size_t mappedSize = 0;
+    const PveKtx2Header *header = nullptr;
+    const PveKtx2Level *levels = nullptr;
+    bool hasSource = false;
+    PveTextureSource source{};
+};
+
+}  // namespace pve
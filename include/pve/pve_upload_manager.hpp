@@ -0,0 +1,97 @@
+#pragma once
+
+#include "pve_buffer.hpp"
+#include "pve_device.hpp"
+
+// std
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <vector>
+
+namespace pve {
+
+// uploads buffer data without stalling the GPU. The data is copied into a persistently mapped
+// staging ring straight away, and the copies are submitted in batches on the transfer queue,
+// which is a dedicated transfer family when the device has one. Each batch signals a fence
+// that is polled once per frame. Then its ring space is reused, the buffers are handed over
+// to the graphics queue, and the futures of its uploads become ready.
+// Not thread safe, everything is meant to be called from the thread that records the frames
+class PveUploadManager {
+   public:
+    static constexpr VkDeviceSize DEFAULT_RING_SIZE = 64 * 1024 * 1024;
+
+    PveUploadManager(PveDevice &device, VkDeviceSize ringSize = DEFAULT_RING_SIZE);
+    // waits for the batches still in flight
+    ~PveUploadManager();
+
+    PveUploadManager(const PveUploadManager &) = delete;
+    PveUploadManager &operator=(const PveUploadManager &) = delete;
+
+    // data can be freed as soon as this returns. Uploads larger than half the ring are split
+    // into chunks, waiting for earlier batches to make room when they have to.
+    // The future is ready once commands recorded on the graphics queue after that point can
+    // read the data, dstBuffer has to stay alive until then. Futures become ready in the
+    // order their uploads were made
+    std::shared_future<void> uploadBuffer(
+        VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data, VkDeviceSize size);
+
+    // submits the copies queued since the last call as one batch
+    void submit();
+
+    // call once per frame, outside a render pass and before anything that might read the
+    // uploads is recorded. Submits what's pending, retires the finished batches, records the
+    // barriers that make their data visible to graphics and readies their futures
+    void update(VkCommandBuffer graphicsCommandBuffer);
+
+    // no copy is recorded, in flight or waiting for update(), so nothing refers to a
+    // destination buffer anymore
+    bool isIdle() const {
+        return pendingBatch.commandBuffer == VK_NULL_HANDLE && submittedBatches.empty() &&
+               finishedBatches.empty();
+    }
+    bool hasDedicatedTransferQueue() const { return transferFamily != graphicsFamily; }
+    VkDeviceSize getRingSize() const { return ringSize; }
+
+   private:
+    struct Batch {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        // where the ring's tail moves once the batch is done
+        VkDeviceSize ringEnd = 0;
+        // the ranges to acquire on the graphics queue, only with a dedicated transfer queue
+        std::vector<VkBufferMemoryBarrier> acquireBarriers;
+        std::vector<std::promise<void>> promises;
+    };
+
+    // returns false when the ring doesn't have size contiguous bytes free
+    bool tryAllocate(VkDeviceSize size, VkDeviceSize &offset);
+    // blocks until there's room, submitting and waiting on batches as needed
+    VkDeviceSize allocate(VkDeviceSize size);
+    void beginBatch();
+    // retires submitted batches in order, waiting for the first one when wait is set
+    void retireBatches(bool wait);
+
+    PveDevice &pveDevice;
+    uint32_t graphicsFamily;
+    uint32_t transferFamily;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+
+    VkDeviceSize ringSize;
+    std::unique_ptr<PveBuffer> stagingRing;
+    // bytes [ringTail, ringHead) are in use, wrapping around the end of the ring
+    VkDeviceSize ringHead = 0;
+    VkDeviceSize ringTail = 0;
+
+    // being recorded, commandBuffer is null until the first copy
+    Batch pendingBatch;
+    // submitted, oldest first
+    std::deque<Batch> submittedBatches;
+    // finished on the GPU but not yet handed to graphics by update()
+    std::vector<Batch> finishedBatches;
+    // command buffers and fences of retired batches, reused by new ones
+    std::vector<std::pair<VkCommandBuffer, VkFence>> freeBatchResources;
+};
+
+}  // namespace pve
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "pve_bounds.hpp"
+
+#include <vulkan/vulkan.h>
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace pve {
+
+// a vertex as the loaders produce it, full float precision. Also a layout the GPU can read
+// as is
+struct PveVertex {
+    glm::vec3 position{};
+    glm::vec3 color{};
+    glm::vec3 normal{};
+    glm::vec2 uv{};
+
+    bool operator==(const PveVertex &other) const {
+        return position == other.position && color == other.color && normal == other.normal &&
+               uv == other.uv;
+    }
+};
+
+// 20 bytes instead of 44. The position is a 16 bit fraction of the mesh's bounding box on
+// each axis, the normal is octahedral encoded in two 16 bit components, the uv is two halfs
+// and the color is 8 bits per channel. Only formats every device can fetch are used
+struct PveCompactVertex {
+    uint16_t position[4];  // unorm, w is unused
+    uint8_t color[4];      // unorm, alpha is always 1
+    int16_t normal[2];     // snorm, octahedral
+    uint16_t uv[2];        // half floats, uvs can go past 1 for tiling
+};
+
+// brings the positions a layout stores back to model space, offset + position * scale.
+// vec4s so it can be copied straight into push constants and storage buffers
+struct PvePositionDequantization {
+    glm::vec4 offset{0.f};
+    glm::vec4 scale{1.f};
+};
+
+// one attribute of a layout, all of them are read from binding 0
+struct PveVertexAttribute {
+    uint32_t location;
+    VkFormat format;
+    uint32_t offset;
+};
+
+// what the engine needs to know about a vertex layout: its attributes, how to pack a
+// PveVertex into it and how the shader unpacks the position. Every layout keeps the shader
+// locations of PveVertex, 0 to 3 for position, color, normal and uv
+template <typename VertexT>
+struct PveVertexTraits;
+
+template <>
+struct PveVertexTraits<PveVertex> {
+    static constexpr std::array<PveVertexAttribute, 4> ATTRIBUTES{{
+        {0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(PveVertex, position)},
+        {1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(PveVertex, color)},
+        {2, VK_FORMAT_R32G32B32_SFLOAT, offsetof(PveVertex, normal)},
+        {3, VK_FORMAT_R32G32_SFLOAT, offsetof(PveVertex, uv)},
+    }};
+
+    static PveVertex pack(const PveVertex &vertex, const PveBounds &) { return vertex; }
+    static PvePositionDequantization dequantization(const PveBounds &) { return {}; }
+};
+
+template <>
+struct PveVertexTraits<PveCompactVertex> {
+    static constexpr std::array<PveVertexAttribute, 4> ATTRIBUTES{{
+        {0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(PveCompactVertex, position)},
+        {1, VK_FORMAT_R8G8B8A8_UNORM, offsetof(PveCompactVertex, color)},
+        {2, VK_FORMAT_R16G16_SNORM, offsetof(PveCompactVertex, normal)},
+        {3, VK_FORMAT_R16G16_SFLOAT, offsetof(PveCompactVertex, uv)},
+    }};
+
+    // the position is quantized against the bounds, the mesh's aabb has to be computed first
+    static PveCompactVertex pack(const PveVertex &vertex, const PveBounds &bounds);
+    static PvePositionDequantization dequantization(const PveBounds &bounds);
+};
+
+// the vertex input state of a layout, generated from its traits
+template <typename VertexT>
+struct PveVertexLayout {
+    static std::vector<VkVertexInputBindingDescription> getBindingDescriptions() {
+        // a single vertex buffer on binding 0
+        std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
+        bindingDescriptions[0].binding = 0;
+        bindingDescriptions[0].stride = sizeof(VertexT);
+        bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        return bindingDescriptions;
+    }
+
+    static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions() {
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
+        for (const PveVertexAttribute &attribute : PveVertexTraits<VertexT>::ATTRIBUTES) {
+            // location, binding, format and offset
+            attributeDescriptions.push_back(
+                {attribute.location, 0, attribute.format, attribute.offset});
+        }
+        return attributeDescriptions;
+    }
+
+    static std::vector<VertexT> pack(const std::vector<PveVertex> &vertices,
+                                     const PveBounds &bounds) {
+        std::vector<VertexT> packed(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            packed[i] = PveVertexTraits<VertexT>::pack(vertices[i], bounds);
+        }
+        return packed;
+    }
+};
+
+// the layout vertex buffers and mesh caches use, picked at compile time. Building with
+// PVE_FULL_PRECISION_VERTICES (make VERTEX_FORMAT=full) keeps the float layout, the shaders
+// are compiled with the same define so their inputs match
+#ifdef PVE_FULL_PRECISION_VERTICES
+using PveGpuVertex = PveVertex;
+#else
+using PveGpuVertex = PveCompactVertex;
+#endif
+
+}  // namespace pve
@@ -11,7 +11,9 @@ namespace pve {
 
 class PveWindow {
    public:
-    PveWindow(int w, int h, std::string name);
+    // a headless window never touches GLFW: there is no OS window and no surface,
+    // PveDevice and PveSwapChain render into offscreen images instead
+    PveWindow(int w, int h, std::string name, bool headless = false);
     ~PveWindow();
 
     // resource creation happens when we initialize our variables.
@@ -21,11 +23,12 @@ class PveWindow {
     PveWindow(const PveWindow &) = delete;
     PveWindow &operator=(const PveWindow &) = delete;
 
-    bool shouldClose() { return glfwWindowShouldClose(window); }
+    bool shouldClose() const { return headless ? false : glfwWindowShouldClose(window); }
     VkExtent2D getExtent() { return {static_cast<uint32_t>(width), static_cast<uint32_t>(height)}; }
     bool wasWindowResized() { return framebufferResized; }
     void resetWindowResizedFlag() { framebufferResized = false; }
     GLFWwindow *getGLFWWindow() const { return window; }
+    bool isHeadless() const { return headless; }
 
     void createWindowSurface(VkInstance instance, VkSurfaceKHR *surface);
 
@@ -35,9 +38,10 @@ class PveWindow {
     int width;
     int height;
     bool framebufferResized = false;  // flag that signals the window has been resized
+    bool headless = false;
 
     std::string windowName;
-    GLFWwindow *window;
+    GLFWwindow *window = nullptr;
 };
 
 }  // namespace pve
\ No newline at end of file
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "pve/pve_buffer.hpp"
+#include "pve/pve_camera.hpp"
+#include "pve/pve_descriptors.hpp"
+#include "pve/pve_device.hpp"
+#include "pve/pve_frame_info.hpp"
+#include "pve/pve_game_object.hpp"
+#include "pve/pve_geometry_arena.hpp"
+#include "pve/pve_material_library.hpp"
+#include "pve/pve_model.hpp"
+#include "pve/pve_pipeline.hpp"
+
+namespace pve {
+// keeps per object transforms and bounds in storage buffers, culls them against the camera
+// frustum in a compute pass and draws whatever survives with indirect draws, so recording
+// a frame costs the same no matter how many objects there are.
+// Only models in the geometry arena are drawn, the rest are skipped
+class GpuDrivenRenderSystem {
+   public:
+    GpuDrivenRenderSystem(
+        PveDevice &device,
+        VkRenderPass renderPass,
+        VkDescriptorSetLayout globalSetLayout,
+        PveMaterialLibrary &materialLibrary,
+        uint32_t maxObjects);
+    ~GpuDrivenRenderSystem();
+
+    GpuDrivenRenderSystem(const GpuDrivenRenderSystem &) = delete;
+    GpuDrivenRenderSystem &operator=(const GpuDrivenRenderSystem &) = delete;
+
+    // writes the objects into this frame's storage buffers
+    void update(FrameInfo &frameInfo);
+    // records the culling dispatch, must happen outside of the render pass
+    void cull(FrameInfo &frameInfo);
+    void render(FrameInfo &frameInfo);
+
+    // results of the most recent frame whose fence has signaled
+    uint32_t getVisibleCount() const { return visibleCount; }
+    uint32_t getCulledCount() const { return culledCount; }
+    // objects of the latest update() left out, outside the arena or past maxObjects
+    uint32_t getSkippedCount() const { return skippedCount; }
+
+   private:
+    void createDescriptors();
+    void createPipelineLayouts(VkDescriptorSetLayout globalSetLayout);
+    void createPipelines(VkRenderPass renderPass);
+
+    PveDevice &pveDevice;
+    PveMaterialLibrary &materialLibrary;
+    uint32_t maxObjects;
+    // VK_KHR_draw_indirect_count lets the cull pass compact the draws and set their count
+    PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = nullptr;
+
+    std::unique_ptr<PvePipeline> cullPipeline;
+    std::unique_ptr<PvePipeline> renderPipeline;
+    VkPipelineLayout cullPipelineLayout;
+    VkPipelineLayout renderPipelineLayout;
+
+    std::unique_ptr<PveDescriptorAllocator> descriptorAllocator;
+    std::shared_ptr<PveDescriptorSetLayout> cullSetLayout;
+    std::shared_ptr<PveDescriptorSetLayout> objectSetLayout;
+
+    // one of each per frame in flight
+    std::vector<std::unique_ptr<PveBuffer>> objectBuffers;
+    std::vector<std::unique_ptr<PveBuffer>> meshBuffers;
+    std::vector<std::unique_ptr<PveBuffer>> drawCommandBuffers;
+    std::vector<std::unique_ptr<PveBuffer>> drawCountBuffers;
+    std::vector<VkDescriptorSet> cullDescriptorSets;
+    std::vector<VkDescriptorSet> objectDescriptorSets;
+    std::vector<uint32_t> objectCounts;
+
+    std::vector<PveModel *> meshes;
+    std::unordered_map<PveModel *, uint32_t> meshIndices;
+    PveGeometryArena *geometryArena = nullptr;
+
+    uint32_t visibleCount = 0;
+    uint32_t culledCount = 0;
+    uint32_t skippedCount = 0;
+};
+}  // namespace pve
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "pve/pve_buffer.hpp"
+#include "pve/pve_camera.hpp"
+#include "pve/pve_device.hpp"
+#include "pve/pve_frame_info.hpp"
+#include "pve/pve_pipeline.hpp"
+
+namespace pve {
+// clustered forward lighting: the view frustum is cut into a grid of froxels, tiles on
+// screen by exponentially spaced depth slices, and a compute pass lists the point lights
+// that reach each one. The fragment shader then only loops over its own cluster's lights,
+// so shading cost follows the lights near a pixel instead of the total light count
+class LightClusterSystem {
+   public:
+    static constexpr uint32_t CLUSTER_COUNT_X = 16;
+    static constexpr uint32_t CLUSTER_COUNT_Y = 9;
+    static constexpr uint32_t CLUSTER_COUNT_Z = 24;
+    static constexpr uint32_t CLUSTER_COUNT = CLUSTER_COUNT_X * CLUSTER_COUNT_Y * CLUSTER_COUNT_Z;
+    // lights past this in a single cluster are dropped, duplicated in the shaders
+    static constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 128;
+
+    // the global set has to hold the UBO, the point lights and both of this system's buffers
+    LightClusterSystem(PveDevice &device, VkDescriptorSetLayout globalSetLayout);
+    ~LightClusterSystem();
+
+    LightClusterSystem(const LightClusterSystem &) = delete;
+    LightClusterSystem &operator=(const LightClusterSystem &) = delete;
+
+    // fills in the cluster grid parameters for a perspective camera
+    void update(const PveCamera &camera, VkExtent2D extent, GlobalUbo &ubo);
+    // records the light assignment dispatch, must happen outside of the render pass
+    void assignLights(FrameInfo &frameInfo);
+
+    VkDescriptorBufferInfo getClusterLightCountInfo(int frameIndex) const {
+        return clusterLightCountBuffers[frameIndex]->descriptorInfo();
+    }
+    VkDescriptorBufferInfo getClusterLightIndexInfo(int frameIndex) const {
+        return clusterLightIndexBuffers[frameIndex]->descriptorInfo();
+    }
+
+   private:
+    void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
+    void createPipeline();
+
+    PveDevice &pveDevice;
+    std::unique_ptr<PvePipeline> pvePipeline;
+    VkPipelineLayout pipelineLayout;
+
+    // one of each per frame in flight, only ever touched by the GPU
+    std::vector<std::unique_ptr<PveBuffer>> clusterLightCountBuffers;
+    std::vector<std::unique_ptr<PveBuffer>> clusterLightIndexBuffers;
+};
+}  // namespace pve
@@ -3,6 +3,7 @@
 #include <memory>
 #include <vector>
 
+#include "pve/pve_buffer.hpp"
 #include "pve/pve_camera.hpp"
 #include "pve/pve_device.hpp"
 #include "pve/pve_frame_info.hpp"
@@ -13,16 +14,28 @@
 namespace pve {
 class PointLightSystem {
    public:
-    PointLightSystem(PveDevice &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+    PointLightSystem(
+        PveDevice &device,
+        VkRenderPass renderPass,
+        VkDescriptorSetLayout globalSetLayout,
+        uint32_t maxLights);
     ~PointLightSystem();
 
     PointLightSystem(const PointLightSystem &) = delete;
     PointLightSystem &operator=(const PointLightSystem &) = delete;
 
+    // gives new lights a slot in the storage buffer and records copies for the lights whose
+    // position, color or intensity changed since they were last uploaded. Has to be called
+    // outside of a render pass, static lights cost nothing after their first upload
     void update(FrameInfo &frameInfo, GlobalUbo &ubo);
-    // Renderer: swapchain, command buffers and draw frame
+    // draws every light as a billboard, sorted back to front, in a single instanced draw
     void render(FrameInfo &frameInfo);
 
+    // one buffer shared by every frame in flight, the copies into it are ordered by barriers
+    VkDescriptorBufferInfo getLightBufferInfo() const { return lightBuffer->descriptorInfo(); }
+    // lights written into the storage buffer by the last update
+    uint32_t getUploadedCount() const { return uploadedCount; }
+
    private:
     void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
 
@@ -30,10 +43,56 @@ class PointLightSystem {
     // because the render system's lifecycle is not tied to the renderPass
     void createPipeline(VkRenderPass renderPass);
 
+    // frees the slots of lights that were destroyed or lost one of their components
+    void releaseSlots(PveRegistry &registry);
+    uint32_t acquireSlot(PveEntity entity);
+    void recordUploads(FrameInfo &frameInfo);
+    // sorts sortOrder by sortKeys, ascending
+    void sortBackToFront();
+
+    // what was last uploaded for the light in a slot, to tell when it has to be sent again
+    struct LightSlot {
+        PveEntity entity = PVE_NULL_ENTITY;
+        uint32_t worldVersion = 0;
+        glm::vec4 color{};
+    };
+    struct DirtyLight {
+        uint32_t slot;
+        PointLight light;
+    };
+    struct Billboard {
+        glm::vec4 position;  // w is the radius
+        glm::vec4 color;     // w is intensity
+    };
+
     PveDevice &pveDevice;
     // a smart pointer simulates a pointer but with the addition of automatic
     // memory management
     std::unique_ptr<PvePipeline> pvePipeline;
     VkPipelineLayout pipelineLayout;
+
+    uint32_t maxLights;
+    // device local, lights keep their slot for as long as they exist
+    std::unique_ptr<PveBuffer> lightBuffer;
+    // per frame in flight, so a staging buffer is only rewritten once its copies are done
+    std::vector<std::unique_ptr<PveBuffer>> stagingBuffers;
+
+    std::vector<LightSlot> slots;
+    std::vector<uint32_t> freeSlots;
+    // slot of each entity index, checked against the slot's entity since indices are reused
+    std::vector<uint32_t> entitySlots;
+    std::vector<DirtyLight> dirtyLights;
+    std::vector<VkBufferCopy> copyRegions;
+    uint64_t lightPoolVersion = ~0ull;
+    uint64_t transformPoolVersion = ~0ull;
+    uint64_t colorPoolVersion = ~0ull;
+    uint32_t uploadedCount = 0;
+
+    // kept between frames so sorting the billboards doesn't allocate once they're big enough
+    std::vector<Billboard> billboards;
+    std::vector<uint32_t> sortKeys;
+    std::vector<uint32_t> sortOrder;
+    std::vector<uint32_t> sortKeysScratch;
+    std::vector<uint32_t> sortOrderScratch;
 };
 }  // namespace pve
@@ -1,28 +1,74 @@
 #pragma once
 
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
+#include "pve/pve_buffer.hpp"
 #include "pve/pve_camera.hpp"
 #include "pve/pve_device.hpp"
 #include "pve/pve_frame_info.hpp"
+#include "pve/pve_frustum.hpp"
 #include "pve/pve_game_object.hpp"
+#include "pve/pve_material_library.hpp"
 #include "pve/pve_model.hpp"
+#include "pve/pve_parallel_recorder.hpp"
 #include "pve/pve_pipeline.hpp"
 
 namespace pve {
 class SimpleRenderSystem {
    public:
-    SimpleRenderSystem(PveDevice &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+    SimpleRenderSystem(PveDevice &device, VkRenderPass renderPass,
+                       VkDescriptorSetLayout globalSetLayout, PveMaterialLibrary &materialLibrary);
     ~SimpleRenderSystem();
 
     SimpleRenderSystem(const SimpleRenderSystem &) = delete;
     SimpleRenderSystem &operator=(const SimpleRenderSystem &) = delete;
 
     // Renderer: swapchain, command buffers and draw frame
-    void renderGameObjects(FrameInfo &frameInfo);
+    // objects outside the camera frustum are skipped, the ones left that share a model and a
+    // material are drawn together with a single instanced draw.
+    // With a recorder the draws are split between its workers, each recording its slice into
+    // a secondary command buffer as a job on frameInfo's job system, and the buffers are
+    // queued in order
+    void renderGameObjects(FrameInfo &frameInfo, PveParallelRecorder *recorder = nullptr);
+
+    // counts of the most recently recorded frame
+    const PveCullingStats &getCullingStats() const { return cullingStats; }
 
    private:
+    struct GroupKey {
+        PveModel *model;
+        uint32_t materialIndex;
+
+        bool operator==(const GroupKey &other) const {
+            return model == other.model && materialIndex == other.materialIndex;
+        }
+    };
+
+    struct GroupKeyHash {
+        size_t operator()(const GroupKey &key) const {
+            return std::hash<PveModel *>{}(key.model) ^ (size_t{key.materialIndex} << 1);
+        }
+    };
+
+    struct InstanceGroup {
+        uint32_t firstInstance = 0;
+        uint32_t instanceCount = 0;
+    };
+
+    struct DrawGroup {
+        PveModel *model;
+        uint32_t materialIndex;
+        uint32_t firstInstance;
+        uint32_t instanceCount;
+    };
+
+    void reserveInstances(int frameIndex, uint32_t instanceCount);
+    // records drawGroups[begin, end) with everything they need bound
+    void recordDraws(FrameInfo &frameInfo, VkCommandBuffer commandBuffer, uint32_t begin,
+                     uint32_t end);
+
     void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
 
     // The renderPass will be used just to create the pipeline, we're not going to store it
@@ -30,9 +76,32 @@ class SimpleRenderSystem {
     void createPipeline(VkRenderPass renderPass);
 
     PveDevice &pveDevice;
+    PveMaterialLibrary &materialLibrary;
     // a smart pointer simulates a pointer but with the addition of automatic
     // memory management
     std::unique_ptr<PvePipeline> pvePipeline;
     VkPipelineLayout pipelineLayout;
+
+    // per frame in flight, so a buffer is only rewritten once the GPU is done reading it
+    std::vector<std::unique_ptr<PveBuffer>> instanceBuffers;
+    // kept between frames so grouping doesn't allocate once the scene has settled
+    std::unordered_map<GroupKey, InstanceGroup, GroupKeyHash> instanceGroups;
+    // the groups flattened, so they can be split into slices
+    std::vector<DrawGroup> drawGroups;
+    // the secondary command buffer each slice was recorded into
+    std::vector<VkCommandBuffer> slices;
+
+    // an object that might be drawn this frame. Pointers into the registry's pools are fine
+    // as nothing is added to them while a frame is recorded
+    struct Candidate {
+        GroupKey key;
+        TransformComponent *transform;
+        glm::mat4 modelMatrix;
+    };
+
+    // in the order their spheres were added to the culler
+    std::vector<Candidate> candidates;
+    PveFrustumCuller frustumCuller;
+    PveCullingStats cullingStats{};
 };
 }  // namespace pve
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include "pve/pve_ecs.hpp"
+#include "pve/pve_game_object.hpp"
+#include "pve/pve_job_system.hpp"
+#include "pve/pve_scene_graph.hpp"
+
+namespace pve {
+// rebuilds the cached matrices of every transform that changed since the last update. The
+// sines and cosines of four transforms' rotations are computed together with SSE, which is
+// where most of the cost of a transform is. Afterwards the scene graph carries the changes
+// down to the world matrices of the children. With a job system both steps are split
+// between its workers once there's enough work.
+// Run it once per frame after gameplay code and before the render systems
+class TransformSystem {
+   public:
+    void update(PveRegistry &registry, PveJobSystem *jobSystem = nullptr);
+
+    // transforms rebuilt by the most recent update, static scenery doesn't count
+    uint32_t getUpdatedCount() const { return updatedCount; }
+    const PveSceneGraph &getSceneGraph() const { return sceneGraph; }
+
+   private:
+    void updateRange(size_t begin, size_t end);
+
+    // kept between frames so collecting the dirty transforms doesn't allocate
+    std::vector<TransformComponent *> dirtyTransforms;
+    uint32_t updatedCount = 0;
+    PveSceneGraph sceneGraph;
+};
+}  // namespace pve
@@ -0,0 +1,89 @@
+#version 450
+
+// same as simple_shader.vert, except the per object data, material included, comes from the
+// object buffer.
+// The culling pass stores each object's index in its draw's firstInstance
+// PVE_FULL_PRECISION_VERTICES matches the engine's vertex layout, see pve_vertex.hpp. In
+// the compact layout the vertex fetch turns the packed components into floats, the position
+// is still a fraction of the mesh bounds and the normal is octahedral encoded
+#ifdef PVE_FULL_PRECISION_VERTICES
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 color;
+layout(location = 2) in vec3 normal;
+#else
+layout(location = 0) in vec4 position;
+layout(location = 1) in vec4 color;
+layout(location = 2) in vec2 normal;
+#endif
+layout(location = 3) in vec2 uv;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragPosWorld;
+layout(location = 2) out vec3 fragNormalWorld;
+layout(location = 3) out vec2 fragUv;
+layout(location = 4) flat out uint fragMaterialIndex;
+
+struct PointLight {
+    vec4 position; // w is how far the light reaches, negative for an unused slot
+    vec4 color; // w is intensity
+};
+
+layout(set = 0, binding = 0) uniform GlobalUbo{
+    mat4 projection;
+    mat4 view;
+    mat4 inverseView;
+    vec4 ambientLightColor;
+    uvec4 clusterCounts; // grid size in xyz, light count in w
+    vec4 clusterParams; // cluster size in pixels in xy, depth slice scale and bias in zw
+    vec4 framebufferSize; // width and height in pixels in xy
+} ubo;
+
+struct ObjectData {
+    mat4 modelMatrix;
+    mat4 normalMatrix;
+    vec4 boundingSphere; // model space center and radius
+    vec4 positionOffset; // dequantizes the mesh's positions, offset + position * scale
+    vec4 positionScale;
+    uint meshIndex;
+    uint materialIndex;
+};
+
+// set 1 holds the materials, as in simple_shader.frag
+layout(set = 2, binding = 0) readonly buffer ObjectBuffer {
+    ObjectData objects[];
+};
+
+// the inverse of octEncode in pve_vertex.cpp
+vec3 octDecode(vec2 encoded) {
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-normal.z, 0.0);
+    normal.x += normal.x >= 0.0 ? -fold : fold;
+    normal.y += normal.y >= 0.0 ? -fold : fold;
+    return normalize(normal);
+}
+
+vec3 modelPosition(vec4 offset, vec4 scale) {
+    return offset.xyz + position.xyz * scale.xyz;
+}
+
+vec3 modelNormal() {
+#ifdef PVE_FULL_PRECISION_VERTICES
+    return normal;
+#else
+    return octDecode(normal);
+#endif
+}
+
+void main() {
+    ObjectData object = objects[gl_InstanceIndex];
+
+    vec4 positionWorld = object.modelMatrix *
+                         vec4(modelPosition(object.positionOffset, object.positionScale), 1.0);
+    gl_Position = ubo.projection * (ubo.view * positionWorld);
+
+    fragNormalWorld = normalize(mat3(object.normalMatrix) * modelNormal());
+    fragPosWorld = positionWorld.xyz;
+    fragColor = color.rgb;
+    fragUv = uv;
+    fragMaterialIndex = object.materialIndex;
+}
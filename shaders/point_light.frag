@@ -1,10 +1,11 @@
 #version 450
 
 layout (location = 0) in vec2 fragOffset;
+layout (location = 1) in vec4 fragColor;
 layout (location = 0) out vec4 outColor;
 
 struct PointLight {
-    vec4 position; // ignore w
+    vec4 position; // w is how far the light reaches, negative for an unused slot
     vec4 color; // w is intensity
 };
 
@@ -13,16 +14,11 @@ layout(set = 0, binding = 0) uniform GlobalUbo{
     mat4 view;
     mat4 inverseView;
     vec4 ambientLightColor;
-    PointLight pointLights[10];
-    int numLights;
+    uvec4 clusterCounts; // grid size in xyz, light count in w
+    vec4 clusterParams; // cluster size in pixels in xy, depth slice scale and bias in zw
+    vec4 framebufferSize; // width and height in pixels in xy
 } ubo;
 
-layout(push_constant) uniform Push {
-    vec4 position;
-    vec4 color;
-    float radius;
-} push;
-
 const float M_PI = 3.1415926538;
 
 void main(){
@@ -30,5 +26,5 @@ void main(){
     if (distance > 1.0) {
         discard;
     }
-    outColor = vec4(push.color.xyz, 0.5 * (cos(distance * M_PI) + 1.0));
+    outColor = vec4(fragColor.xyz, 0.5 * (cos(distance * M_PI) + 1.0));
 }
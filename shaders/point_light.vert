@@ -9,10 +9,14 @@ const vec2 OFFSETS[6] = vec2[](
   vec2(1.0, 1.0)
 );
 
+layout (location = 0) in vec4 instancePosition; // w is the billboard's radius
+layout (location = 1) in vec4 instanceColor; // w is intensity
+
 layout (location = 0) out vec2 fragOffset;
+layout (location = 1) out vec4 fragColor;
 
 struct PointLight {
-    vec4 position; // ignore w
+    vec4 position; // w is how far the light reaches, negative for an unused slot
     vec4 color; // w is intensity
 };
 
@@ -21,24 +25,21 @@ layout(set = 0, binding = 0) uniform GlobalUbo{
     mat4 view;
     mat4 inverseView;
     vec4 ambientLightColor;
-    PointLight pointLights[10];
-    int numLights;
+    uvec4 clusterCounts; // grid size in xyz, light count in w
+    vec4 clusterParams; // cluster size in pixels in xy, depth slice scale and bias in zw
+    vec4 framebufferSize; // width and height in pixels in xy
 } ubo;
 
-layout(push_constant) uniform Push {
-    vec4 position;
-    vec4 color;
-    float radius;
-} push;
-
 void main(){
     fragOffset = OFFSETS[gl_VertexIndex];
+    fragColor = instanceColor;
     vec3 cameraRightWorld = {ubo.view[0][0], ubo.view[1][0], ubo.view[2][0]};
     vec3 cameraUpWorld= {ubo.view[0][1], ubo.view[1][1], ubo.view[2][1]};
 
-    vec3 positionWorld = push.position.xyz 
-        + push.radius * fragOffset.x * cameraRightWorld
-        + push.radius * fragOffset.y * cameraUpWorld;
+    float radius = instancePosition.w;
+    vec3 positionWorld = instancePosition.xyz
+        + radius * fragOffset.x * cameraRightWorld
+        + radius * fragOffset.y * cameraUpWorld;
 
     gl_Position = ubo.projection * ubo.view * vec4(positionWorld,1.0);
 }
@@ -1,8 +1,11 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout (location = 0) in vec3 fragColor;
 layout (location = 1) in vec3 fragPosWorld;
 layout (location = 2) in vec3 fragNormalWorld;
+layout (location = 3) in vec2 fragUv;
+layout (location = 4) flat in uint fragMaterialIndex;
 
 // this is the output variable.
 // the "layout" qualifier takes a location value.
@@ -11,7 +14,7 @@ layout (location = 2) in vec3 fragNormalWorld;
 layout (location = 0) out vec4 outColor;
 
 struct PointLight {
-    vec4 position; // ignore w
+    vec4 position; // w is how far the light reaches, negative for an unused slot
     vec4 color; // w is intensity
 };
 
@@ -20,16 +23,48 @@ layout(set = 0, binding = 0) uniform GlobalUbo{
     mat4 view;
     mat4 inverseView;
     vec4 ambientLightColor;
-    PointLight pointLights[10];
-    int numLights;
+    uvec4 clusterCounts; // grid size in xyz, light count in w
+    vec4 clusterParams; // cluster size in pixels in xy, depth slice scale and bias in zw
+    vec4 framebufferSize; // width and height in pixels in xy
 } ubo;
 
-layout(push_constant) uniform Push {
-    mat4 modelMatrix;
-    mat4 normalMatrix;
-} push;
+// must match LightClusterSystem::MAX_LIGHTS_PER_CLUSTER
+const uint MAX_LIGHTS_PER_CLUSTER = 128;
+
+layout(set = 0, binding = 1) readonly buffer PointLightBuffer {
+    PointLight pointLights[];
+};
+
+layout(set = 0, binding = 2) readonly buffer ClusterLightCountBuffer {
+    uint clusterLightCounts[];
+};
+
+layout(set = 0, binding = 3) readonly buffer ClusterLightIndexBuffer {
+    uint clusterLightIndices[];
+};
+
+// must match PveMaterialLibrary::MAX_TEXTURES
+const uint MAX_TEXTURES = 4096;
+
+struct Material {
+    vec4 baseColorFactor;
+    uint baseColorTexture;
+};
+
+// every texture and material there is, indexed rather than bound per draw
+layout(set = 1, binding = 0) uniform sampler2D textures[MAX_TEXTURES];
+
+layout(set = 1, binding = 1) readonly buffer MaterialBuffer {
+    Material materials[];
+};
 
 void main() {
+    // the index can differ between the instances of an indirect draw
+    Material material = materials[fragMaterialIndex];
+    vec4 baseColor = material.baseColorFactor *
+                     texture(textures[nonuniformEXT(material.baseColorTexture)], fragUv);
+    vec3 surfaceColor = fragColor * baseColor.rgb;
+
     vec3 diffuseLight = ubo.ambientLightColor.xyz * ubo.ambientLightColor.w;
     vec3 specularLight = vec3(0.0);
     vec3 surfaceNormal = normalize(fragNormalWorld);
@@ -37,10 +72,25 @@ void main() {
     vec3 cameraPosWorld = ubo.inverseView[3].xyz;
     vec3 viewDirection = normalize(cameraPosWorld - fragPosWorld);
 
-    for (int i = 0; i < ubo.numLights; i++) {
-        PointLight light = ubo.pointLights[i];
+    // only the lights assigned to this fragment's cluster can reach it
+    float viewDepth = (ubo.view * vec4(fragPosWorld, 1.0)).z;
+    uvec3 grid = ubo.clusterCounts.xyz;
+    uvec3 cluster;
+    cluster.xy = min(uvec2(gl_FragCoord.xy / ubo.clusterParams.xy), grid.xy - 1u);
+    cluster.z = uint(clamp(log(viewDepth) * ubo.clusterParams.z - ubo.clusterParams.w, 0.0,
+                           float(grid.z - 1u)));
+    uint clusterIndex = cluster.x + grid.x * (cluster.y + grid.y * cluster.z);
+    uint lightCount = clusterLightCounts[clusterIndex];
+
+    for (uint i = 0; i < lightCount; i++) {
+        PointLight light =
+            pointLights[clusterLightIndices[clusterIndex * MAX_LIGHTS_PER_CLUSTER + i]];
         vec3 directionToLight = light.position.xyz - fragPosWorld;
-        float attenuation = 1.0 / dot(directionToLight, directionToLight);
+        float distanceSquared = dot(directionToLight, directionToLight);
+        // fades to exactly zero at the light's reach, so clipping it to clusters doesn't show
+        float reachSquared = light.position.w * light.position.w;
+        float falloff = clamp(1.0 - pow(distanceSquared / reachSquared, 2.0), 0.0, 1.0);
+        float attenuation = falloff * falloff / distanceSquared;
         directionToLight = normalize(directionToLight);
         float cosAngIncidence = max(dot(surfaceNormal, directionToLight),0);
         vec3 intensity = light.color.xyz * light.color.w * attenuation;
@@ -54,5 +104,5 @@ void main() {
         specularLight += intensity * blinnTerm;
     }
 
-    outColor = vec4(diffuseLight * fragColor + specularLight * fragColor, 1.0);
+    outColor = vec4(diffuseLight * surfaceColor + specularLight * surfaceColor, 1.0);
 }
\ No newline at end of file
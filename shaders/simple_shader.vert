@@ -8,17 +8,32 @@
 // "in" signifies this variable takes its value from a vertex buffer
 // "layout(location)" sets the storage of where this variable value will come from
 // this is how we connect the attribute description to the variable we mean to reference in the shader
+// PVE_FULL_PRECISION_VERTICES matches the engine's vertex layout, see pve_vertex.hpp. In
+// the compact layout the vertex fetch turns the packed components into floats, the position
+// is still a fraction of the mesh bounds and the normal is octahedral encoded
+#ifdef PVE_FULL_PRECISION_VERTICES
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 color;
 layout(location = 2) in vec3 normal;
+#else
+layout(location = 0) in vec4 position;
+layout(location = 1) in vec4 color;
+layout(location = 2) in vec2 normal;
+#endif
 layout(location = 3) in vec2 uv;
 
+// per instance attributes, a mat4 takes up four locations
+layout(location = 4) in mat4 modelMatrix;
+layout(location = 8) in mat4 normalMatrix;
+
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec3 fragPosWorld;
 layout(location = 2) out vec3 fragNormalWorld;
+layout(location = 3) out vec2 fragUv;
+layout(location = 4) flat out uint fragMaterialIndex;
 
 struct PointLight {
-    vec4 position; // ignore w
+    vec4 position; // w is how far the light reaches, negative for an unused slot
     vec4 color; // w is intensity
 };
 
@@ -27,15 +42,39 @@ layout(set = 0, binding = 0) uniform GlobalUbo{
     mat4 view;
     mat4 inverseView;
     vec4 ambientLightColor;
-    PointLight pointLights[10];
-    int numLights;
+    uvec4 clusterCounts; // grid size in xyz, light count in w
+    vec4 clusterParams; // cluster size in pixels in xy, depth slice scale and bias in zw
+    vec4 framebufferSize; // width and height in pixels in xy
 } ubo;
 
+// the only things that change between draws of different models and materials
 layout(push_constant) uniform Push {
-    mat4 modelMatrix;
-    mat4 normalMatrix;
+    vec4 positionOffset; // dequantizes the model's positions, offset + position * scale
+    vec4 positionScale;
+    uint materialIndex;
 } push;
 
+// the inverse of octEncode in pve_vertex.cpp
+vec3 octDecode(vec2 encoded) {
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-normal.z, 0.0);
+    normal.x += normal.x >= 0.0 ? -fold : fold;
+    normal.y += normal.y >= 0.0 ? -fold : fold;
+    return normalize(normal);
+}
+
+vec3 modelPosition(vec4 offset, vec4 scale) {
+    return offset.xyz + position.xyz * scale.xyz;
+}
+
+vec3 modelNormal() {
+#ifdef PVE_FULL_PRECISION_VERTICES
+    return normal;
+#else
+    return octDecode(normal);
+#endif
+}
+
 void main() {
 // the gl_Position is a 4-dimensional vector that maps to the output frame buffer image.
 // the top left corner is (-1,-1) and the bottom right corner is (1,1). The center is (0,0).
@@ -48,10 +87,13 @@ void main() {
 // the 4th parameter is what the vector will be divided by.
 // gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
 
-    vec4 positionWorld = push.modelMatrix * vec4(position, 1.0);
+    vec4 positionWorld =
+        modelMatrix * vec4(modelPosition(push.positionOffset, push.positionScale), 1.0);
     gl_Position = ubo.projection * (ubo.view * positionWorld);
 
-    fragNormalWorld = normalize(mat3(push.normalMatrix) * normal);
+    fragNormalWorld = normalize(mat3(normalMatrix) * modelNormal());
     fragPosWorld = positionWorld.xyz;
-    fragColor = color;
+    fragColor = color.rgb;
+    fragUv = uv;
+    fragMaterialIndex = push.materialIndex;
 }
\ No newline at end of file
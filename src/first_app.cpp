@@ -2,10 +2,14 @@
 
 #include "constants/colors.hpp"
 #include "controllers/keyboard_movement_controller.hpp"
-#include "pve/pve_buffer.hpp"
 #include "pve/pve_camera.hpp"
+#include "pve/pve_frame_allocator.hpp"
+#include "pve/pve_parallel_recorder.hpp"
+#include "systems/gpu_driven_render_system.hpp"
+#include "systems/light_cluster_system.hpp"
 #include "systems/point_light_system.hpp"
 #include "systems/simple_render_system.hpp"
+#include "systems/transform_system.hpp"
 
 // libs
 #define GLM_FORCE_RADIANS  // No matter what system i'm in, angles are in radians, not degrees
@@ -17,67 +21,173 @@
 #include <array>
 #include <cassert>
 #include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <random>
 #include <stdexcept>
 #include <vector>
 
 namespace pve {
 
 float MAX_FRAME_TIME = 1.0f;
+uint32_t GEOMETRY_ARENA_VERTICES = 1 << 20;
+uint32_t GEOMETRY_ARENA_INDICES = 4 << 20;
+uint32_t GPU_DRIVEN_MAX_OBJECTS = 1 << 17;
+uint32_t MAX_POINT_LIGHTS = 1 << 14;
+VkDeviceSize STREAMING_MEMORY_BUDGET = 256 * 1024 * 1024;
+uint32_t STREAMING_WORKERS = 2;
+uint32_t DEFRAGMENT_EVICTIONS = 16;
+
+// writes a tightly packed 4 byte per pixel frame as a binary PPM, dropping alpha
+static void writeFramePPM(const std::string &path, const void *pixels, VkExtent2D extent,
+                          VkFormat format) {
+    std::ofstream file{path, std::ios::binary};
+    if (!file) {
+        throw std::runtime_error("failed to open file for writing: " + path);
+    }
+    file << "P6\n" << extent.width << " " << extent.height << "\n255\n";
+
+    bool bgra = format == VK_FORMAT_B8G8R8A8_SRGB || format == VK_FORMAT_B8G8R8A8_UNORM;
+    auto src = static_cast<const uint8_t *>(pixels);
+    std::vector<uint8_t> row(extent.width * 3);
+    for (uint32_t y = 0; y < extent.height; y++) {
+        for (uint32_t x = 0; x < extent.width; x++) {
+            const uint8_t *pixel = src + (y * extent.width + x) * 4;
+            row[x * 3 + 0] = bgra ? pixel[2] : pixel[0];
+            row[x * 3 + 1] = pixel[1];
+            row[x * 3 + 2] = bgra ? pixel[0] : pixel[2];
+        }
+        file.write(reinterpret_cast<const char *>(row.data()), row.size());
+    }
+}
+
+// light and dark squares, squares across each side. Cooked like a texture loaded from a
+// file, so it's mipmapped and block compressed
+static std::shared_ptr<PveTexture> makeCheckerboard(PveDevice &device, PveJobSystem &jobSystem,
+                                                    uint32_t size, uint32_t squares) {
+    PveImage image;
+    image.width = size;
+    image.height = size;
+    image.pixels.resize(size * size * 4);
+    for (uint32_t y = 0; y < size; y++) {
+        for (uint32_t x = 0; x < size; x++) {
+            bool light = (x * squares / size + y * squares / size) % 2 == 0;
+            uint32_t pixel = light ? 0xffd8d8d8 : 0xff707070;
+            std::memcpy(&image.pixels[(y * size + x) * 4], &pixel, 4);
+        }
+    }
+    PveTextureCooker::Options options = PveTexture::supportedOptions(device, {});
+    return std::make_shared<PveTexture>(device,
+                                        PveTextureCooker::cook(image, options, &jobSystem));
+}
 
-FirstApp::FirstApp() {
-    globalPool = PveDescriptorPool::Builder(pveDevice)
-                     .setMaxSets(PveSwapChain::MAX_FRAMES_IN_FLIGHT)
-                     .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                                  PveSwapChain::MAX_FRAMES_IN_FLIGHT)
-                     .build();
+FirstApp::FirstApp(const AppConfigInfo &config)
+    : config{config}, pveWindow{WIDTH, HEIGHT, "Hello Vulkan!", config.headless} {
+    materialLibrary = std::make_unique<PveMaterialLibrary>(pveDevice);
+    if (config.geometryArena || config.gpuDriven) {
+        geometryArena = std::make_unique<PveGeometryArena>(
+            pveDevice, sizeof(PveModel::GpuVertex), GEOMETRY_ARENA_VERTICES,
+            GEOMETRY_ARENA_INDICES);
+    }
+    PveAssetStreamer::Config streamerConfig{};
+    streamerConfig.memoryBudget = STREAMING_MEMORY_BUDGET;
+    streamerConfig.workerCount = STREAMING_WORKERS;
+    assetStreamer = std::make_unique<PveAssetStreamer>(pveDevice, uploadManager,
+                                                       geometryArena.get(), streamerConfig);
     loadGameObjects();
 }
 
 FirstApp::~FirstApp() {}
 
-void FirstApp::run() {
-    std::vector<std::unique_ptr<PveBuffer>> uboBuffers(
-        PveSwapChain::MAX_FRAMES_IN_FLIGHT);
-    for (int i = 0; i < uboBuffers.size(); i++) {
-        uboBuffers[i] = std::make_unique<PveBuffer>(
-            pveDevice, sizeof(GlobalUbo), 1, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-        uboBuffers[i]->map();
+bool FirstApp::shouldStop(uint32_t framesRendered) const {
+    if (config.frameCount > 0 && framesRendered >= config.frameCount) {
+        return true;
     }
+    return pveWindow.shouldClose();
+}
 
-    auto globalSetLayout = PveDescriptorSetLayout::Builder(pveDevice)
-                               .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                                           VK_SHADER_STAGE_ALL_GRAPHICS)
-                               .build();
-
-    std::vector<VkDescriptorSet> globalDescriptorSets(PveSwapChain::MAX_FRAMES_IN_FLIGHT);
-    for (int i = 0; i < globalDescriptorSets.size(); i++) {
-        auto bufferInfo = uboBuffers[i]->descriptorInfo();
-        PveDescriptorWriter(*globalSetLayout, *globalPool)
-            .writeBuffer(0, &bufferInfo)
-            .build(globalDescriptorSets[i]);
+void FirstApp::run() {
+    // the ubo and every other bit of data that only lives for a frame
+    PveFrameAllocator frameAllocator{pveDevice};
+    // and descriptor sets that do, one allocator per frame in flight
+    std::vector<std::unique_ptr<PveDescriptorAllocator>> frameDescriptorAllocators;
+    for (int i = 0; i < PveSwapChain::MAX_FRAMES_IN_FLIGHT; i++) {
+        frameDescriptorAllocators.push_back(std::make_unique<PveDescriptorAllocator>(pveDevice));
     }
 
+    // the light cluster compute pass reads the ubo and lights and writes the cluster lists.
+    // The ubo is wherever the frame allocator put it, passed as the dynamic offset
+    auto globalSetLayout =
+        PveDescriptorSetLayout::Builder(pveDevice)
+            .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                        VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT)
+            .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                        VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT)
+            .addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                        VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT)
+            .addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                        VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT)
+            .build();
+
     SimpleRenderSystem simpleRenderSystem{pveDevice, pveRenderer.getSwapChainRenderPass(),
-                                          globalSetLayout->getDescriptorSetLayout()};
+                                          globalSetLayout->getDescriptorSetLayout(),
+                                          *materialLibrary};
+
+    std::unique_ptr<GpuDrivenRenderSystem> gpuDrivenRenderSystem;
+    if (config.gpuDriven) {
+        gpuDrivenRenderSystem = std::make_unique<GpuDrivenRenderSystem>(
+            pveDevice, pveRenderer.getSwapChainRenderPass(),
+            globalSetLayout->getDescriptorSetLayout(), *materialLibrary, GPU_DRIVEN_MAX_OBJECTS);
+    }
 
     PointLightSystem pointLightSystem{pveDevice, pveRenderer.getSwapChainRenderPass(),
-                                      globalSetLayout->getDescriptorSetLayout()};
+                                      globalSetLayout->getDescriptorSetLayout(),
+                                      MAX_POINT_LIGHTS};
+    LightClusterSystem lightClusterSystem{pveDevice, globalSetLayout->getDescriptorSetLayout()};
+
+    std::unique_ptr<PveParallelRecorder> parallelRecorder;
+    if (config.recordThreads > 0) {
+        parallelRecorder = std::make_unique<PveParallelRecorder>(pveDevice, config.recordThreads);
+    }
+
+    TransformSystem transformSystem{};
     PveCamera camera{};
     camera.setViewTarget(
         glm::vec3(-1.f, -2.f, 2.f),
         glm::vec3(0.f, 0.f, 2.5f));  // camera looks to the center of the cube
     // while the window doesn't want to close, poll window events
 
-    // viewerObject has no model and won't be rendered. It's used to store the camera's current state.
-    auto viewerObject = PveGameObject::createGameObject();
-    viewerObject.transform.translation.z = -2.5f;
+    // the viewer isn't an entity, its transform just stores the camera's current state
+    TransformComponent viewerTransform{};
+    viewerTransform.setTranslation({0.f, 0.f, -2.5f});
     KeyboardMovementController cameraController{};
 
-    auto currentTime = std::chrono::high_resolution_clock::now();
+    // only the most recent frame is kept, older ones are overwritten as they come back
+    std::vector<uint8_t> lastFrame;
+    VkExtent2D lastFrameExtent{};
+    VkFormat lastFrameFormat = VK_FORMAT_UNDEFINED;
+    if (config.headless && config.readback) {
+        pveRenderer.setFrameReadback(
+            [&](const void *pixels, VkExtent2D extent, VkFormat format) {
+                auto bytes = static_cast<const uint8_t *>(pixels);
+                lastFrame.assign(bytes, bytes + extent.width * extent.height * 4);
+                lastFrameExtent = extent;
+                lastFrameFormat = format;
+            });
+    }
 
-    while (!pveWindow.shouldClose()) {
-        glfwPollEvents();
+    uint32_t framesRendered = 0;
+    uint32_t defragmentedEvictions = 0;
+    auto startTime = std::chrono::high_resolution_clock::now();
+    auto currentTime = startTime;
+
+    while (!shouldStop(framesRendered)) {
+        if (!config.headless) {
+            PVE_PROFILE_ZONE("input");
+            glfwPollEvents();
+        }
 
         auto newTime = std::chrono::high_resolution_clock::now();
         float frameTime = std::chrono::duration<float, std::chrono::seconds::period>(
@@ -86,23 +196,73 @@ void FirstApp::run() {
         currentTime = newTime;
         frameTime = glm::min(frameTime, MAX_FRAME_TIME);
 
-        cameraController.moveInPlaneXZ(pveWindow.getGLFWWindow(), frameTime,
-                                       viewerObject);
-        camera.setViewYXZ(viewerObject.transform.translation,
-                          viewerObject.transform.rotation);
+        if (!config.headless) {
+            cameraController.moveInPlaneXZ(pveWindow.getGLFWWindow(), frameTime,
+                                           viewerTransform);
+        }
+        camera.setViewYXZ(viewerTransform.getTranslation(), viewerTransform.getRotation());
+
+        registry.view<NameComponent, TransformComponent>().each(
+            [](PveEntity, NameComponent &name, TransformComponent &transform) {
+                if (name.name != "cube") return;
+                glm::vec3 rotation = transform.getRotation();
+                rotation.y = glm::mod(rotation.y + 0.001f, glm::two_pi<float>());
+                rotation.x = glm::mod(rotation.x + 0.005f, glm::two_pi<float>());
+                transform.setRotation(rotation);
+            });
+        // everything that moved this frame gets its matrices rebuilt in one batch
+        transformSystem.update(registry, &jobSystem);
 
         float aspect = pveRenderer.getAspectRatio();
         camera.setPerspectiveProjection(glm::radians(50.f), aspect, 0.1f, 100.f);
 
+        // evicted models leave holes in device memory. Once enough of them did, the remaining
+        // model buffers are packed together while no upload refers to them. The device waits
+        // for every frame in flight, which is fine as rarely as this happens
+        if (assetStreamer->getEvictionCount() - defragmentedEvictions >= DEFRAGMENT_EVICTIONS &&
+            uploadManager.isIdle()) {
+            PVE_PROFILE_ZONE("defragment");
+            pveDevice.defragmentMemory();
+            defragmentedEvictions = assetStreamer->getEvictionCount();
+        }
+
         // the beginFrame function returns a nullptr if the swap chains needs to be recreated
         if (auto commandBuffer = pveRenderer.beginFrame()) {
             int frameIndex = pveRenderer.getFrameIndex();
+            profiler.beginFrame(frameIndex, commandBuffer);
+            frameAllocator.beginFrame(frameIndex);
+            // the frame's fence has signaled, nothing still reads its sets
+            frameDescriptorAllocators[frameIndex]->reset();
+            // the global set is transient like the rest, once the frame's pools have grown
+            // to fit, allocating it again is only a descriptor write
+            VkDescriptorSet globalDescriptorSet;
+            {
+                auto bufferInfo = frameAllocator.descriptorInfo(sizeof(GlobalUbo));
+                auto lightInfo = pointLightSystem.getLightBufferInfo();
+                auto clusterLightCountInfo =
+                    lightClusterSystem.getClusterLightCountInfo(frameIndex);
+                auto clusterLightIndexInfo =
+                    lightClusterSystem.getClusterLightIndexInfo(frameIndex);
+                PveDescriptorWriter(*globalSetLayout, *frameDescriptorAllocators[frameIndex])
+                    .writeBuffer(0, &bufferInfo)
+                    .writeBuffer(1, &lightInfo)
+                    .writeBuffer(2, &clusterLightCountInfo)
+                    .writeBuffer(3, &clusterLightIndexInfo)
+                    .build(globalDescriptorSet);
+            }
+            // before the upload manager, so models created now start uploading this frame
+            assetStreamer->update(registry, camera.getPosition());
+            // models whose uploads finished become drawable from here on
+            uploadManager.update(commandBuffer);
             FrameInfo frameInfo{frameIndex,
                                 frameTime,
                                 commandBuffer,
                                 camera,
-                                globalDescriptorSets[frameIndex],
-                                gameObjects};
+                                globalDescriptorSet,
+                                registry,
+                                &jobSystem,
+                                &frameAllocator,
+                                frameDescriptorAllocators[frameIndex].get()};
 
             // prepare and update objects in memory
             GlobalUbo ubo{};
@@ -110,60 +270,161 @@ void FirstApp::run() {
             ubo.view = camera.getView();
             ubo.inverseView = camera.getInverseView();
             pointLightSystem.update(frameInfo, ubo);
-            uboBuffers[frameIndex]->writeToBuffer(&ubo);
-            uboBuffers[frameIndex]->flush();
-
-            // render - record draw calls
-            pveRenderer.beginSwapChainRenderPass(commandBuffer);
+            lightClusterSystem.update(camera, pveRenderer.getSwapChainExtent(), ubo);
+            // the memory is coherent, so a copy is all it takes
+            auto uboAllocation = frameAllocator.allocateUniform(sizeof(GlobalUbo));
+            std::memcpy(uboAllocation.mapped, &ubo, sizeof(ubo));
+            frameInfo.globalUboOffset = uboAllocation.offset;
+
+            // compute work has to be recorded before the render pass begins
+            {
+                PveProfiler::GpuZone zone{profiler, commandBuffer, "lightClusters"};
+                lightClusterSystem.assignLights(frameInfo);
+            }
+            if (gpuDrivenRenderSystem) {
+                gpuDrivenRenderSystem->update(frameInfo);
+                PveProfiler::GpuZone zone{profiler, commandBuffer, "gpuCull"};
+                gpuDrivenRenderSystem->cull(frameInfo);
+            }
+
+            // render - record draw calls. Recorded inline, every system's draws get a zone of
+            // their own. The secondary buffers are recorded on workers, so in parallel mode the
+            // GPU only gets a zone around the whole pass
+            std::optional<PveProfiler::GpuZone> renderPassZone;
+            if (parallelRecorder) {
+                renderPassZone.emplace(profiler, commandBuffer, "renderPass");
+                parallelRecorder->beginFrame(frameIndex, pveRenderer.getSwapChainRenderPass(),
+                                             pveRenderer.getCurrentFramebuffer(),
+                                             pveRenderer.getSwapChainExtent());
+                pveRenderer.beginSwapChainRenderPass(
+                    commandBuffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            } else {
+                pveRenderer.beginSwapChainRenderPass(commandBuffer);
+            }
+
+            // systems that record serially get a secondary buffer of their own in parallel
+            // mode, from the first worker's pool since no worker is running by then
+            auto recordSerially = [&](auto &&record) {
+                if (!parallelRecorder) {
+                    record(frameInfo);
+                    return;
+                }
+                FrameInfo secondaryFrameInfo{frameInfo};
+                secondaryFrameInfo.commandBuffer = parallelRecorder->beginSecondary(0);
+                record(secondaryFrameInfo);
+                parallelRecorder->endSecondary(secondaryFrameInfo.commandBuffer);
+                parallelRecorder->queue(secondaryFrameInfo.commandBuffer);
+            };
 
             // order here matters
-            simpleRenderSystem.renderGameObjects(frameInfo);
-            pointLightSystem.render(frameInfo);
-
+            {
+                std::optional<PveProfiler::GpuZone> zone;
+                if (!parallelRecorder) zone.emplace(profiler, commandBuffer, "gameObjects");
+                if (gpuDrivenRenderSystem) {
+                    recordSerially(
+                        [&](FrameInfo &info) { gpuDrivenRenderSystem->render(info); });
+                } else {
+                    simpleRenderSystem.renderGameObjects(frameInfo, parallelRecorder.get());
+                }
+            }
+            {
+                std::optional<PveProfiler::GpuZone> zone;
+                if (!parallelRecorder) zone.emplace(profiler, commandBuffer, "pointLights");
+                recordSerially([&](FrameInfo &info) { pointLightSystem.render(info); });
+            }
+
+            if (parallelRecorder) {
+                parallelRecorder->execute(commandBuffer);
+            }
             pveRenderer.endSwapChainRenderPass(commandBuffer);
+            if (renderPassZone) {
+                renderPassZone->end();
+            }
             pveRenderer.endFrame();
+            framesRendered++;
         }
+        profiler.endFrame();
     }
 
     // this makes the CPU block until all GPU operations have completed
     vkDeviceWaitIdle(pveDevice.device());
+
+    float elapsed = std::chrono::duration<float, std::chrono::seconds::period>(
+                        std::chrono::high_resolution_clock::now() - startTime)
+                        .count();
+    if (framesRendered > 0 && elapsed > 0.f) {
+        std::cout << framesRendered << " frames in " << elapsed << "s ("
+                  << framesRendered / elapsed << " frames/s)\n";
+    }
+    if (gpuDrivenRenderSystem) {
+        std::cout << "gpu culling: " << gpuDrivenRenderSystem->getVisibleCount() << " visible, "
+                  << gpuDrivenRenderSystem->getCulledCount() << " culled, "
+                  << gpuDrivenRenderSystem->getSkippedCount() << " skipped\n";
+    } else {
+        const auto &stats = simpleRenderSystem.getCullingStats();
+        std::cout << "cpu culling: " << stats.visibleCount << " visible, " << stats.culledCount
+                  << " culled\n";
+    }
+
+    if (config.profile) {
+        profiler.printSummary(std::cout);
+        if (profiler.writeChromeTrace(config.profilePath)) {
+            std::cout << "wrote trace to " << config.profilePath << "\n";
+        } else {
+            std::cerr << "failed to write trace to " << config.profilePath << "\n";
+        }
+    }
+
+    if (config.headless && config.readback) {
+        pveRenderer.flushPendingReadbacks();
+        if (!lastFrame.empty()) {
+            writeFramePPM(config.readbackPath, lastFrame.data(), lastFrameExtent,
+                          lastFrameFormat);
+            std::cout << "wrote last frame to " << config.readbackPath << "\n";
+        }
+    }
 }
 
 void FirstApp::loadGameObjects() {
-    std::shared_ptr<PveModel> pveModel =
-        PveModel::createModelFromFile(pveDevice, "models/cube.obj");
-    auto cube = PveGameObject::createGameObject();
-    cube.model = pveModel;
-    cube.name = "cube";
-    cube.transform.translation = {-2.0f, -0.2f, 0.f};
-    cube.transform.scale = {.3f, .3f, .3f};
-    gameObjects.emplace(cube.getId(), std::move(cube));
-
-    pveModel = PveModel::createModelFromFile(pveDevice, "models/flat_vase.obj");
-    auto flatVase = PveGameObject::createGameObject();
-    flatVase.model = pveModel;
-    flatVase.name = "flatVase";
-    flatVase.transform.translation = {1.0f, .5f, 0.f};
-    flatVase.transform.scale = {3.f, 3.f, 3.f};
-    gameObjects.emplace(flatVase.getId(), std::move(flatVase));
-
-    pveModel = PveModel::createModelFromFile(pveDevice, "models/smooth_vase.obj");
-    auto smoothVase = PveGameObject::createGameObject();
-    smoothVase.model = pveModel;
-    smoothVase.name = "smoothVase";
-    smoothVase.transform.translation = {2.0f, .5f, 0.f};
-    smoothVase.transform.scale = {3.f, 3.f, 3.f};
-    gameObjects.emplace(smoothVase.getId(), std::move(smoothVase));
-
-    pveModel = PveModel::createModelFromFile(pveDevice, "models/quad.obj");
-    auto floor = PveGameObject::createGameObject();
-    floor.model = pveModel;
-    floor.transform.translation = {0.f, .5f, 0.f};
-    floor.transform.scale = {3.f, 1.f, 3.f};
-    gameObjects.emplace(floor.getId(), std::move(floor));
-
-    // auto pointLight = PveGameObject::makePointLight(0.2f);
-    // gameObjects.emplace(pointLight.getId(), std::move(pointLight));
+    // the models load in the background, the entities show up as they become resident
+    auto cube = registry.create();
+    registry.emplace<StreamedModelComponent>(cube, assetStreamer->request("models/cube.obj"));
+    registry.emplace<ModelComponent>(cube);
+    registry.emplace<NameComponent>(cube, "cube");
+    auto &cubeTransform = registry.emplace<TransformComponent>(cube);
+    cubeTransform.setTranslation({-2.0f, -0.2f, 0.f});
+    cubeTransform.setScale({.3f, .3f, .3f});
+
+    auto flatVase = registry.create();
+    registry.emplace<StreamedModelComponent>(flatVase,
+                                             assetStreamer->request("models/flat_vase.obj"));
+    registry.emplace<ModelComponent>(flatVase);
+    registry.emplace<NameComponent>(flatVase, "flatVase");
+    auto &flatVaseTransform = registry.emplace<TransformComponent>(flatVase);
+    flatVaseTransform.setTranslation({1.0f, .5f, 0.f});
+    flatVaseTransform.setScale({3.f, 3.f, 3.f});
+
+    auto smoothVase = registry.create();
+    registry.emplace<StreamedModelComponent>(smoothVase,
+                                             assetStreamer->request("models/smooth_vase.obj"));
+    registry.emplace<ModelComponent>(smoothVase);
+    registry.emplace<NameComponent>(smoothVase, "smoothVase");
+    auto &smoothVaseTransform = registry.emplace<TransformComponent>(smoothVase);
+    smoothVaseTransform.setTranslation({2.0f, .5f, 0.f});
+    smoothVaseTransform.setScale({3.f, 3.f, 3.f});
+
+    auto floor = registry.create();
+    registry.emplace<StreamedModelComponent>(floor, assetStreamer->request("models/quad.obj"));
+    registry.emplace<ModelComponent>(floor);
+    PveMaterial floorMaterial{};
+    floorMaterial.baseColorTexture =
+        materialLibrary->addTexture(makeCheckerboard(pveDevice, jobSystem, 256, 8));
+    registry.emplace<MaterialComponent>(floor, materialLibrary->addMaterial(floorMaterial));
+    auto &floorTransform = registry.emplace<TransformComponent>(floor);
+    floorTransform.setTranslation({0.f, .5f, 0.f});
+    floorTransform.setScale({3.f, 1.f, 3.f});
+
+    // makePointLight(registry, 0.2f);
 
     std::vector<glm::vec3> lightColors{
         {1.f, .1f, .1f}, {.1f, .1f, 1.f}, {.1f, 1.f, .1f},
@@ -171,14 +432,26 @@ void FirstApp::loadGameObjects() {
     };
 
     for (int i = 0; i < lightColors.size(); i++) {
-        auto pointLight = PveGameObject::makePointLight(0.2f);
-        pointLight.color = lightColors[i];
+        auto pointLight = makePointLight(registry, 0.2f, 0.1f, lightColors[i]);
         auto rotateLight =
             glm::rotate(glm::mat4(1.f), (i * glm::two_pi<float>()) / lightColors.size(),
                         glm::vec3(0.f, -1.f, 0.f));
-        pointLight.transform.translation =
-            glm::vec3(rotateLight * glm::vec4(-1.f, -1.f, -1.f, 1.f));
-        gameObjects.emplace(pointLight.getId(), std::move(pointLight));
+        registry.get<TransformComponent>(pointLight)
+            .setTranslation(glm::vec3(rotateLight * glm::vec4(-1.f, -1.f, -1.f, 1.f)));
+    }
+
+    // small dim lights scattered just above the floor, seeded so every run matches
+    std::mt19937 random{1234};
+    std::uniform_real_distribution<float> across{-3.f, 3.f};
+    std::uniform_real_distribution<float> height{-.6f, .3f};
+    std::uniform_real_distribution<float> channel{.1f, 1.f};
+    uint32_t extraLights = glm::min(config.extraLights,
+                                    MAX_POINT_LIGHTS - static_cast<uint32_t>(lightColors.size()));
+    for (uint32_t i = 0; i < extraLights; i++) {
+        auto pointLight = makePointLight(registry, 0.01f, 0.02f,
+                                         {channel(random), channel(random), channel(random)});
+        registry.get<TransformComponent>(pointLight)
+            .setTranslation({across(random), height(random), across(random)});
     }
 }
 
@@ -1,13 +1,73 @@
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <stdexcept>
+#include <string>
 
 #include "first_app.hpp"
 
-int main() {
-    pve::FirstApp app{};
+static int usage(const char *program) {
+    std::cerr << "usage: " << program
+              << " [--headless] [--frames N] [--readback [file.ppm]] [--geometry-arena]"
+              << " [--gpu-driven] [--lights N] [--record-threads N] [--job-threads N]"
+              << " [--profile [trace.json]]\n";
+    return EXIT_FAILURE;
+}
+
+// only plain digits that fit 32 bits, stoul alone would take "-1" and throw on "abc"
+static bool parseCount(const std::string &text, uint32_t &value) {
+    if (text.empty() || text.size() > 10 ||
+        text.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    unsigned long long parsed = std::stoull(text);
+    if (parsed > UINT32_MAX) {
+        return false;
+    }
+    value = static_cast<uint32_t>(parsed);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    pve::AppConfigInfo config{};
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--headless") {
+            config.headless = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            if (!parseCount(argv[++i], config.frameCount)) return usage(argv[0]);
+        } else if (arg == "--geometry-arena") {
+            config.geometryArena = true;
+        } else if (arg == "--gpu-driven") {
+            config.gpuDriven = true;
+        } else if (arg == "--lights" && i + 1 < argc) {
+            if (!parseCount(argv[++i], config.extraLights)) return usage(argv[0]);
+        } else if (arg == "--record-threads" && i + 1 < argc) {
+            if (!parseCount(argv[++i], config.recordThreads)) return usage(argv[0]);
+        } else if (arg == "--job-threads" && i + 1 < argc) {
+            if (!parseCount(argv[++i], config.jobThreads)) return usage(argv[0]);
+        } else if (arg == "--readback") {
+            config.readback = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                config.readbackPath = argv[++i];
+            }
+        } else if (arg == "--profile") {
+            config.profile = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                config.profilePath = argv[++i];
+            }
+        } else {
+            return usage(argv[0]);
+        }
+    }
+
+    if (config.headless && config.frameCount == 0) {
+        // nothing can close a headless window
+        config.frameCount = 1000;
+    }
 
     try {
+        pve::FirstApp app{config};
         app.run();
     } catch (const std::exception &e) {
         std::cerr << e.what() << '\n';
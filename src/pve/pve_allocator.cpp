@@ -0,0 +1,418 @@
+#include "pve/pve_allocator.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace pve {
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// range allocator
+
+PveRangeAllocator::PveRangeAllocator(VkDeviceSize size) { reset(size); }
+
+void PveRangeAllocator::reset(VkDeviceSize size) {
+    this->size = size;
+    freeBytes = 0;
+    freeByOffset.clear();
+    freeBySize.clear();
+    if (size > 0) {
+        insertFreeRange(0, size);
+    }
+}
+
+bool PveRangeAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment,
+                                 VkDeviceSize &offset, VkDeviceSize &padding) {
+    assert(size > 0 && alignment > 0 && "Cannot allocate an empty or unaligned range");
+
+    // the smallest range that fits wins, padding may push a candidate over so keep looking
+    for (auto candidate = freeBySize.lower_bound(size); candidate != freeBySize.end();
+         candidate++) {
+        VkDeviceSize rangeOffset = candidate->second;
+        VkDeviceSize rangeSize = candidate->first;
+        VkDeviceSize alignedOffset = alignUp(rangeOffset, alignment);
+        if (alignedOffset + size > rangeOffset + rangeSize) {
+            continue;
+        }
+
+        eraseFreeRange(freeByOffset.find(rangeOffset));
+        VkDeviceSize end = alignedOffset + size;
+        if (end < rangeOffset + rangeSize) {
+            insertFreeRange(end, rangeOffset + rangeSize - end);
+        }
+        offset = alignedOffset;
+        padding = alignedOffset - rangeOffset;
+        return true;
+    }
+    return false;
+}
+
+void PveRangeAllocator::free(VkDeviceSize offset, VkDeviceSize size) {
+    assert(offset + size <= this->size && "Freed range is out of bounds");
+
+    // merge with the free neighbours on both sides
+    auto next = freeByOffset.lower_bound(offset);
+    if (next != freeByOffset.end() && next->first == offset + size) {
+        size += next->second;
+        eraseFreeRange(next);
+    }
+    auto previous = freeByOffset.lower_bound(offset);
+    if (previous != freeByOffset.begin()) {
+        previous--;
+        if (previous->first + previous->second == offset) {
+            offset = previous->first;
+            size += previous->second;
+            eraseFreeRange(previous);
+        }
+    }
+    insertFreeRange(offset, size);
+}
+
+VkDeviceSize PveRangeAllocator::getLargestFreeRange() const {
+    return freeBySize.empty() ? 0 : freeBySize.rbegin()->first;
+}
+
+void PveRangeAllocator::insertFreeRange(VkDeviceSize offset, VkDeviceSize size) {
+    freeByOffset.emplace(offset, size);
+    freeBySize.emplace(size, offset);
+    freeBytes += size;
+}
+
+void PveRangeAllocator::eraseFreeRange(std::map<VkDeviceSize, VkDeviceSize>::iterator range) {
+    auto sizes = freeBySize.equal_range(range->second);
+    for (auto it = sizes.first; it != sizes.second; it++) {
+        if (it->second == range->first) {
+            freeBySize.erase(it);
+            break;
+        }
+    }
+    freeBytes -= range->second;
+    freeByOffset.erase(range);
+}
+
+// memory blocks
+
+struct PveMemoryBlock {
+    struct Record {
+        VkDeviceSize padding;
+        VkDeviceSize reservedSize;  // what was taken from the range allocator after the offset
+        VkDeviceSize requestedSize;
+        VkDeviceSize alignment;
+        void *userData;
+    };
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    void *mapped = nullptr;
+    uint32_t memoryTypeIndex = 0;
+    size_t poolIndex = 0;
+    // dedicated blocks hold one large allocation and are released together with it
+    bool dedicated = false;
+
+    PveRangeAllocator ranges;
+    // keyed by the aligned offset handed out to the caller
+    std::unordered_map<VkDeviceSize, Record> allocations;
+    VkDeviceSize bytesUsed = 0;
+    VkDeviceSize bytesWasted = 0;
+};
+
+// allocator
+
+PveAllocator::PveAllocator(VkDevice device, VkPhysicalDevice physicalDevice) : device{device} {
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    nonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+
+    pools.resize(memoryProperties.memoryTypeCount * 2);
+    for (uint32_t i = 0; i < pools.size(); i++) {
+        pools[i].memoryTypeIndex = i / 2;
+    }
+}
+
+PveAllocator::~PveAllocator() {
+    for (auto &pool : pools) {
+        for (auto &block : pool.blocks) {
+            if (block->mapped != nullptr) {
+                vkUnmapMemory(device, block->memory);
+            }
+            vkFreeMemory(device, block->memory, nullptr);
+        }
+    }
+}
+
+PveAllocator::Pool &PveAllocator::getPool(uint32_t memoryTypeIndex, bool linear) {
+    return pools[memoryTypeIndex * 2 + (linear ? 1 : 0)];
+}
+
+PveMemoryBlock *PveAllocator::createBlock(Pool &pool, VkDeviceSize size, bool dedicated) {
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = pool.memoryTypeIndex;
+
+    auto block = std::make_unique<PveMemoryBlock>();
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate device memory block!");
+    }
+
+    // a memory object can only be mapped once, so host visible blocks are mapped up front
+    // and every allocation in them gets a pointer into that mapping
+    if (memoryProperties.memoryTypes[pool.memoryTypeIndex].propertyFlags &
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) !=
+            VK_SUCCESS) {
+            vkFreeMemory(device, block->memory, nullptr);
+            throw std::runtime_error("failed to map device memory block!");
+        }
+    }
+
+    block->size = size;
+    block->memoryTypeIndex = pool.memoryTypeIndex;
+    block->poolIndex = &pool - pools.data();
+    block->dedicated = dedicated;
+    block->ranges.reset(size);
+    pool.blocks.push_back(std::move(block));
+    return pool.blocks.back().get();
+}
+
+void PveAllocator::destroyBlock(Pool &pool, PveMemoryBlock *block) {
+    if (block->mapped != nullptr) {
+        vkUnmapMemory(device, block->memory);
+    }
+    vkFreeMemory(device, block->memory, nullptr);
+    pool.blocks.erase(
+        std::find_if(pool.blocks.begin(), pool.blocks.end(),
+                     [block](const std::unique_ptr<PveMemoryBlock> &b) { return b.get() == block; }));
+}
+
+bool PveAllocator::allocateFromBlock(PveMemoryBlock &block,
+                                     const VkMemoryRequirements &requirements, void *userData,
+                                     PveAllocation &allocation) {
+    VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+    VkDeviceSize size = requirements.size;
+    // keep non coherent allocations on their own atoms so flushing one never touches another
+    if (!(memoryProperties.memoryTypes[block.memoryTypeIndex].propertyFlags &
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        alignment = alignUp(alignment, nonCoherentAtomSize);
+        size = alignUp(size, nonCoherentAtomSize);
+    }
+
+    VkDeviceSize offset, padding;
+    if (!block.ranges.allocate(size, alignment, offset, padding)) {
+        return false;
+    }
+    block.allocations[offset] = {padding, size, requirements.size, alignment, userData};
+    block.bytesUsed += requirements.size;
+    block.bytesWasted += padding + size - requirements.size;
+
+    allocation.memory = block.memory;
+    allocation.offset = offset;
+    allocation.size = requirements.size;
+    allocation.mapped =
+        block.mapped != nullptr ? static_cast<char *>(block.mapped) + offset : nullptr;
+    allocation.memoryTypeIndex = block.memoryTypeIndex;
+    allocation.block = &block;
+    return true;
+}
+
+void PveAllocator::freeFromBlock(PveAllocation &allocation) {
+    PveMemoryBlock &block = *allocation.block;
+    auto record = block.allocations.find(allocation.offset);
+    assert(record != block.allocations.end() && "Freeing an allocation that isn't live");
+
+    block.ranges.free(allocation.offset - record->second.padding,
+                      record->second.padding + record->second.reservedSize);
+    block.bytesUsed -= record->second.requestedSize;
+    block.bytesWasted -=
+        record->second.padding + record->second.reservedSize - record->second.requestedSize;
+    block.allocations.erase(record);
+}
+
+PveAllocation PveAllocator::allocate(const VkMemoryRequirements &requirements,
+                                     uint32_t memoryTypeIndex, bool linear, void *userData) {
+    std::lock_guard<std::mutex> lock{mutex};
+    Pool &pool = getPool(memoryTypeIndex, linear);
+    PveAllocation allocation{};
+
+    // small heaps (e.g. the 256MB host visible device local one) get proportionally smaller blocks
+    uint32_t heapIndex = memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    VkDeviceSize blockSize =
+        std::min(DEFAULT_BLOCK_SIZE, memoryProperties.memoryHeaps[heapIndex].size / 8);
+
+    if (requirements.size > blockSize / 2) {
+        VkDeviceSize size = alignUp(requirements.size, nonCoherentAtomSize);
+        PveMemoryBlock *block = createBlock(pool, size, true);
+        if (!allocateFromBlock(*block, requirements, userData, allocation)) {
+            destroyBlock(pool, block);
+            throw std::runtime_error("failed to sub-allocate dedicated memory block!");
+        }
+        return allocation;
+    }
+
+    for (auto &block : pool.blocks) {
+        if (!block->dedicated && allocateFromBlock(*block, requirements, userData, allocation)) {
+            return allocation;
+        }
+    }
+
+    PveMemoryBlock *block = createBlock(pool, blockSize, false);
+    if (!allocateFromBlock(*block, requirements, userData, allocation)) {
+        throw std::runtime_error("failed to sub-allocate from a new memory block!");
+    }
+    return allocation;
+}
+
+void PveAllocator::free(PveAllocation &allocation) {
+    if (allocation.block == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock{mutex};
+    PveMemoryBlock *block = allocation.block;
+    Pool &pool = pools[block->poolIndex];
+    freeFromBlock(allocation);
+    allocation = PveAllocation{};
+
+    if (block->dedicated && block->allocations.empty()) {
+        destroyBlock(pool, block);
+        return;
+    }
+
+    // keep a single empty block around per pool so alloc/free cycles don't hit the driver
+    if (block->allocations.empty()) {
+        for (auto &other : pool.blocks) {
+            if (other.get() != block && !other->dedicated && other->allocations.empty()) {
+                destroyBlock(pool, block);
+                return;
+            }
+        }
+    }
+}
+
+VkMappedMemoryRange PveAllocator::alignedRange(const PveAllocation &allocation,
+                                               VkDeviceSize size, VkDeviceSize offset) const {
+    if (size == VK_WHOLE_SIZE) {
+        size = allocation.size - offset;
+    }
+    VkDeviceSize start = allocation.offset + offset;
+    VkDeviceSize end = std::min(alignUp(start + size, nonCoherentAtomSize), allocation.block->size);
+    start = start / nonCoherentAtomSize * nonCoherentAtomSize;
+
+    VkMappedMemoryRange mappedRange = {};
+    mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    mappedRange.memory = allocation.memory;
+    mappedRange.offset = start;
+    mappedRange.size = end - start;
+    return mappedRange;
+}
+
+VkResult PveAllocator::flush(const PveAllocation &allocation, VkDeviceSize size,
+                             VkDeviceSize offset) {
+    VkMappedMemoryRange mappedRange = alignedRange(allocation, size, offset);
+    return vkFlushMappedMemoryRanges(device, 1, &mappedRange);
+}
+
+VkResult PveAllocator::invalidate(const PveAllocation &allocation, VkDeviceSize size,
+                                  VkDeviceSize offset) {
+    VkMappedMemoryRange mappedRange = alignedRange(allocation, size, offset);
+    return vkInvalidateMappedMemoryRanges(device, 1, &mappedRange);
+}
+
+std::vector<PveHeapStats> PveAllocator::getHeapStats() {
+    std::lock_guard<std::mutex> lock{mutex};
+    std::vector<PveHeapStats> stats(memoryProperties.memoryHeapCount);
+    for (auto &pool : pools) {
+        uint32_t heapIndex = memoryProperties.memoryTypes[pool.memoryTypeIndex].heapIndex;
+        for (auto &block : pool.blocks) {
+            stats[heapIndex].bytesUsed += block->bytesUsed;
+            stats[heapIndex].bytesWasted += block->bytesWasted;
+            stats[heapIndex].bytesFree += block->ranges.getFreeBytes();
+            stats[heapIndex].blockCount++;
+            stats[heapIndex].allocationCount += static_cast<uint32_t>(block->allocations.size());
+        }
+    }
+    return stats;
+}
+
+VkDeviceSize PveAllocator::defragment(const PveDefragmentationCallback &moveAllocation) {
+    std::lock_guard<std::mutex> lock{mutex};
+    VkDeviceSize bytesMoved = 0;
+
+    for (auto &pool : pools) {
+        std::vector<PveMemoryBlock *> blocks;
+        for (auto &block : pool.blocks) {
+            if (!block->dedicated) {
+                blocks.push_back(block.get());
+            }
+        }
+        // fullest first: allocations only ever move towards the front
+        std::sort(blocks.begin(), blocks.end(), [](PveMemoryBlock *a, PveMemoryBlock *b) {
+            return a->ranges.getFreeBytes() < b->ranges.getFreeBytes();
+        });
+
+        for (size_t source = blocks.size(); source-- > 1;) {
+            std::vector<std::pair<VkDeviceSize, PveMemoryBlock::Record>> movable;
+            for (auto &record : blocks[source]->allocations) {
+                if (record.second.userData != nullptr) {
+                    movable.push_back(record);
+                }
+            }
+
+            for (auto &record : movable) {
+                PveAllocation oldAllocation{};
+                oldAllocation.memory = blocks[source]->memory;
+                oldAllocation.offset = record.first;
+                oldAllocation.size = record.second.requestedSize;
+                oldAllocation.mapped = blocks[source]->mapped != nullptr
+                                           ? static_cast<char *>(blocks[source]->mapped) + record.first
+                                           : nullptr;
+                oldAllocation.memoryTypeIndex = blocks[source]->memoryTypeIndex;
+                oldAllocation.block = blocks[source];
+
+                VkMemoryRequirements requirements{};
+                requirements.size = record.second.requestedSize;
+                requirements.alignment = record.second.alignment;
+                requirements.memoryTypeBits = 1u << pool.memoryTypeIndex;
+
+                for (size_t target = 0; target < source; target++) {
+                    PveAllocation newAllocation{};
+                    if (!allocateFromBlock(*blocks[target], requirements,
+                                           record.second.userData, newAllocation)) {
+                        continue;
+                    }
+                    if (moveAllocation(record.second.userData, oldAllocation, newAllocation)) {
+                        freeFromBlock(oldAllocation);
+                        bytesMoved += record.second.requestedSize;
+                    } else {
+                        freeFromBlock(newAllocation);
+                    }
+                    break;
+                }
+            }
+        }
+        releaseEmptyBlocks(pool);
+    }
+    return bytesMoved;
+}
+
+void PveAllocator::freeEmptyBlocks() {
+    std::lock_guard<std::mutex> lock{mutex};
+    for (auto &pool : pools) {
+        releaseEmptyBlocks(pool);
+    }
+}
+
+void PveAllocator::releaseEmptyBlocks(Pool &pool) {
+    for (size_t i = pool.blocks.size(); i-- > 0;) {
+        if (pool.blocks[i]->allocations.empty()) {
+            destroyBlock(pool, pool.blocks[i].get());
+        }
+    }
+}
+
+}  // namespace pve
@@ -0,0 +1,261 @@
+#include "pve/pve_asset_streamer.hpp"
+
+#include "pve/pve_mesh_optimizer.hpp"
+#include "pve/pve_profiler.hpp"
+#include "pve/pve_swap_chain.hpp"
+
+// std
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+namespace pve {
+
+static constexpr float NO_USERS = std::numeric_limits<float>::infinity();
+
+PveAssetStreamer::PveAssetStreamer(
+    PveDevice &device,
+    PveUploadManager &uploadManager,
+    PveGeometryArena *arena,
+    const Config &config)
+    : pveDevice{device}, uploadManager{uploadManager}, geometryArena{arena}, config{config} {
+    for (uint32_t i = 0; i < config.workerCount; i++) {
+        workers.emplace_back([this] { workerLoop(); });
+    }
+}
+
+PveAssetStreamer::~PveAssetStreamer() {
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+PveAssetHandle PveAssetStreamer::request(const std::string &filepath) {
+    auto it = handles.find(filepath);
+    if (it != handles.end()) {
+        return it->second;
+    }
+
+    std::lock_guard<std::mutex> lock{mutex};
+    PveAssetHandle handle = static_cast<PveAssetHandle>(assets.size());
+    assets.emplace_back();
+    assets.back().filepath = filepath;
+    assets.back().priority = NO_USERS;
+    handles.emplace(filepath, handle);
+    return handle;
+}
+
+void PveAssetStreamer::workerLoop() {
+    while (true) {
+        PveAssetHandle handle;
+        std::string filepath;
+        {
+            std::unique_lock<std::mutex> lock{mutex};
+            workAvailable.wait(lock, [this] { return stopping || !queued.empty(); });
+            if (stopping) {
+                return;
+            }
+            // closest first, the priorities change every frame so there's no point keeping
+            // the queue sorted
+            auto closest = std::min_element(
+                queued.begin(), queued.end(), [this](PveAssetHandle a, PveAssetHandle b) {
+                    return assets[a].priority < assets[b].priority;
+                });
+            handle = *closest;
+            *closest = queued.back();
+            queued.pop_back();
+            assets[handle].state = AssetState::Loading;
+            filepath = assets[handle].filepath;
+        }
+
+        auto builder = std::make_unique<PveModel::Builder>();
+        std::string error;
+        try {
+            builder->loadCachedModel(filepath);
+        } catch (const std::exception &e) {
+            error = e.what();
+        }
+
+        std::lock_guard<std::mutex> lock{mutex};
+        Asset &asset = assets[handle];
+        if (error.empty()) {
+            asset.builder = std::move(builder);
+            asset.state = AssetState::Parsed;
+        } else {
+            asset.error = error;
+            asset.state = AssetState::Failed;
+        }
+        parsed.push_back(handle);
+    }
+}
+
+void PveAssetStreamer::update(PveRegistry &registry, const glm::vec3 &viewerPosition) {
+    PVE_PROFILE_ZONE("PveAssetStreamer::update");
+    for (auto it = retiredModels.begin(); it != retiredModels.end();) {
+        if (it->framesLeft > 0) {
+            it->framesLeft--;
+        }
+        // an upload still writing into the model's buffers has to finish too
+        if (it->framesLeft == 0 && it->model->isReady()) {
+            it = retiredModels.erase(it);
+        } else {
+            it++;
+        }
+    }
+
+    nearestUsers.assign(assets.size(), NO_USERS);
+    registry.view<StreamedModelComponent, TransformComponent>().each(
+        [&](PveEntity, StreamedModelComponent &streamed, TransformComponent &transform) {
+            if (streamed.asset >= nearestUsers.size()) return;
+            float distance = glm::length(glm::vec3(transform.mat4()[3]) - viewerPosition);
+            nearestUsers[streamed.asset] = glm::min(nearestUsers[streamed.asset], distance);
+        });
+
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        for (size_t i = 0; i < assets.size(); i++) {
+            assets[i].priority = nearestUsers[i];
+        }
+        parsedScratch.swap(parsed);
+    }
+    // the workers are done with these, they're only touched by this thread from here on
+    for (PveAssetHandle handle : parsedScratch) {
+        makeResident(handle);
+    }
+    parsedScratch.clear();
+
+    evictableBytes.clear();
+    for (auto &asset : assets) {
+        if (asset.model != nullptr) {
+            evictableBytes.push_back({asset.priority, asset.bytes});
+        }
+    }
+    std::sort(evictableBytes.begin(), evictableBytes.end(),
+              [](const auto &a, const auto &b) { return a.first > b.first; });
+    for (size_t i = 1; i < evictableBytes.size(); i++) {
+        evictableBytes[i].second += evictableBytes[i - 1].second;
+    }
+    // an asset is only worth parsing if evicting everything farther away makes room for it.
+    // Its size is only known once it has been parsed before
+    auto worthLoading = [&](const Asset &asset) {
+        if (asset.bytes == 0) return true;
+        if (asset.bytes > config.memoryBudget) return false;
+        auto farther = std::partition_point(
+            evictableBytes.begin(), evictableBytes.end(),
+            [&](const auto &entry) { return entry.first > asset.priority; });
+        VkDeviceSize freeable =
+            farther == evictableBytes.begin() ? 0 : std::prev(farther)->second;
+        return fitsBudget(residentBytes, freeable, asset.bytes, config.memoryBudget);
+    };
+
+    bool requested = false;
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        // requests nobody needs anymore are dropped before a worker gets to them
+        queued.erase(std::remove_if(queued.begin(), queued.end(),
+                                    [this](PveAssetHandle handle) {
+                                        if (assets[handle].priority != NO_USERS) return false;
+                                        assets[handle].state = AssetState::Unloaded;
+                                        return true;
+                                    }),
+                     queued.end());
+        for (PveAssetHandle handle = 0; handle < assets.size(); handle++) {
+            Asset &asset = assets[handle];
+            if (asset.state != AssetState::Unloaded || asset.priority == NO_USERS ||
+                !worthLoading(asset)) {
+                continue;
+            }
+            asset.state = AssetState::Queued;
+            queued.push_back(handle);
+            requested = true;
+        }
+    }
+    if (requested) {
+        workAvailable.notify_all();
+    }
+
+    registry.view<StreamedModelComponent, ModelComponent>().each(
+        [&](PveEntity, StreamedModelComponent &streamed, ModelComponent &modelComponent) {
+            const std::shared_ptr<PveModel> &model =
+                streamed.asset < assets.size() && assets[streamed.asset].model != nullptr
+                    ? assets[streamed.asset].model
+                    : placeholder;
+            if (modelComponent.model != model) {
+                modelComponent.model = model;
+            }
+        });
+}
+
+void PveAssetStreamer::makeResident(PveAssetHandle handle) {
+    Asset &asset = assets[handle];
+    if (asset.state == AssetState::Failed) {
+        // failed assets are never requested again, so this is only reported once
+        std::cerr << "failed to stream " << asset.filepath << ": " << asset.error << "\n";
+        return;
+    }
+
+    std::unique_ptr<PveModel::Builder> builder = std::move(asset.builder);
+    // the most the model can take. The geometry arena keeps 32 bit indices, only a model with
+    // buffers of its own gets 16 bit ones when its vertices allow. Which one it gets is only
+    // known once it exists, so its bytes are taken from it then and never grow
+    uint32_t vertexCount = static_cast<uint32_t>(builder->packedVertices.size());
+    VkDeviceSize indexSize = geometryArena == nullptr && PveMeshOptimizer::fitsUint16(vertexCount)
+                                 ? sizeof(uint16_t)
+                                 : sizeof(uint32_t);
+    asset.bytes = sizeof(PveModel::GpuVertex) * static_cast<VkDeviceSize>(vertexCount) +
+                  indexSize * builder->indices.size();
+    // dropped if it isn't needed anymore or doesn't fit, it's parsed again when it does
+    if (asset.priority == NO_USERS || !makeRoom(asset.bytes, asset.priority)) {
+        asset.state = AssetState::Unloaded;
+        return;
+    }
+
+    asset.model = std::make_shared<PveModel>(pveDevice, *builder, geometryArena, &uploadManager);
+    asset.bytes = asset.model->getGeometryBytes();
+    asset.state = AssetState::Resident;
+    residentBytes += asset.bytes;
+    residentCount++;
+}
+
+bool PveAssetStreamer::makeRoom(VkDeviceSize bytes, float priority) {
+    // check first, so nothing is evicted for an asset that won't fit anyway
+    VkDeviceSize freeable = 0;
+    for (auto &asset : assets) {
+        if (asset.model != nullptr && asset.priority > priority) {
+            freeable += asset.bytes;
+        }
+    }
+    if (!fitsBudget(residentBytes, freeable, bytes, config.memoryBudget)) {
+        return false;
+    }
+
+    while (residentBytes + bytes > config.memoryBudget) {
+        Asset *farthest = nullptr;
+        for (auto &asset : assets) {
+            if (asset.model == nullptr) continue;
+            if (farthest == nullptr || asset.priority > farthest->priority) {
+                farthest = &asset;
+            }
+        }
+        evict(*farthest);
+    }
+    return true;
+}
+
+void PveAssetStreamer::evict(Asset &asset) {
+    // the frames in flight may still draw it
+    retiredModels.push_back({std::move(asset.model), PveSwapChain::MAX_FRAMES_IN_FLIGHT});
+    asset.model = nullptr;
+    asset.state = AssetState::Unloaded;
+    residentBytes -= asset.bytes;
+    residentCount--;
+    evictionCount++;
+}
+
+}  // namespace pve
@@ -35,7 +35,8 @@ PveBuffer::PveBuffer(
     uint32_t instanceCount,
     VkBufferUsageFlags usageFlags,
     VkMemoryPropertyFlags memoryPropertyFlags,
-    VkDeviceSize minOffsetAlignment)
+    VkDeviceSize minOffsetAlignment,
+    bool relocatable)
     : pveDevice{device},
       instanceSize{instanceSize},
       instanceCount{instanceCount},
@@ -43,18 +44,61 @@ PveBuffer::PveBuffer(
       memoryPropertyFlags{memoryPropertyFlags} {
     alignmentSize = getAlignment(instanceSize, minOffsetAlignment);
     bufferSize = alignmentSize * instanceCount;
-    device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer, memory);
+    if (relocatable) {
+        // relocate() copies out of the old buffer
+        this->usageFlags |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    }
+    device.createBuffer(bufferSize, this->usageFlags, memoryPropertyFlags, buffer, allocation,
+                        relocatable ? this : nullptr);
 }
 
 PveBuffer::~PveBuffer() {
     unmap();
     vkDestroyBuffer(pveDevice.device(), buffer, nullptr);
-    vkFreeMemory(pveDevice.device(), memory, nullptr);
+    pveDevice.getAllocator().free(allocation);
+}
+
+/**
+ * Move the buffer to memory the defragmenter picked. Must not call the allocator, it is locked
+ * while this runs
+ *
+ * @param newAllocation Where the contents go, already reserved by the allocator
+ *
+ * @return Whether the buffer moved. The allocator frees the old allocation when it did
+ */
+bool PveBuffer::relocate(const PveAllocation &newAllocation) {
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = bufferSize;
+    bufferInfo.usage = usageFlags;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkBuffer newBuffer;
+    if (vkCreateBuffer(pveDevice.device(), &bufferInfo, nullptr, &newBuffer) != VK_SUCCESS) {
+        return false;
+    }
+    if (vkBindBufferMemory(pveDevice.device(), newBuffer, newAllocation.memory,
+                           newAllocation.offset) != VK_SUCCESS) {
+        vkDestroyBuffer(pveDevice.device(), newBuffer, nullptr);
+        return false;
+    }
+    pveDevice.copyBuffer(buffer, newBuffer, bufferSize);
+
+    vkDestroyBuffer(pveDevice.device(), buffer, nullptr);
+    buffer = newBuffer;
+    allocation = newAllocation;
+    if (mapped) {
+        mapped = allocation.mapped;
+    }
+    return true;
 }
 
 /**
  * Map a memory range of this buffer. If successful, mapped points to the specified buffer range.
  *
+ * @note Host visible memory stays mapped by the allocator, so this only checks that the range lies
+ * inside the allocation and hands out a pointer into it
+ *
  * @param size (Optional) Size of the memory range to map. Pass VK_WHOLE_SIZE to map the complete
  * buffer range.
  * @param offset (Optional) Byte offset from beginning
@@ -62,20 +106,25 @@ PveBuffer::~PveBuffer() {
  * @return VkResult of the buffer mapping call
  */
 VkResult PveBuffer::map(VkDeviceSize size, VkDeviceSize offset) {
-    assert(buffer && memory && "Called map on buffer before create");
-    return vkMapMemory(pveDevice.device(), memory, offset, size, 0, &mapped);
+    assert(buffer && allocation.memory && "Called map on buffer before create");
+    if (allocation.mapped == nullptr) {
+        return VK_ERROR_MEMORY_MAP_FAILED;
+    }
+    if (offset > allocation.size ||
+        (size != VK_WHOLE_SIZE && size > allocation.size - offset)) {
+        return VK_ERROR_MEMORY_MAP_FAILED;
+    }
+    mapped = static_cast<char *>(allocation.mapped) + offset;
+    return VK_SUCCESS;
 }
 
 /**
  * Unmap a mapped memory range
  *
- * @note Does not return a result as vkUnmapMemory can't fail
+ * @note The allocator keeps host visible memory mapped, so this only drops the pointer
  */
 void PveBuffer::unmap() {
-    if (mapped) {
-        vkUnmapMemory(pveDevice.device(), memory);
-        mapped = nullptr;
-    }
+    mapped = nullptr;
 }
 
 /**
@@ -111,12 +160,7 @@ void PveBuffer::writeToBuffer(void *data, VkDeviceSize size, VkDeviceSize offset
  * @return VkResult of the flush call
  */
 VkResult PveBuffer::flush(VkDeviceSize size, VkDeviceSize offset) {
-    VkMappedMemoryRange mappedRange = {};
-    mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    mappedRange.memory = memory;
-    mappedRange.offset = offset;
-    mappedRange.size = size;
-    return vkFlushMappedMemoryRanges(pveDevice.device(), 1, &mappedRange);
+    return pveDevice.getAllocator().flush(allocation, size, offset);
 }
 
 /**
@@ -131,12 +175,7 @@ VkResult PveBuffer::flush(VkDeviceSize size, VkDeviceSize offset) {
  * @return VkResult of the invalidate call
  */
 VkResult PveBuffer::invalidate(VkDeviceSize size, VkDeviceSize offset) {
-    VkMappedMemoryRange mappedRange = {};
-    mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    mappedRange.memory = memory;
-    mappedRange.offset = offset;
-    mappedRange.size = size;
-    return vkInvalidateMappedMemoryRanges(pveDevice.device(), 1, &mappedRange);
+    return pveDevice.getAllocator().invalidate(allocation, size, offset);
 }
 
 /**
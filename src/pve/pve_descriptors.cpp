@@ -1,6 +1,7 @@
 #include "pve/pve_descriptors.hpp"
 
 // std
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
 
@@ -12,7 +13,8 @@ PveDescriptorSetLayout::Builder &PveDescriptorSetLayout::Builder::addBinding(
     uint32_t binding,
     VkDescriptorType descriptorType,
     VkShaderStageFlags stageFlags,
-    uint32_t count) {
+    uint32_t count,
+    VkDescriptorBindingFlags flags) {
     assert(bindings.count(binding) == 0 && "Binding already in use");
     VkDescriptorSetLayoutBinding layoutBinding{};
     layoutBinding.binding = binding;
@@ -20,21 +22,33 @@ PveDescriptorSetLayout::Builder &PveDescriptorSetLayout::Builder::addBinding(
     layoutBinding.descriptorCount = count;
     layoutBinding.stageFlags = stageFlags;
     bindings[binding] = layoutBinding;
+    if (flags != 0) {
+        bindingFlags[binding] = flags;
+    }
     return *this;
 }
 
-std::unique_ptr<PveDescriptorSetLayout> PveDescriptorSetLayout::Builder::build() const {
-    return std::make_unique<PveDescriptorSetLayout>(pveDevice, bindings);
+std::shared_ptr<PveDescriptorSetLayout> PveDescriptorSetLayout::Builder::build() const {
+    return pveDevice.getDescriptorSetLayoutCache().getLayout(bindings, bindingFlags);
 }
 
 // *************** Descriptor Set Layout *********************
 
 PveDescriptorSetLayout::PveDescriptorSetLayout(
-    PveDevice &pveDevice, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings)
+    PveDevice &pveDevice,
+    std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings,
+    const std::unordered_map<uint32_t, VkDescriptorBindingFlags> &bindingFlags)
     : pveDevice{pveDevice}, bindings{bindings} {
     std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
+    // in the same order as the bindings
+    std::vector<VkDescriptorBindingFlags> setLayoutBindingFlags{};
+    bool updateAfterBind = false;
     for (auto kv : bindings) {
         setLayoutBindings.push_back(kv.second);
+        auto flags = bindingFlags.find(kv.first);
+        setLayoutBindingFlags.push_back(flags != bindingFlags.end() ? flags->second : 0);
+        updateAfterBind |=
+            (setLayoutBindingFlags.back() & VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT) != 0;
     }
 
     VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo{};
@@ -42,6 +56,17 @@ PveDescriptorSetLayout::PveDescriptorSetLayout(
     descriptorSetLayoutInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
     descriptorSetLayoutInfo.pBindings = setLayoutBindings.data();
 
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+    if (!bindingFlags.empty()) {
+        bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        bindingFlagsInfo.bindingCount = static_cast<uint32_t>(setLayoutBindingFlags.size());
+        bindingFlagsInfo.pBindingFlags = setLayoutBindingFlags.data();
+        descriptorSetLayoutInfo.pNext = &bindingFlagsInfo;
+    }
+    if (updateAfterBind) {
+        descriptorSetLayoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    }
+
     if (vkCreateDescriptorSetLayout(
             pveDevice.device(),
             &descriptorSetLayoutInfo,
@@ -55,6 +80,75 @@ PveDescriptorSetLayout::~PveDescriptorSetLayout() {
     vkDestroyDescriptorSetLayout(pveDevice.device(), descriptorSetLayout, nullptr);
 }
 
+// *************** Descriptor Set Layout Cache *********************
+
+bool PveDescriptorSetLayoutCache::Key::operator==(const Key &other) const {
+    if (bindings.size() != other.bindings.size() || flags != other.flags) {
+        return false;
+    }
+    for (size_t i = 0; i < bindings.size(); i++) {
+        const VkDescriptorSetLayoutBinding &a = bindings[i];
+        const VkDescriptorSetLayoutBinding &b = other.bindings[i];
+        if (a.binding != b.binding || a.descriptorType != b.descriptorType ||
+            a.descriptorCount != b.descriptorCount || a.stageFlags != b.stageFlags) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// FNV-1a over every field that tells two layouts apart
+size_t PveDescriptorSetLayoutCache::KeyHash::operator()(const Key &key) const {
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&](uint64_t value) {
+        hash ^= value;
+        hash *= 1099511628211ull;
+    };
+    for (size_t i = 0; i < key.bindings.size(); i++) {
+        mix(key.bindings[i].binding);
+        mix(static_cast<uint64_t>(key.bindings[i].descriptorType));
+        mix(key.bindings[i].descriptorCount);
+        mix(key.bindings[i].stageFlags);
+        mix(key.flags[i]);
+    }
+    return static_cast<size_t>(hash);
+}
+
+std::shared_ptr<PveDescriptorSetLayout> PveDescriptorSetLayoutCache::getLayout(
+    const std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> &bindings,
+    const std::unordered_map<uint32_t, VkDescriptorBindingFlags> &bindingFlags) {
+    Key key;
+    for (auto &kv : bindings) {
+        // immutable samplers would have to be part of the key
+        assert(kv.second.pImmutableSamplers == nullptr && "Immutable samplers aren't cached");
+        key.bindings.push_back(kv.second);
+    }
+    std::sort(key.bindings.begin(), key.bindings.end(),
+              [](const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b) {
+                  return a.binding < b.binding;
+              });
+    for (auto &binding : key.bindings) {
+        auto flags = bindingFlags.find(binding.binding);
+        key.flags.push_back(flags != bindingFlags.end() ? flags->second : 0);
+    }
+
+    // creating a layout is cheap enough to do under the lock
+    std::lock_guard<std::mutex> lock{mutex};
+    std::weak_ptr<PveDescriptorSetLayout> &entry = layouts[key];
+    if (auto layout = entry.lock()) {
+        sharedCount++;
+        return layout;
+    }
+    auto layout = std::make_shared<PveDescriptorSetLayout>(pveDevice, bindings, bindingFlags);
+    entry = layout;
+    createdCount++;
+    // layouts are rarely created, so this is where the ones nobody uses anymore are forgotten
+    for (auto it = layouts.begin(); it != layouts.end();) {
+        it = it->second.expired() ? layouts.erase(it) : std::next(it);
+    }
+    return layout;
+}
+
 // *************** Descriptor Pool Builder *********************
 
 PveDescriptorPool::Builder &PveDescriptorPool::Builder::addPoolSize(
@@ -110,8 +204,7 @@ bool PveDescriptorPool::allocateDescriptor(
     allocInfo.pSetLayouts = &descriptorSetLayout;
     allocInfo.descriptorSetCount = 1;
 
-    // Might want to create a "DescriptorPoolManager" class that handles this case, and builds
-    // a new pool whenever an old pool fills up. But this is beyond our current scope
+    // a pool that can fill up is what PveDescriptorAllocator is for
     if (vkAllocateDescriptorSets(pveDevice.device(), &allocInfo, &descriptor) != VK_SUCCESS) {
         return false;
     }
@@ -130,10 +223,121 @@ void PveDescriptorPool::resetPool() {
     vkResetDescriptorPool(pveDevice.device(), descriptorPool, 0);
 }
 
+// *************** Descriptor Allocator *********************
+
+std::vector<PveDescriptorAllocator::PoolSizeRatio> PveDescriptorAllocator::defaultRatios() {
+    return {
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.f},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.f},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4.f},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.f},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.f},
+    };
+}
+
+PveDescriptorAllocator::PveDescriptorAllocator(
+    PveDevice &pveDevice,
+    uint32_t initialSetsPerPool,
+    const std::vector<PoolSizeRatio> &ratios,
+    VkDescriptorPoolCreateFlags poolFlags)
+    : pveDevice{pveDevice},
+      ratios{ratios},
+      poolFlags{poolFlags},
+      setsPerPool{std::max(initialSetsPerPool, 1u)} {}
+
+PveDescriptorAllocator::~PveDescriptorAllocator() {
+    vkDestroyDescriptorPool(pveDevice.device(), currentPool, nullptr);
+    for (VkDescriptorPool pool : fullPools) {
+        vkDestroyDescriptorPool(pveDevice.device(), pool, nullptr);
+    }
+    for (VkDescriptorPool pool : readyPools) {
+        vkDestroyDescriptorPool(pveDevice.device(), pool, nullptr);
+    }
+}
+
+VkDescriptorPool PveDescriptorAllocator::nextPool() {
+    if (!readyPools.empty()) {
+        VkDescriptorPool pool = readyPools.back();
+        readyPools.pop_back();
+        return pool;
+    }
+
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    for (auto &ratio : ratios) {
+        uint32_t count = static_cast<uint32_t>(ratio.ratio * static_cast<float>(setsPerPool));
+        poolSizes.push_back({ratio.descriptorType, std::max(count, 1u)});
+    }
+    VkDescriptorPoolCreateInfo descriptorPoolInfo{};
+    descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    descriptorPoolInfo.pPoolSizes = poolSizes.data();
+    descriptorPoolInfo.maxSets = setsPerPool;
+    descriptorPoolInfo.flags = poolFlags;
+
+    VkDescriptorPool pool;
+    if (vkCreateDescriptorPool(pveDevice.device(), &descriptorPoolInfo, nullptr, &pool) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+    // a scene that filled this pool will likely fill a bigger one too
+    setsPerPool = std::min(setsPerPool * 2, MAX_SETS_PER_POOL);
+    return pool;
+}
+
+VkDescriptorSet PveDescriptorAllocator::allocate(VkDescriptorSetLayout descriptorSetLayout) {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (currentPool == VK_NULL_HANDLE) {
+        currentPool = nextPool();
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = currentPool;
+    allocInfo.pSetLayouts = &descriptorSetLayout;
+    allocInfo.descriptorSetCount = 1;
+
+    VkDescriptorSet descriptor;
+    VkResult result = vkAllocateDescriptorSets(pveDevice.device(), &allocInfo, &descriptor);
+    if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+        // the current pool is done, and a fresh one is tried once
+        fullPools.push_back(currentPool);
+        currentPool = nextPool();
+        allocInfo.descriptorPool = currentPool;
+        result = vkAllocateDescriptorSets(pveDevice.device(), &allocInfo, &descriptor);
+    }
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor set!");
+    }
+    return descriptor;
+}
+
+void PveDescriptorAllocator::reset() {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (currentPool != VK_NULL_HANDLE) {
+        fullPools.push_back(currentPool);
+        currentPool = VK_NULL_HANDLE;
+    }
+    for (VkDescriptorPool pool : fullPools) {
+        vkResetDescriptorPool(pveDevice.device(), pool, 0);
+        readyPools.push_back(pool);
+    }
+    fullPools.clear();
+}
+
+uint32_t PveDescriptorAllocator::getPoolCount() const {
+    std::lock_guard<std::mutex> lock{mutex};
+    return static_cast<uint32_t>(fullPools.size() + readyPools.size()) +
+           (currentPool != VK_NULL_HANDLE ? 1 : 0);
+}
+
 // *************** Descriptor Writer *********************
 
 PveDescriptorWriter::PveDescriptorWriter(PveDescriptorSetLayout &setLayout, PveDescriptorPool &pool)
-    : setLayout{setLayout}, pool{pool} {}
+    : setLayout{setLayout}, pool{&pool} {}
+
+PveDescriptorWriter::PveDescriptorWriter(
+    PveDescriptorSetLayout &setLayout, PveDescriptorAllocator &allocator)
+    : setLayout{setLayout}, allocator{&allocator} {}
 
 PveDescriptorWriter &PveDescriptorWriter::writeBuffer(
     uint32_t binding, VkDescriptorBufferInfo *bufferInfo) {
@@ -157,19 +361,20 @@ PveDescriptorWriter &PveDescriptorWriter::writeBuffer(
 }
 
 PveDescriptorWriter &PveDescriptorWriter::writeImage(
-    uint32_t binding, VkDescriptorImageInfo *imageInfo) {
+    uint32_t binding, VkDescriptorImageInfo *imageInfo, uint32_t arrayElement) {
     assert(setLayout.bindings.count(binding) == 1 && "Layout does not contain specified binding");
 
     auto &bindingDescription = setLayout.bindings[binding];
 
     assert(
-        bindingDescription.descriptorCount == 1 &&
-        "Binding single descriptor info, but binding expects multiple");
+        arrayElement < bindingDescription.descriptorCount &&
+        "Array element out of range for binding");
 
     VkWriteDescriptorSet write{};
     write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     write.descriptorType = bindingDescription.descriptorType;
     write.dstBinding = binding;
+    write.dstArrayElement = arrayElement;
     write.pImageInfo = imageInfo;
     write.descriptorCount = 1;
 
@@ -178,8 +383,9 @@ PveDescriptorWriter &PveDescriptorWriter::writeImage(
 }
 
 bool PveDescriptorWriter::build(VkDescriptorSet &set) {
-    bool success = pool.allocateDescriptor(setLayout.getDescriptorSetLayout(), set);
-    if (!success) {
+    if (allocator != nullptr) {
+        set = allocator->allocate(setLayout.getDescriptorSetLayout());
+    } else if (!pool->allocateDescriptor(setLayout.getDescriptorSetLayout(), set)) {
         return false;
     }
     overwrite(set);
@@ -190,7 +396,7 @@ void PveDescriptorWriter::overwrite(VkDescriptorSet &set) {
     for (auto &write : writes) {
         write.dstSet = set;
     }
-    vkUpdateDescriptorSets(pool.pveDevice.device(), writes.size(), writes.data(), 0, nullptr);
+    vkUpdateDescriptorSets(setLayout.pveDevice.device(), writes.size(), writes.data(), 0, nullptr);
 }
 
 }  // namespace pve
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "pve/pve_device.hpp"
 
+#include "pve/pve_buffer.hpp"
+#include "pve/pve_descriptors.hpp"
+
 // std headers
 #include <cstring>
 #include <iostream>
@@ -46,8 +49,43 @@ void DestroyDebugUtilsMessengerEXT(
     }
 }
 
+// what the bindless material textures need from VK_EXT_descriptor_indexing: indexing the
+// texture array with a per object index, writing new slots while frames using the array are
+// in flight, and leaving the unused slots empty
+static VkPhysicalDeviceDescriptorIndexingFeatures bindlessFeatures() {
+    VkPhysicalDeviceDescriptorIndexingFeatures features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    features.descriptorBindingPartiallyBound = VK_TRUE;
+    return features;
+}
+
+static bool supportsBindless(VkPhysicalDevice device) {
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(device, &deviceProperties);
+    if (deviceProperties.apiVersion < VK_API_VERSION_1_1) {
+        return false;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{};
+    indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &indexingFeatures;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+    return indexingFeatures.shaderSampledImageArrayNonUniformIndexing &&
+           indexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+           indexingFeatures.descriptorBindingUpdateUnusedWhilePending &&
+           indexingFeatures.descriptorBindingPartiallyBound;
+}
+
 // class member functions
 PveDevice::PveDevice(PveWindow &window) : window{window} {
+    if (!window.isHeadless()) {
+        deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
     // initialize the Vulkan library and create the connection between my application and Vulkan
     createInstance();
     // set up validation layers. The Vulkan API does extremely little error checking during operations
@@ -55,6 +93,7 @@ PveDevice::PveDevice(PveWindow &window) : window{window} {
     // when debugging, enable validation layers to check for errors and then disable for release
     setupDebugMessenger();
     // the surface relies in GLFW. This is the connection between the window and Vulkan's ability to display results
+    // a headless device skips it and renders into offscreen images only
     createSurface();
     // pick the graphics device capable of working with the Vulkan API
     pickPhysicalDevice();
@@ -62,9 +101,18 @@ PveDevice::PveDevice(PveWindow &window) : window{window} {
     createLogicalDevice();
     // command pool that will help with command buffer allocation
     createCommandPool();
+    // every buffer and image is sub-allocated from large per memory type blocks
+    createAllocator();
+    // pipelines and shader modules are shared and compiled through a cache kept on disk
+    createPipelineRegistry();
+    // systems asking for the same descriptor bindings share one layout
+    createDescriptorSetLayoutCache();
 }
 
 PveDevice::~PveDevice() {
+    descriptorSetLayoutCache.reset();
+    pipelineRegistry.reset();
+    allocator.reset();
     vkDestroyCommandPool(device_, commandPool, nullptr);
     vkDestroyDevice(device_, nullptr);
 
@@ -72,7 +120,9 @@ PveDevice::~PveDevice() {
         DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
     }
 
-    vkDestroySurfaceKHR(instance, surface_, nullptr);
+    if (surface_ != VK_NULL_HANDLE) {
+        vkDestroySurfaceKHR(instance, surface_, nullptr);
+    }
     vkDestroyInstance(instance, nullptr);
 }
 
@@ -87,7 +137,8 @@ void PveDevice::createInstance() {
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    // descriptor indexing needs vkGetPhysicalDeviceFeatures2 and maintenance3, both core in 1.1
+    appInfo.apiVersion = VK_API_VERSION_1_1;
 
     VkInstanceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -145,7 +196,8 @@ void PveDevice::createLogicalDevice() {
     QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily,
+                                              indices.transferFamily};
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -157,8 +209,37 @@ void PveDevice::createLogicalDevice() {
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
     VkPhysicalDeviceFeatures deviceFeatures = {};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    // gpu driven rendering issues all its draws from a single indirect buffer when these exist
+    deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+    // cooked textures fall back to uncompressed texels without it
+    deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+    enabledFeatures = deviceFeatures;
+
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(
+        physicalDevice,
+        nullptr,
+        &extensionCount,
+        availableExtensions.data());
+
+    std::vector<const char *> extensions = deviceExtensions;
+    for (const char *optionalExtension : optionalDeviceExtensions) {
+        for (const auto &extension : availableExtensions) {
+            if (strcmp(extension.extensionName, optionalExtension) == 0) {
+                extensions.push_back(optionalExtension);
+                break;
+            }
+        }
+    }
+    enabledExtensions = std::set<std::string>(extensions.begin(), extensions.end());
 
     VkDeviceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -167,8 +248,10 @@ void PveDevice::createLogicalDevice() {
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
     createInfo.pEnabledFeatures = &deviceFeatures;
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures = bindlessFeatures();
+    createInfo.pNext = &indexingFeatures;
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
 
     // might not really be necessary anymore because device specific validation layers
     // have been deprecated
@@ -185,6 +268,7 @@ void PveDevice::createLogicalDevice() {
 
     vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
     vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+    vkGetDeviceQueue(device_, indices.transferFamily, 0, &transferQueue_);
 }
 
 void PveDevice::createCommandPool() {
@@ -201,15 +285,34 @@ void PveDevice::createCommandPool() {
     }
 }
 
-void PveDevice::createSurface() { window.createWindowSurface(instance, &surface_); }
+void PveDevice::createAllocator() {
+    allocator = std::make_unique<PveAllocator>(device_, physicalDevice);
+}
+
+void PveDevice::createPipelineRegistry() {
+    // next to the compiled shaders, so `make clean` drops it along with them
+    pipelineRegistry =
+        std::make_unique<PvePipelineRegistry>(*this, "shaders/compiled/pipelines.pvecache");
+}
+
+void PveDevice::createDescriptorSetLayoutCache() {
+    descriptorSetLayoutCache = std::make_unique<PveDescriptorSetLayoutCache>(*this);
+}
+
+void PveDevice::createSurface() {
+    if (window.isHeadless()) {
+        return;
+    }
+    window.createWindowSurface(instance, &surface_);
+}
 
 bool PveDevice::isDeviceSuitable(VkPhysicalDevice device) {
     QueueFamilyIndices indices = findQueueFamilies(device);
 
     bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-    bool swapChainAdequate = false;
-    if (extensionsSupported) {
+    bool swapChainAdequate = window.isHeadless();
+    if (extensionsSupported && !window.isHeadless()) {
         SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
@@ -218,7 +321,7 @@ bool PveDevice::isDeviceSuitable(VkPhysicalDevice device) {
     vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
     return indices.isComplete() && extensionsSupported && swapChainAdequate &&
-           supportedFeatures.samplerAnisotropy;
+           supportedFeatures.samplerAnisotropy && supportsBindless(device);
 }
 
 void PveDevice::populateDebugMessengerCreateInfo(
@@ -270,11 +373,13 @@ bool PveDevice::checkValidationLayerSupport() {
 }
 
 std::vector<const char *> PveDevice::getRequiredExtensions() {
-    uint32_t glfwExtensionCount = 0;
-    const char **glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-    std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    std::vector<const char *> extensions;
+    if (!window.isHeadless()) {
+        uint32_t glfwExtensionCount = 0;
+        const char **glfwExtensions;
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     if (enableValidationLayers) {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -341,8 +446,11 @@ QueueFamilyIndices PveDevice::findQueueFamilies(VkPhysicalDevice device) {
             indices.graphicsFamily = i;
             indices.graphicsFamilyHasValue = true;
         }
-        VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+        // without a surface nothing is presented, the graphics family stands in for present
+        VkBool32 presentSupport = window.isHeadless() && indices.graphicsFamilyHasValue;
+        if (!window.isHeadless()) {
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+        }
         if (queueFamily.queueCount > 0 && presentSupport) {
             indices.presentFamily = i;
             indices.presentFamilyHasValue = true;
@@ -354,6 +462,18 @@ QueueFamilyIndices PveDevice::findQueueFamilies(VkPhysicalDevice device) {
         i++;
     }
 
+    // a family that can only copy is usually backed by dedicated DMA engines, so uploads on it
+    // run alongside the graphics work instead of queueing behind it
+    indices.transferFamily = indices.graphicsFamily;
+    for (uint32_t family = 0; family < queueFamilyCount; family++) {
+        VkQueueFlags flags = queueFamilies[family].queueFlags;
+        if (queueFamilies[family].queueCount > 0 && (flags & VK_QUEUE_TRANSFER_BIT) &&
+            !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            indices.transferFamily = family;
+            break;
+        }
+    }
+
     return indices;
 }
 
@@ -419,7 +539,8 @@ void PveDevice::createBuffer(
     VkBufferUsageFlags usage,
     VkMemoryPropertyFlags properties,
     VkBuffer &buffer,
-    VkDeviceMemory &bufferMemory) {
+    PveAllocation &bufferAllocation,
+    PveBuffer *relocationHandle) {
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size = size;
@@ -433,16 +554,20 @@ void PveDevice::createBuffer(
     VkMemoryRequirements memRequirements;
     vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+    bufferAllocation = allocator->allocate(
+        memRequirements, findMemoryType(memRequirements.memoryTypeBits, properties), true,
+        relocationHandle);
 
-    if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate vertex buffer memory!");
-    }
+    vkBindBufferMemory(device_, buffer, bufferAllocation.memory, bufferAllocation.offset);
+}
 
-    vkBindBufferMemory(device_, buffer, bufferMemory, 0);
+VkDeviceSize PveDevice::defragmentMemory() {
+    // nothing may be using the buffers while they move
+    vkDeviceWaitIdle(device_);
+    return allocator->defragment(
+        [](void *userData, const PveAllocation &, const PveAllocation &newAllocation) {
+            return static_cast<PveBuffer *>(userData)->relocate(newAllocation);
+        });
 }
 
 VkCommandBuffer PveDevice::beginSingleTimeCommands() {
@@ -477,12 +602,17 @@ void PveDevice::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
     vkFreeCommandBuffers(device_, commandPool, 1, &commandBuffer);
 }
 
-void PveDevice::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+void PveDevice::copyBuffer(
+    VkBuffer srcBuffer,
+    VkBuffer dstBuffer,
+    VkDeviceSize size,
+    VkDeviceSize srcOffset,
+    VkDeviceSize dstOffset) {
     VkCommandBuffer commandBuffer = beginSingleTimeCommands();
 
     VkBufferCopy copyRegion{};
-    copyRegion.srcOffset = 0;  // Optional
-    copyRegion.dstOffset = 0;  // Optional
+    copyRegion.srcOffset = srcOffset;  // Optional
+    copyRegion.dstOffset = dstOffset;  // Optional
     copyRegion.size = size;
     vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
@@ -520,7 +650,7 @@ void PveDevice::createImageWithInfo(
     const VkImageCreateInfo &imageInfo,
     VkMemoryPropertyFlags properties,
     VkImage &image,
-    VkDeviceMemory &imageMemory) {
+    PveAllocation &imageAllocation) {
     if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS) {
         throw std::runtime_error("failed to create image!");
     }
@@ -528,16 +658,12 @@ void PveDevice::createImageWithInfo(
     VkMemoryRequirements memRequirements;
     vkGetImageMemoryRequirements(device_, image, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-    if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate image memory!");
-    }
+    imageAllocation = allocator->allocate(
+        memRequirements, findMemoryType(memRequirements.memoryTypeBits, properties),
+        imageInfo.tiling == VK_IMAGE_TILING_LINEAR);
 
-    if (vkBindImageMemory(device_, image, imageMemory, 0) != VK_SUCCESS) {
+    if (vkBindImageMemory(device_, image, imageAllocation.memory, imageAllocation.offset) !=
+        VK_SUCCESS) {
         throw std::runtime_error("failed to bind image memory!");
     }
 }
@@ -0,0 +1,57 @@
+#include "pve/pve_frame_allocator.hpp"
+
+#include "pve/pve_swap_chain.hpp"
+
+// std
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace pve {
+
+PveFrameAllocator::PveFrameAllocator(PveDevice &device, VkDeviceSize capacity)
+    : pveDevice{device} {
+    const VkPhysicalDeviceLimits &limits = pveDevice.properties.limits;
+    uniformAlignment = std::max<VkDeviceSize>(limits.minUniformBufferOffsetAlignment, 1);
+    storageAlignment = std::max<VkDeviceSize>(limits.minStorageBufferOffsetAlignment, 1);
+
+    // every frame's region starts at an offset any allocation could be placed at
+    VkDeviceSize regionAlignment = std::max(uniformAlignment, storageAlignment);
+    frameCapacity = (capacity + regionAlignment - 1) / regionAlignment * regionAlignment;
+    if (frameCapacity * PveSwapChain::MAX_FRAMES_IN_FLIGHT >
+        std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("Frame allocator capacity doesn't fit dynamic offsets");
+    }
+
+    buffer = std::make_unique<PveBuffer>(
+        pveDevice, frameCapacity, PveSwapChain::MAX_FRAMES_IN_FLIGHT,
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if (buffer->map() != VK_SUCCESS) {
+        throw std::runtime_error("Failed to map frame allocator buffer");
+    }
+    mapped = static_cast<char *>(buffer->getMappedMemory());
+}
+
+void PveFrameAllocator::beginFrame(int frameIndex) {
+    frameStart = frameCapacity * static_cast<VkDeviceSize>(frameIndex);
+    head.store(frameStart, std::memory_order_relaxed);
+}
+
+PveFrameAllocator::Allocation PveFrameAllocator::allocate(VkDeviceSize size,
+                                                          VkDeviceSize alignment) {
+    VkDeviceSize frameEnd = frameStart + frameCapacity;
+    VkDeviceSize offset;
+    VkDeviceSize current = head.load(std::memory_order_relaxed);
+    do {
+        offset = (current + alignment - 1) / alignment * alignment;
+        if (offset + size > frameEnd) {
+            throw std::runtime_error("Frame allocator ran out of space for this frame");
+        }
+    } while (!head.compare_exchange_weak(current, offset + size, std::memory_order_relaxed));
+
+    return {mapped + offset, static_cast<uint32_t>(offset), static_cast<uint32_t>(size)};
+}
+
+}  // namespace pve
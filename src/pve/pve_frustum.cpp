@@ -0,0 +1,117 @@
+#include "pve/pve_frustum.hpp"
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+namespace pve {
+
+PveFrustum PveFrustum::fromMatrix(const glm::mat4 &projectionView) {
+    // glm is column major, m[column][row]
+    auto row = [&](int i) {
+        return glm::vec4{projectionView[0][i], projectionView[1][i], projectionView[2][i],
+                         projectionView[3][i]};
+    };
+
+    PveFrustum frustum{};
+    frustum.planes[LEFT] = row(3) + row(0);
+    frustum.planes[RIGHT] = row(3) - row(0);
+    frustum.planes[BOTTOM] = row(3) + row(1);
+    frustum.planes[TOP] = row(3) - row(1);
+    // clip space depth goes from 0 to w, not -w to w
+    frustum.planes[NEAR] = row(2);
+    frustum.planes[FAR] = row(3) - row(2);
+
+    // normalized so plane distances are in world units and can be compared to a radius
+    for (auto &plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+PveFrustum PveFrustum::fromCamera(const PveCamera &camera) {
+    return fromMatrix(camera.getProjection() * camera.getView());
+}
+
+bool PveFrustum::intersectsSphere(const glm::vec3 &center, float radius) const {
+    for (const auto &plane : planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PveFrustumCuller::clear() {
+    centersX.clear();
+    centersY.clear();
+    centersZ.clear();
+    radii.clear();
+}
+
+uint32_t PveFrustumCuller::addSphere(const glm::vec3 &center, float radius) {
+    centersX.push_back(center.x);
+    centersY.push_back(center.y);
+    centersZ.push_back(center.z);
+    radii.push_back(radius);
+    return static_cast<uint32_t>(radii.size() - 1);
+}
+
+PveCullingStats PveFrustumCuller::cull(const PveFrustum &frustum) {
+    const uint32_t count = getSphereCount();
+    visible.resize(count);
+    uint32_t first = 0;
+
+#ifdef __SSE__
+    // every plane component splatted across a register once for the whole batch
+    __m128 planeX[PveFrustum::PLANE_COUNT];
+    __m128 planeY[PveFrustum::PLANE_COUNT];
+    __m128 planeZ[PveFrustum::PLANE_COUNT];
+    __m128 planeW[PveFrustum::PLANE_COUNT];
+    for (int p = 0; p < PveFrustum::PLANE_COUNT; p++) {
+        planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+        planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+        planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+        planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+    }
+    const __m128 zero = _mm_setzero_ps();
+
+    for (; first + 4 <= count; first += 4) {
+        __m128 x = _mm_loadu_ps(&centersX[first]);
+        __m128 y = _mm_loadu_ps(&centersY[first]);
+        __m128 z = _mm_loadu_ps(&centersZ[first]);
+        __m128 negativeRadius = _mm_sub_ps(zero, _mm_loadu_ps(&radii[first]));
+
+        // a lane stays set while its sphere is not fully behind any plane
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for (int p = 0; p < PveFrustum::PLANE_COUNT; p++) {
+            __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+                _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        visible[first] = mask & 1;
+        visible[first + 1] = (mask >> 1) & 1;
+        visible[first + 2] = (mask >> 2) & 1;
+        visible[first + 3] = (mask >> 3) & 1;
+    }
+#endif
+
+    // whatever doesn't fill a whole register, or everything without SSE
+    for (uint32_t i = first; i < count; i++) {
+        visible[i] = frustum.intersectsSphere({centersX[i], centersY[i], centersZ[i]}, radii[i])
+                         ? 1
+                         : 0;
+    }
+
+    PveCullingStats stats{};
+    for (uint32_t i = 0; i < count; i++) {
+        stats.visibleCount += visible[i];
+    }
+    stats.culledCount = count - stats.visibleCount;
+    return stats;
+}
+
+}  // namespace pve
@@ -2,14 +2,37 @@
 
 namespace pve {
 
-glm::mat4 TransformComponent::mat4() {
-    const float c3 = glm::cos(rotation.z);
-    const float s3 = glm::sin(rotation.z);
-    const float c2 = glm::cos(rotation.x);
-    const float s2 = glm::sin(rotation.x);
-    const float c1 = glm::cos(rotation.y);
-    const float s1 = glm::sin(rotation.y);
-    return glm::mat4{
+const glm::mat4 &TransformComponent::mat4() {
+    // a parented world matrix is only as fresh as the last scene graph propagation
+    return parented ? worldMatrix : localMatrix();
+}
+
+const glm::mat3 &TransformComponent::normalMatrix() {
+    return parented ? worldNormalMatrix : localNormalMatrix();
+}
+
+const glm::mat4 &TransformComponent::localMatrix() {
+    if (dirty) {
+        updateMatrices(glm::sin(rotation), glm::cos(rotation));
+    }
+    return cachedMatrix;
+}
+
+const glm::mat3 &TransformComponent::localNormalMatrix() {
+    if (dirty) {
+        updateMatrices(glm::sin(rotation), glm::cos(rotation));
+    }
+    return cachedNormalMatrix;
+}
+
+void TransformComponent::updateMatrices(const glm::vec3 &sines, const glm::vec3 &cosines) {
+    const float c3 = cosines.z;
+    const float s3 = sines.z;
+    const float c2 = cosines.x;
+    const float s2 = sines.x;
+    const float c1 = cosines.y;
+    const float s1 = sines.y;
+    cachedMatrix = glm::mat4{
         {
             scale.x * (c1 * c3 + s1 * s2 * s3),
             scale.x * (c2 * s3),
@@ -29,17 +52,9 @@ glm::mat4 TransformComponent::mat4() {
             0.0f,
         },
         {translation.x, translation.y, translation.z, 1.0f}};
-}
 
-glm::mat3 TransformComponent::normalMatrix() {
-    const float c3 = glm::cos(rotation.z);
-    const float s3 = glm::sin(rotation.z);
-    const float c2 = glm::cos(rotation.x);
-    const float s2 = glm::sin(rotation.x);
-    const float c1 = glm::cos(rotation.y);
-    const float s1 = glm::sin(rotation.y);
     const glm::vec3 invScale = 1.0f / scale;
-    return glm::mat3{
+    cachedNormalMatrix = glm::mat3{
         {
             invScale.x * (c1 * c3 + s1 * s2 * s3),
             invScale.x * (c2 * s3),
@@ -56,16 +71,18 @@ glm::mat3 TransformComponent::normalMatrix() {
             invScale.z * (c1 * c2),
         },
     };
+    dirty = false;
+    version++;
+    // a parented world matrix only changes once the scene graph gets to it
+    if (!parented) worldVersion++;
 }
 
-PveGameObject PveGameObject::makePointLight(
-    float intensity, float radius, glm::vec3 color) {
-    PveGameObject gameObject = PveGameObject::createGameObject();
-    gameObject.color = color;
-    gameObject.transform.scale.x = radius;
-    gameObject.pointLight = std::make_unique<PointLightComponent>();
-    gameObject.pointLight->lightIntensity = intensity;
-    return gameObject;
+PveEntity makePointLight(PveRegistry &registry, float intensity, float radius, glm::vec3 color) {
+    PveEntity entity = registry.create();
+    registry.emplace<TransformComponent>(entity).setScale({radius, 1.f, 1.f});
+    registry.emplace<ColorComponent>(entity, color);
+    registry.emplace<PointLightComponent>(entity, intensity);
+    return entity;
 }
 
 }  // namespace pve
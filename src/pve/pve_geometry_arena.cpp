@@ -0,0 +1,104 @@
+#include "pve/pve_geometry_arena.hpp"
+
+namespace pve {
+
+PveGeometryArena::PveGeometryArena(PveDevice &device, VkDeviceSize vertexStride,
+                                   uint32_t maxVertexCount, uint32_t maxIndexCount)
+    : pveDevice{device},
+      vertexStride{vertexStride},
+      vertexRanges{maxVertexCount},
+      indexRanges{maxIndexCount} {
+    vertexBuffer = std::make_unique<PveBuffer>(
+        pveDevice,
+        vertexStride,
+        maxVertexCount,
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        1,
+        true);
+
+    indexBuffer = std::make_unique<PveBuffer>(
+        pveDevice,
+        sizeof(uint32_t),
+        maxIndexCount,
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        1,
+        true);
+}
+
+PveGeometryArena::~PveGeometryArena() {}
+
+bool PveGeometryArena::allocate(uint32_t vertexCount, uint32_t indexCount, Range &range) {
+    VkDeviceSize firstVertex, firstIndex, padding;
+    if (!vertexRanges.allocate(vertexCount, 1, firstVertex, padding)) {
+        return false;
+    }
+    if (indexCount > 0 && !indexRanges.allocate(indexCount, 1, firstIndex, padding)) {
+        vertexRanges.free(firstVertex, vertexCount);
+        return false;
+    }
+
+    range.firstVertex = static_cast<uint32_t>(firstVertex);
+    range.vertexCount = vertexCount;
+    range.firstIndex = indexCount > 0 ? static_cast<uint32_t>(firstIndex) : 0;
+    range.indexCount = indexCount;
+    return true;
+}
+
+void PveGeometryArena::free(const Range &range) {
+    vertexRanges.free(range.firstVertex, range.vertexCount);
+    if (range.indexCount > 0) {
+        indexRanges.free(range.firstIndex, range.indexCount);
+    }
+}
+
+std::shared_future<void> PveGeometryArena::upload(const Range &range, const void *vertices,
+                                                  const uint32_t *indices,
+                                                  PveUploadManager *uploadManager) {
+    VkDeviceSize vertexBytes = vertexStride * range.vertexCount;
+    VkDeviceSize indexBytes = sizeof(uint32_t) * range.indexCount;
+
+    // indices stay relative to the model, the draw's vertexOffset moves them into the arena
+    if (uploadManager != nullptr) {
+        std::shared_future<void> uploaded = uploadManager->uploadBuffer(
+            vertexBuffer->getBuffer(), vertexStride * range.firstVertex, vertices, vertexBytes);
+        if (range.indexCount > 0) {
+            uploaded = uploadManager->uploadBuffer(indexBuffer->getBuffer(),
+                                                   sizeof(uint32_t) * range.firstIndex, indices,
+                                                   indexBytes);
+        }
+        return uploaded;
+    }
+
+    // a single staging buffer holds the vertices followed by the indices
+    PveBuffer stagingBuffer{
+        pveDevice,
+        vertexBytes + indexBytes,
+        1,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    };
+    stagingBuffer.map();
+    stagingBuffer.writeToBuffer((void *)vertices, vertexBytes, 0);
+    if (range.indexCount > 0) {
+        stagingBuffer.writeToBuffer((void *)indices, indexBytes, vertexBytes);
+    }
+
+    pveDevice.copyBuffer(stagingBuffer.getBuffer(), vertexBuffer->getBuffer(), vertexBytes, 0,
+                         vertexStride * range.firstVertex);
+    if (range.indexCount > 0) {
+        pveDevice.copyBuffer(stagingBuffer.getBuffer(), indexBuffer->getBuffer(), indexBytes,
+                             vertexBytes, sizeof(uint32_t) * range.firstIndex);
+    }
+    return {};
+}
+
+void PveGeometryArena::bind(VkCommandBuffer commandBuffer) {
+    VkBuffer buffers[] = {vertexBuffer->getBuffer()};
+    VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+}
+
+}  // namespace pve
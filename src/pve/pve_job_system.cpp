@@ -0,0 +1,206 @@
+#include "pve/pve_job_system.hpp"
+
+// std
+#include <stdexcept>
+
+namespace pve {
+
+// yields before an idle worker goes to sleep, so a frame's worth of short bursts of jobs
+// doesn't pay for waking the workers up every time
+static constexpr uint32_t IDLE_SPINS = 64;
+
+// which worker of which job system the current thread is
+static thread_local const PveJobSystem *currentSystem = nullptr;
+static thread_local uint32_t currentIndex = 0;
+
+// after "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê et al.), with a
+// fixed size buffer. The fences are folded into sequentially consistent accesses of top and
+// bottom, which costs about the same on x86 and keeps ThreadSanitizer able to follow it
+bool PveJobSystem::Deque::push(Job *job) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= DEQUE_CAPACITY) {
+        return false;
+    }
+    buffer[b & (DEQUE_CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+PveJobSystem::Job *PveJobSystem::Deque::pop() {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_seq_cst);
+    if (t > b) {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job *job = buffer[b & (DEQUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+        // the last job, a thief may be taking it at the same time
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+            job = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+PveJobSystem::Job *PveJobSystem::Deque::steal() {
+    int64_t t = top.load(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_seq_cst);
+    if (t >= b) {
+        return nullptr;
+    }
+
+    Job *job = buffer[t & (DEQUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+    // lost to the owner or another thief
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return job;
+}
+
+PveJobSystem::PveJobSystem(uint32_t workerCount) {
+    if (workerCount == 0) {
+        workerCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    for (uint32_t i = 0; i < workerCount; i++) {
+        workers.push_back(std::make_unique<Worker>());
+        workers.back()->randomState = 2654435761u * (i + 1);
+    }
+
+    currentSystem = this;
+    currentIndex = 0;
+    for (uint32_t i = 1; i < workerCount; i++) {
+        threads.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+PveJobSystem::~PveJobSystem() {
+    {
+        std::lock_guard<std::mutex> lock{sleepMutex};
+        stopping.store(true);
+    }
+    jobAvailable.notify_all();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    if (currentSystem == this) {
+        currentSystem = nullptr;
+    }
+}
+
+uint32_t PveJobSystem::currentWorker() const {
+    // any other thread would push onto a deque it doesn't own, which the deque can't survive
+    if (currentSystem != this) {
+        throw std::runtime_error("jobs can only be spawned from the job system's threads!");
+    }
+    return currentIndex;
+}
+
+void PveJobSystem::spawn(JobFunction function, PveJobCounter *counter) {
+    Worker &worker = *workers[currentWorker()];
+    Job &job = worker.jobs[worker.nextJob & (DEQUE_CAPACITY - 1)];
+    // every slot taken means thousands of jobs in flight. The oldest one may be the job that's
+    // spawning this, further up this thread's stack, so waiting for its slot could deadlock.
+    // Running the new job right here is as good as queueing it
+    if (!job.finished.load(std::memory_order_acquire)) {
+        function();
+        return;
+    }
+    worker.nextJob++;
+    job.finished.store(false, std::memory_order_relaxed);
+    job.function = std::move(function);
+    job.counter = counter;
+    if (counter != nullptr) {
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (!worker.deque.push(&job)) {
+        execute(job);
+        return;
+    }
+    queuedJobs.fetch_add(1);
+    // taking the mutex orders this against a worker that's about to sleep, see workerLoop()
+    if (sleepingWorkers.load() > 0) {
+        { std::lock_guard<std::mutex> lock{sleepMutex}; }
+        jobAvailable.notify_one();
+    }
+}
+
+void PveJobSystem::wait(PveJobCounter &counter) {
+    uint32_t index = currentWorker();
+    while (!counter.isDone()) {
+        if (Job *job = findJob(index)) {
+            execute(*job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+PveJobSystem::Job *PveJobSystem::findJob(uint32_t index) {
+    Job *job = workers[index]->deque.pop();
+    if (job == nullptr && workers.size() > 1) {
+        // xorshift, so the thieves don't all line up behind the same victim
+        uint32_t &random = workers[index]->randomState;
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        uint32_t workerCount = getWorkerCount();
+        uint32_t start = random % workerCount;
+        for (uint32_t i = 0; i < workerCount && job == nullptr; i++) {
+            uint32_t victim = (start + i) % workerCount;
+            if (victim == index) continue;
+            job = workers[victim]->deque.steal();
+        }
+    }
+    if (job != nullptr) {
+        queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+void PveJobSystem::execute(Job &job) {
+    job.function();
+    // drops whatever the function captured now rather than when the slot is reused
+    job.function = nullptr;
+    PveJobCounter *counter = job.counter;
+    // the slot may be reused as soon as this is set, so the job isn't touched afterwards
+    job.finished.store(true, std::memory_order_release);
+    if (counter != nullptr) {
+        counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+void PveJobSystem::workerLoop(uint32_t index) {
+    currentSystem = this;
+    currentIndex = index;
+
+    uint32_t idleSpins = 0;
+    while (!stopping.load(std::memory_order_acquire)) {
+        if (Job *job = findJob(index)) {
+            execute(*job);
+            idleSpins = 0;
+            continue;
+        }
+        if (++idleSpins < IDLE_SPINS) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // spawn() reads sleepingWorkers after adding to queuedJobs, and this reads queuedJobs
+        // after adding to sleepingWorkers, so one of the two always sees the other
+        idleSpins = 0;
+        std::unique_lock<std::mutex> lock{sleepMutex};
+        sleepingWorkers.fetch_add(1);
+        jobAvailable.wait(lock, [this] { return stopping.load() || queuedJobs.load() > 0; });
+        sleepingWorkers.fetch_sub(1);
+    }
+}
+
+}  // namespace pve
@@ -0,0 +1,105 @@
+#include "pve/pve_material_library.hpp"
+
+// std
+#include <algorithm>
+#include <stdexcept>
+
+namespace pve {
+
+PveMaterialLibrary::PveMaterialLibrary(PveDevice &device) : pveDevice{device} {
+    createSampler();
+    createDescriptors();
+
+    const uint32_t white = 0xffffffff;
+    addTexture(std::make_shared<PveTexture>(pveDevice, 1, 1, &white));
+    addMaterial(PveMaterial{});
+}
+
+PveMaterialLibrary::~PveMaterialLibrary() {
+    vkDestroySampler(pveDevice.device(), sampler, nullptr);
+}
+
+void PveMaterialLibrary::createSampler() {
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    // the device is only picked if it supports anisotropy
+    samplerInfo.anisotropyEnable = VK_TRUE;
+    samplerInfo.maxAnisotropy = std::min(16.f, pveDevice.properties.limits.maxSamplerAnisotropy);
+    samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+    samplerInfo.minLod = 0.f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    if (vkCreateSampler(pveDevice.device(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture sampler");
+    }
+}
+
+void PveMaterialLibrary::createDescriptors() {
+    descriptorPool = PveDescriptorPool::Builder(pveDevice)
+                         .setMaxSets(1)
+                         .setPoolFlags(VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT)
+                         .addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MAX_TEXTURES)
+                         .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1)
+                         .build();
+
+    // slots past the last texture are never written, and never read
+    setLayout = PveDescriptorSetLayout::Builder(pveDevice)
+                    .addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                VK_SHADER_STAGE_FRAGMENT_BIT, MAX_TEXTURES,
+                                VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                                    VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+                                    VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT)
+                    .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+                    .build();
+
+    materialBuffer = std::make_unique<PveBuffer>(
+        pveDevice, sizeof(PveMaterial), MAX_MATERIALS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    materialBuffer->map();
+
+    auto materialInfo = materialBuffer->descriptorInfo();
+    if (!PveDescriptorWriter(*setLayout, *descriptorPool)
+             .writeBuffer(1, &materialInfo)
+             .build(descriptorSet)) {
+        throw std::runtime_error("Failed to allocate material descriptor set");
+    }
+}
+
+uint32_t PveMaterialLibrary::addTexture(std::shared_ptr<PveTexture> texture) {
+    if (textures.size() == MAX_TEXTURES) {
+        throw std::runtime_error("Material library ran out of texture slots");
+    }
+    uint32_t index = static_cast<uint32_t>(textures.size());
+
+    // no frame in flight can be reading a slot that didn't exist when it was recorded
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.sampler = sampler;
+    imageInfo.imageView = texture->getImageView();
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    PveDescriptorWriter(*setLayout, *descriptorPool)
+        .writeImage(0, &imageInfo, index)
+        .overwrite(descriptorSet);
+
+    textures.push_back(std::move(texture));
+    return index;
+}
+
+uint32_t PveMaterialLibrary::addMaterial(const PveMaterial &material) {
+    if (materialCount == MAX_MATERIALS) {
+        throw std::runtime_error("Material library ran out of material slots");
+    }
+    if (material.baseColorTexture >= textures.size()) {
+        throw std::runtime_error("Material uses a texture that isn't in the library");
+    }
+    PveMaterial slot = material;
+    materialBuffer->writeToIndex(&slot, static_cast<int>(materialCount));
+    return materialCount++;
+}
+
+}  // namespace pve
@@ -0,0 +1,144 @@
+#include "pve/pve_mesh_cache.hpp"
+
+// std
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+// posix
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace pve {
+
+// keeps the arrays aligned for the memcpy into the staging buffer
+static constexpr uint64_t DATA_ALIGNMENT = 16;
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// a stat() of the source is all that's needed to validate the cache, the source is never
+// read or hashed on the fast path
+static bool sourceFingerprint(const std::string &sourcePath, uint64_t &size,
+                              int64_t &modifiedTimeNs) {
+    struct stat sourceStat {};
+    if (stat(sourcePath.c_str(), &sourceStat) != 0) {
+        return false;
+    }
+    size = static_cast<uint64_t>(sourceStat.st_size);
+    modifiedTimeNs = static_cast<int64_t>(sourceStat.st_mtim.tv_sec) * 1000000000 +
+                     sourceStat.st_mtim.tv_nsec;
+    return true;
+}
+
+PveMeshCache::PveMeshCache(const std::string &sourcePath, uint32_t vertexStride) {
+    uint64_t sourceSize;
+    int64_t sourceModifiedTimeNs;
+    if (!sourceFingerprint(sourcePath, sourceSize, sourceModifiedTimeNs)) {
+        return;
+    }
+
+    int fd = open(cachePathFor(sourcePath).c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat cacheStat {};
+    if (fstat(fd, &cacheStat) != 0 ||
+        static_cast<size_t>(cacheStat.st_size) < sizeof(PveMeshCacheHeader)) {
+        close(fd);
+        return;
+    }
+    mappedSize = static_cast<size_t>(cacheStat.st_size);
+    mapped = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        mapped = nullptr;
+        return;
+    }
+
+    auto candidate = static_cast<const PveMeshCacheHeader *>(mapped);
+    bool matches = candidate->magic == MAGIC && candidate->version == VERSION &&
+                   candidate->vertexStride == vertexStride &&
+                   (candidate->indexStride == sizeof(uint16_t) ||
+                    candidate->indexStride == sizeof(uint32_t)) &&
+                   candidate->sourceSize == sourceSize &&
+                   candidate->sourceModifiedTimeNs == sourceModifiedTimeNs &&
+                   candidate->vertexOffset + candidate->vertexCount * vertexStride <= mappedSize &&
+                   candidate->indexOffset + candidate->indexCount * candidate->indexStride <=
+                       mappedSize;
+    if (!matches) {
+        munmap(mapped, mappedSize);
+        mapped = nullptr;
+        return;
+    }
+    header = candidate;
+}
+
+PveMeshCache::~PveMeshCache() {
+    if (mapped != nullptr) {
+        munmap(mapped, mappedSize);
+    }
+}
+
+const void *PveMeshCache::getVertexData() const {
+    return static_cast<const char *>(mapped) + header->vertexOffset;
+}
+
+const void *PveMeshCache::getIndexData() const {
+    return static_cast<const char *>(mapped) + header->indexOffset;
+}
+
+std::string PveMeshCache::cachePathFor(const std::string &sourcePath) {
+    return sourcePath + ".pvemesh";
+}
+
+bool PveMeshCache::write(const std::string &sourcePath, const void *vertices,
+                         uint32_t vertexCount, uint32_t vertexStride, const void *indices,
+                         uint32_t indexCount, uint32_t indexStride, const PveBounds &bounds) {
+    PveMeshCacheHeader cacheHeader{};
+    if (!sourceFingerprint(sourcePath, cacheHeader.sourceSize,
+                           cacheHeader.sourceModifiedTimeNs)) {
+        return false;
+    }
+    cacheHeader.magic = MAGIC;
+    cacheHeader.version = VERSION;
+    cacheHeader.vertexStride = vertexStride;
+    cacheHeader.indexStride = indexStride;
+    cacheHeader.vertexCount = vertexCount;
+    cacheHeader.indexCount = indexCount;
+    cacheHeader.bounds = bounds;
+    cacheHeader.vertexOffset = alignUp(sizeof(PveMeshCacheHeader), DATA_ALIGNMENT);
+    uint64_t vertexBytes = static_cast<uint64_t>(vertexCount) * vertexStride;
+    cacheHeader.indexOffset = alignUp(cacheHeader.vertexOffset + vertexBytes, DATA_ALIGNMENT);
+    uint64_t indexBytes = static_cast<uint64_t>(indexCount) * indexStride;
+
+    // write to a temporary file and rename it so a concurrent reader never maps a half
+    // written cache
+    std::string cachePath = cachePathFor(sourcePath);
+    std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream file{tempPath, std::ios::binary | std::ios::trunc};
+        if (!file) {
+            return false;
+        }
+        std::vector<char> padding(DATA_ALIGNMENT, 0);
+        file.write(reinterpret_cast<const char *>(&cacheHeader), sizeof(cacheHeader));
+        file.write(padding.data(), cacheHeader.vertexOffset - sizeof(cacheHeader));
+        file.write(static_cast<const char *>(vertices), vertexBytes);
+        file.write(padding.data(),
+                   cacheHeader.indexOffset - (cacheHeader.vertexOffset + vertexBytes));
+        file.write(static_cast<const char *>(indices), indexBytes);
+        if (!file) {
+            file.close();
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+    return std::rename(tempPath.c_str(), cachePath.c_str()) == 0;
+}
+
+}  // namespace pve
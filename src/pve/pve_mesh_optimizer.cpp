@@ -0,0 +1,292 @@
+#include "pve/pve_mesh_optimizer.hpp"
+
+// std
+#include <algorithm>
+#include <numeric>
+
+namespace pve {
+
+static constexpr uint32_t NO_VERTEX = ~0u;
+
+// a FIFO cache kept as the time every vertex was last added. A vertex is in the cache while
+// fewer than cacheSize vertices were added after it
+class CacheModel {
+   public:
+    CacheModel(uint32_t vertexCount, uint32_t cacheSize)
+        : cacheTime(vertexCount, 0), cacheSize{cacheSize}, timestamp{cacheSize + 1} {}
+
+    // returns whether the vertex was a miss
+    bool access(uint32_t vertex) {
+        if (timestamp - cacheTime[vertex] <= cacheSize) {
+            return false;
+        }
+        cacheTime[vertex] = timestamp++;
+        return true;
+    }
+
+    uint32_t triangleMisses(const uint32_t *triangle) {
+        return access(triangle[0]) + access(triangle[1]) + access(triangle[2]);
+    }
+
+    // how long ago the vertex was added, larger than cacheSize once it was evicted
+    uint32_t age(uint32_t vertex) const { return timestamp - cacheTime[vertex]; }
+
+    void flush() { timestamp += cacheSize + 1; }
+
+   private:
+    std::vector<uint32_t> cacheTime;
+    uint32_t cacheSize;
+    uint32_t timestamp;
+};
+
+PveMeshOptimizer::Report PveMeshOptimizer::optimize(std::vector<PveVertex> &vertices,
+                                                    std::vector<uint32_t> &indices,
+                                                    const Options &options) {
+    Report report{};
+    report.before = analyzeVertexCache(indices, static_cast<uint32_t>(vertices.size()),
+                                       options.cacheSize);
+    if (options.vertexCache) {
+        std::vector<uint32_t> clusters = optimizeVertexCache(
+            indices, static_cast<uint32_t>(vertices.size()), options.cacheSize);
+        if (options.overdraw) {
+            optimizeOverdraw(indices, clusters, vertices, options.cacheSize,
+                             options.overdrawThreshold);
+        }
+    }
+    if (options.vertexFetch) {
+        optimizeVertexFetch(vertices, indices);
+    }
+    report.after = analyzeVertexCache(indices, static_cast<uint32_t>(vertices.size()),
+                                      options.cacheSize);
+    return report;
+}
+
+std::vector<uint32_t> PveMeshOptimizer::optimizeVertexCache(std::vector<uint32_t> &indices,
+                                                            uint32_t vertexCount,
+                                                            uint32_t cacheSize) {
+    const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+    std::vector<uint32_t> clusters;
+    if (triangleCount == 0) {
+        return clusters;
+    }
+
+    // the triangles of every vertex, packed in one array
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t index : indices) {
+        adjacencyOffsets[index + 1]++;
+    }
+    std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (uint32_t triangle = 0; triangle < triangleCount; triangle++) {
+        for (uint32_t corner = 0; corner < 3; corner++) {
+            adjacency[fill[indices[triangle * 3 + corner]]++] = triangle;
+        }
+    }
+
+    // triangles not emitted yet around every vertex
+    std::vector<uint32_t> liveTriangles(vertexCount);
+    for (uint32_t vertex = 0; vertex < vertexCount; vertex++) {
+        liveTriangles[vertex] = adjacencyOffsets[vertex + 1] - adjacencyOffsets[vertex];
+    }
+    std::vector<bool> emitted(triangleCount, false);
+    CacheModel cache{vertexCount, cacheSize};
+    // the vertices of the emitted triangles, most recent last
+    std::vector<uint32_t> deadEnds;
+    deadEnds.reserve(indices.size());
+    std::vector<uint32_t> candidates;
+    uint32_t nextInputVertex = 0;
+
+    // the most recently used vertex with triangles left, or the next one in input order
+    auto skipDeadEnd = [&]() {
+        while (!deadEnds.empty()) {
+            uint32_t vertex = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[vertex] > 0) return vertex;
+        }
+        while (nextInputVertex < vertexCount) {
+            uint32_t vertex = nextInputVertex++;
+            if (liveTriangles[vertex] > 0) return vertex;
+        }
+        return NO_VERTEX;
+    };
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    uint32_t fanning = skipDeadEnd();
+    bool clusterStart = true;
+    while (fanning != NO_VERTEX) {
+        candidates.clear();
+        for (uint32_t i = adjacencyOffsets[fanning]; i < adjacencyOffsets[fanning + 1]; i++) {
+            uint32_t triangle = adjacency[i];
+            if (emitted[triangle]) continue;
+            emitted[triangle] = true;
+            if (clusterStart) {
+                clusters.push_back(static_cast<uint32_t>(result.size() / 3));
+                clusterStart = false;
+            }
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                uint32_t vertex = indices[triangle * 3 + corner];
+                result.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                liveTriangles[vertex]--;
+                cache.access(vertex);
+            }
+        }
+
+        // the oldest candidate that would still be in the cache after its own triangles are
+        // emitted, each one adding at most two vertices. Failing that, any with triangles left
+        fanning = NO_VERTEX;
+        int64_t bestPriority = -1;
+        for (uint32_t vertex : candidates) {
+            if (liveTriangles[vertex] == 0) continue;
+            int64_t priority = 0;
+            if (cache.age(vertex) + 2 * liveTriangles[vertex] <= cacheSize) {
+                priority = cache.age(vertex);
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                fanning = vertex;
+            }
+        }
+        if (fanning == NO_VERTEX) {
+            fanning = skipDeadEnd();
+            clusterStart = true;
+        }
+    }
+
+    indices.swap(result);
+    return clusters;
+}
+
+void PveMeshOptimizer::optimizeOverdraw(std::vector<uint32_t> &indices,
+                                        const std::vector<uint32_t> &clusters,
+                                        const std::vector<PveVertex> &vertices,
+                                        uint32_t cacheSize, float threshold) {
+    const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+    if (triangleCount == 0 || clusters.empty()) {
+        return;
+    }
+
+    // a hard cluster is cut as soon as its ACMR since the last cut, with a cold cache, gets
+    // within the threshold of the ACMR of the whole cluster. The remainder after the last cut
+    // is usually a few triangles with a poor ACMR, so it stays with the cluster before it
+    CacheModel cache{static_cast<uint32_t>(vertices.size()), cacheSize};
+    std::vector<uint32_t> softClusters;
+    for (size_t cluster = 0; cluster < clusters.size(); cluster++) {
+        uint32_t begin = clusters[cluster];
+        uint32_t end = cluster + 1 < clusters.size() ? clusters[cluster + 1] : triangleCount;
+        cache.flush();
+        uint32_t clusterMisses = 0;
+        for (uint32_t triangle = begin; triangle < end; triangle++) {
+            clusterMisses += cache.triangleMisses(&indices[triangle * 3]);
+        }
+        float targetAcmr = threshold * clusterMisses / static_cast<float>(end - begin);
+
+        size_t firstCut = softClusters.size();
+        softClusters.push_back(begin);
+        cache.flush();
+        uint32_t misses = 0;
+        uint32_t triangles = 0;
+        for (uint32_t triangle = begin; triangle < end; triangle++) {
+            misses += cache.triangleMisses(&indices[triangle * 3]);
+            triangles++;
+            if (misses <= targetAcmr * triangles) {
+                softClusters.push_back(triangle + 1);
+                cache.flush();
+                misses = 0;
+                triangles = 0;
+            }
+        }
+        if (softClusters.size() > firstCut + 1) {
+            softClusters.pop_back();
+        }
+    }
+
+    // the corners of every triangle averaged, the mesh's center for the sort
+    glm::vec3 meshCenter{0.f};
+    for (uint32_t index : indices) {
+        meshCenter += vertices[index].position;
+    }
+    meshCenter *= 1.f / static_cast<float>(indices.size());
+
+    // how much a cluster faces away from the center, its area weighted normal against the
+    // direction from the center to its own center
+    struct SortedCluster {
+        float facing;
+        uint32_t begin;
+        uint32_t end;
+    };
+    std::vector<SortedCluster> sortedClusters(softClusters.size());
+    for (size_t cluster = 0; cluster < softClusters.size(); cluster++) {
+        uint32_t begin = softClusters[cluster];
+        uint32_t end =
+            cluster + 1 < softClusters.size() ? softClusters[cluster + 1] : triangleCount;
+        glm::vec3 center{0.f};
+        glm::vec3 normal{0.f};
+        for (uint32_t triangle = begin; triangle < end; triangle++) {
+            const glm::vec3 &a = vertices[indices[triangle * 3 + 0]].position;
+            const glm::vec3 &b = vertices[indices[triangle * 3 + 1]].position;
+            const glm::vec3 &c = vertices[indices[triangle * 3 + 2]].position;
+            center += a + b + c;
+            normal += glm::cross(b - a, c - a);
+        }
+        center *= 1.f / static_cast<float>((end - begin) * 3);
+        float area = glm::length(normal);
+        float facing = area > 0.f ? glm::dot(center - meshCenter, normal) / area : 0.f;
+        sortedClusters[cluster] = {facing, begin, end};
+    }
+    std::stable_sort(sortedClusters.begin(), sortedClusters.end(),
+                     [](const SortedCluster &a, const SortedCluster &b) {
+                         return a.facing > b.facing;
+                     });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (const SortedCluster &cluster : sortedClusters) {
+        result.insert(result.end(), indices.begin() + cluster.begin * 3,
+                      indices.begin() + cluster.end * 3);
+    }
+    indices.swap(result);
+}
+
+std::vector<uint32_t> PveMeshOptimizer::remapVertexFetch(std::vector<uint32_t> &indices,
+                                                         uint32_t vertexCount) {
+    std::vector<uint32_t> remap(vertexCount, NO_VERTEX);
+    std::vector<uint32_t> order;
+    order.reserve(vertexCount);
+    for (uint32_t &index : indices) {
+        if (remap[index] == NO_VERTEX) {
+            remap[index] = static_cast<uint32_t>(order.size());
+            order.push_back(index);
+        }
+        index = remap[index];
+    }
+    return order;
+}
+
+PveMeshOptimizer::CacheStats PveMeshOptimizer::analyzeVertexCache(
+    const std::vector<uint32_t> &indices, uint32_t vertexCount, uint32_t cacheSize) {
+    CacheStats stats{};
+    if (indices.empty()) {
+        return stats;
+    }
+
+    CacheModel cache{vertexCount, cacheSize};
+    std::vector<bool> used(vertexCount, false);
+    uint32_t misses = 0;
+    uint32_t usedCount = 0;
+    for (uint32_t index : indices) {
+        misses += cache.access(index);
+        if (!used[index]) {
+            used[index] = true;
+            usedCount++;
+        }
+    }
+    stats.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+    stats.atvr = static_cast<float>(misses) / static_cast<float>(usedCount);
+    return stats;
+}
+
+}  // namespace pve
@@ -11,6 +11,7 @@
 
 // std
 #include <cassert>
+#include <chrono>
 #include <cstring>
 #include <unordered_map>
 
@@ -26,27 +27,126 @@ struct hash<pve::PveModel::Vertex> {
 }  // namespace std
 
 namespace pve {
-PveModel::PveModel(PveDevice &device, const PveModel::Builder &builder)
-    : pveDevice{device} {
-    createVertexBuffers(builder.vertices);
-    createIndexBuffers(builder.indices);
+PveModel::PveModel(PveDevice &device, const PveModel::Builder &builder, PveGeometryArena *arena,
+                   PveUploadManager *uploadManager)
+    : pveDevice{device},
+      bounds{builder.bounds},
+      dequantization{PveVertexTraits<GpuVertex>::dequantization(builder.bounds)} {
+    if (!builder.packedVertices.empty()) {
+        createBuffers(builder.packedVertices.data(),
+                      static_cast<uint32_t>(builder.packedVertices.size()),
+                      builder.indices.data(), static_cast<uint32_t>(builder.indices.size()),
+                      VK_INDEX_TYPE_UINT32, arena, uploadManager);
+        return;
+    }
+    // the data is copied before createBuffers returns
+    std::vector<GpuVertex> packedVertices =
+        PveVertexLayout<GpuVertex>::pack(builder.vertices, builder.bounds);
+    createBuffers(packedVertices.data(), static_cast<uint32_t>(packedVertices.size()),
+                  builder.indices.data(), static_cast<uint32_t>(builder.indices.size()),
+                  VK_INDEX_TYPE_UINT32, arena, uploadManager);
+}
+
+PveModel::PveModel(PveDevice &device, const PveMeshCache &meshCache, PveGeometryArena *arena,
+                   PveUploadManager *uploadManager)
+    : pveDevice{device},
+      bounds{meshCache.getBounds()},
+      dequantization{PveVertexTraits<GpuVertex>::dequantization(meshCache.getBounds())} {
+    // the mapped arrays are copied straight into the staging buffers
+    createBuffers(static_cast<const GpuVertex *>(meshCache.getVertexData()),
+                  meshCache.getVertexCount(), meshCache.getIndexData(), meshCache.getIndexCount(),
+                  meshCache.getIndexStride() == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16
+                                                                 : VK_INDEX_TYPE_UINT32,
+                  arena, uploadManager);
 }
 
 PveModel::~PveModel() {
+    if (geometryArena != nullptr) {
+        geometryArena->free(geometryRange);
+    }
 }
 
-std::unique_ptr<PveModel> PveModel::createModelFromFile(PveDevice &device, const std::string &filepath) {
+std::unique_ptr<PveModel> PveModel::createModelFromFile(
+    PveDevice &device, const std::string &filepath, PveGeometryArena *arena,
+    PveUploadManager *uploadManager) {
+    PveMeshCache meshCache{filepath, sizeof(GpuVertex)};
+    if (meshCache.isValid()) {
+        return std::make_unique<PveModel>(device, meshCache, arena, uploadManager);
+    }
+
     Builder builder{};
     builder.loadModel(filepath);
-    return std::make_unique<PveModel>(device, builder);
+    return std::make_unique<PveModel>(device, builder, arena, uploadManager);
+}
+
+bool PveModel::isReady() {
+    if (!uploadsDone.valid()) {
+        return true;
+    }
+    if (uploadsDone.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return false;
+    }
+    uploadsDone = {};
+    return true;
+}
+
+VkDeviceSize PveModel::getGeometryBytes() const {
+    VkDeviceSize indexSize =
+        indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    return sizeof(GpuVertex) * static_cast<VkDeviceSize>(vertexCount) + indexSize * indexCount;
+}
+
+void PveModel::createBuffers(
+    const GpuVertex *vertices, uint32_t vertexCount, const void *indices, uint32_t indexCount,
+    VkIndexType indexType, PveGeometryArena *arena, PveUploadManager *uploadManager) {
+    assert(vertexCount >= 3 && "Vertex count must be at least 3");
+    // the copies below are made before the data goes away, uploads copy it straight away
+    if (arena != nullptr && arena->allocate(vertexCount, indexCount, geometryRange)) {
+        geometryArena = arena;
+        this->vertexCount = vertexCount;
+        this->indexCount = indexCount;
+        hasIndexBuffer = indexCount > 0;
+        // the arena's index buffer is shared by every model, so it stays 32 bit
+        std::vector<uint32_t> wideIndices;
+        if (indexType == VK_INDEX_TYPE_UINT16) {
+            auto narrowIndices = static_cast<const uint16_t *>(indices);
+            wideIndices.assign(narrowIndices, narrowIndices + indexCount);
+            indices = wideIndices.data();
+        }
+        uploadsDone = geometryArena->upload(geometryRange, vertices,
+                                            static_cast<const uint32_t *>(indices), uploadManager);
+        return;
+    }
+    createVertexBuffers(vertices, vertexCount, uploadManager);
+    // a model with its own index buffer takes 16 bit indices when its vertex count allows,
+    // halving the index fetches
+    std::vector<uint16_t> narrowIndices;
+    if (indexType == VK_INDEX_TYPE_UINT32 && PveMeshOptimizer::fitsUint16(vertexCount)) {
+        auto wideIndices = static_cast<const uint32_t *>(indices);
+        narrowIndices.assign(wideIndices, wideIndices + indexCount);
+        indices = narrowIndices.data();
+        indexType = VK_INDEX_TYPE_UINT16;
+    }
+    createIndexBuffers(indices, indexCount, indexType, uploadManager);
 }
 
-void PveModel::createVertexBuffers(const std::vector<Vertex> &vertices) {
-    vertexCount = static_cast<uint32_t>(vertices.size());
+void PveModel::createVertexBuffers(
+    const GpuVertex *vertices, uint32_t vertexCount, PveUploadManager *uploadManager) {
+    this->vertexCount = vertexCount;
     assert(vertexCount >= 3 && "Vertex count must be at least 3");
     VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
     uint32_t vertexSize = sizeof(vertices[0]);
 
+    if (uploadManager != nullptr) {
+        vertexBuffer = std::make_unique<PveBuffer>(
+            pveDevice, vertexSize, vertexCount,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1, true);
+        uploadsDone = uploadManager->uploadBuffer(vertexBuffer->getBuffer(), 0, vertices,
+                                                  bufferSize);
+        return;
+    }
+
     PveBuffer stagingBuffer{
         pveDevice,
         vertexSize,
@@ -60,7 +160,7 @@ void PveModel::createVertexBuffers(const std::vector<Vertex> &vertices) {
     };
 
     stagingBuffer.map();
-    stagingBuffer.writeToBuffer((void *)vertices.data());
+    stagingBuffer.writeToBuffer((void *)vertices);
 
     vertexBuffer = std::make_unique<PveBuffer>(
         pveDevice,
@@ -68,19 +168,33 @@ void PveModel::createVertexBuffers(const std::vector<Vertex> &vertices) {
         vertexCount,
         // Buffer will be used to hold vertex input data or as as the destination location for a memory transfer operation
         VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        1,
+        true);
 
     pveDevice.copyBuffer(stagingBuffer.getBuffer(), vertexBuffer->getBuffer(), bufferSize);
 }
 
-void PveModel::createIndexBuffers(const std::vector<uint32_t> &indices) {
-    indexCount = static_cast<uint32_t>(indices.size());
+void PveModel::createIndexBuffers(const void *indices, uint32_t indexCount,
+                                  VkIndexType indexType, PveUploadManager *uploadManager) {
+    this->indexCount = indexCount;
+    this->indexType = indexType;
     hasIndexBuffer = indexCount > 0;
     if (!hasIndexBuffer) {
         return;
     }
-    VkDeviceSize bufferSize = sizeof(indices[0]) * indexCount;
-    uint32_t indexSize = sizeof(indices[0]);
+    uint32_t indexSize = indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    VkDeviceSize bufferSize = static_cast<VkDeviceSize>(indexSize) * indexCount;
+
+    if (uploadManager != nullptr) {
+        indexBuffer = std::make_unique<PveBuffer>(
+            pveDevice, indexSize, indexCount,
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1, true);
+        uploadsDone = uploadManager->uploadBuffer(indexBuffer->getBuffer(), 0, indices,
+                                                  bufferSize);
+        return;
+    }
 
     PveBuffer stagingBuffer{
         pveDevice,
@@ -91,7 +205,7 @@ void PveModel::createIndexBuffers(const std::vector<uint32_t> &indices) {
     };
 
     stagingBuffer.map();
-    stagingBuffer.writeToBuffer((void *)indices.data());
+    stagingBuffer.writeToBuffer((void *)indices);
 
     indexBuffer = std::make_unique<PveBuffer>(
         pveDevice,
@@ -99,54 +213,49 @@ void PveModel::createIndexBuffers(const std::vector<uint32_t> &indices) {
         indexCount,
         // Buffer will be used to hold vertex input data or as as the destination location for a memory transfer operation
         VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        1,
+        true);
 
     pveDevice.copyBuffer(stagingBuffer.getBuffer(), indexBuffer->getBuffer(), bufferSize);
 }
 
-void PveModel::draw(VkCommandBuffer commandBuffer) {
+void PveModel::draw(VkCommandBuffer commandBuffer, uint32_t instanceCount, uint32_t firstInstance) {
+    if (geometryArena != nullptr) {
+        // the indices are relative to the model, vertexOffset moves them to its slice of the arena
+        if (hasIndexBuffer) {
+            vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, geometryRange.firstIndex,
+                             static_cast<int32_t>(geometryRange.firstVertex), firstInstance);
+        } else {
+            vkCmdDraw(commandBuffer, vertexCount, instanceCount, geometryRange.firstVertex,
+                      firstInstance);
+        }
+        return;
+    }
+
     if (hasIndexBuffer) {
-        vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+        vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, 0, 0, firstInstance);
     } else {
-        vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+        vkCmdDraw(commandBuffer, vertexCount, instanceCount, 0, firstInstance);
     }
 }
 
 void PveModel::bind(VkCommandBuffer commandBuffer) {
+    if (geometryArena != nullptr) {
+        geometryArena->bind(commandBuffer);
+        return;
+    }
+
     VkBuffer buffers[] = {vertexBuffer->getBuffer()};
     VkDeviceSize offsets[] = {0};
     // record to commandBuffer to bind one vertexBuffer starting at binding 0 with offset of 0 into the buffer
     // when we want to add multiple bindings, just add additional elements to the arrays
     vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
     if (hasIndexBuffer) {
-        vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, indexType);
     }
 }
 
-std::vector<VkVertexInputBindingDescription> PveModel::Vertex::getBindingDescriptions() {
-    std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
-    bindingDescriptions[0].binding = 0;
-    bindingDescriptions[0].stride = sizeof(Vertex);
-    bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-    // this binding description corresponds to a single vertex buffer.
-    // it will occupy the first binding and index 0.
-    return bindingDescriptions;
-}
-
-std::vector<VkVertexInputAttributeDescription>
-PveModel::Vertex::getAttributeDescriptions() {
-    std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
-
-    // location, binding, format and offset
-    attributeDescriptions.push_back({0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position)});
-    attributeDescriptions.push_back({1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color)});
-    attributeDescriptions.push_back({2, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal)});
-    attributeDescriptions.push_back({3, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv)});
-
-    return attributeDescriptions;
-}
-
 void PveModel::Builder::loadModel(const std::string &filepath) {
     tinyobj::attrib_t attrib;              // position, color, normal, texture coordinate data
     std::vector<tinyobj::shape_t> shapes;  // index values for each face element
@@ -198,6 +307,68 @@ void PveModel::Builder::loadModel(const std::string &filepath) {
             indices.push_back(uniqueVertices[vertex]);
         }
     }
+
+    PveMeshOptimizer::optimize(vertices, indices, PveMeshOptimizer::Options{});
+    computeBounds();
+    packedVertices = PveVertexLayout<GpuVertex>::pack(vertices, bounds);
+
+    // failing to write the cache only costs the next launch another parse.
+    // Indices are cached at 16 bits when they fit
+    const void *cachedIndices = indices.data();
+    uint32_t indexStride = sizeof(uint32_t);
+    std::vector<uint16_t> narrowIndices;
+    if (PveMeshOptimizer::fitsUint16(static_cast<uint32_t>(vertices.size()))) {
+        narrowIndices.assign(indices.begin(), indices.end());
+        cachedIndices = narrowIndices.data();
+        indexStride = sizeof(uint16_t);
+    }
+    PveMeshCache::write(filepath, packedVertices.data(),
+                        static_cast<uint32_t>(packedVertices.size()), sizeof(GpuVertex),
+                        cachedIndices, static_cast<uint32_t>(indices.size()), indexStride,
+                        bounds);
+}
+
+void PveModel::Builder::loadCachedModel(const std::string &filepath) {
+    PveMeshCache meshCache{filepath, sizeof(GpuVertex)};
+    if (!meshCache.isValid()) {
+        loadModel(filepath);
+        return;
+    }
+
+    auto cachedVertices = static_cast<const GpuVertex *>(meshCache.getVertexData());
+    vertices.clear();
+    packedVertices.assign(cachedVertices, cachedVertices + meshCache.getVertexCount());
+    // widened back, the model narrows them again when it gets its own index buffer
+    if (meshCache.getIndexStride() == sizeof(uint16_t)) {
+        auto cachedIndices = static_cast<const uint16_t *>(meshCache.getIndexData());
+        indices.assign(cachedIndices, cachedIndices + meshCache.getIndexCount());
+    } else {
+        auto cachedIndices = static_cast<const uint32_t *>(meshCache.getIndexData());
+        indices.assign(cachedIndices, cachedIndices + meshCache.getIndexCount());
+    }
+    bounds = meshCache.getBounds();
+}
+
+void PveModel::Builder::computeBounds() {
+    bounds = PveBounds{};
+    if (vertices.empty()) {
+        return;
+    }
+
+    bounds.aabbMin = vertices[0].position;
+    bounds.aabbMax = vertices[0].position;
+    for (const auto &vertex : vertices) {
+        bounds.aabbMin = glm::min(bounds.aabbMin, vertex.position);
+        bounds.aabbMax = glm::max(bounds.aabbMax, vertex.position);
+    }
+
+    bounds.sphereCenter = (bounds.aabbMin + bounds.aabbMax) * 0.5f;
+    float radiusSquared = 0.f;
+    for (const auto &vertex : vertices) {
+        glm::vec3 offset = vertex.position - bounds.sphereCenter;
+        radiusSquared = glm::max(radiusSquared, glm::dot(offset, offset));
+    }
+    bounds.sphereRadius = glm::sqrt(radiusSquared);
 }
 
 }  // namespace pve
\ No newline at end of file
@@ -0,0 +1,122 @@
+#include "pve/pve_parallel_recorder.hpp"
+
+#include "pve/pve_swap_chain.hpp"
+
+// std
+#include <cassert>
+#include <stdexcept>
+
+namespace pve {
+
+PveParallelRecorder::PveParallelRecorder(PveDevice &device, uint32_t workerCount)
+    : pveDevice{device}, workerCount{workerCount} {
+    assert(workerCount > 0 && "Parallel recording needs at least one worker");
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = pveDevice.findPhysicalQueueFamilies().graphicsFamily;
+    // the buffers are never reset one by one, the whole pool is reset once per frame
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    workerPools.resize(PveSwapChain::MAX_FRAMES_IN_FLIGHT * workerCount);
+    for (auto &workerPool : workerPools) {
+        if (vkCreateCommandPool(pveDevice.device(), &poolInfo, nullptr,
+                                &workerPool.commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create worker command pool");
+        }
+    }
+}
+
+PveParallelRecorder::~PveParallelRecorder() {
+    // destroying a pool frees every command buffer allocated from it
+    for (auto &workerPool : workerPools) {
+        vkDestroyCommandPool(pveDevice.device(), workerPool.commandPool, nullptr);
+    }
+}
+
+void PveParallelRecorder::beginFrame(int frameIndex, VkRenderPass renderPass,
+                                     VkFramebuffer framebuffer, VkExtent2D extent) {
+    this->frameIndex = frameIndex;
+    this->renderPass = renderPass;
+    this->framebuffer = framebuffer;
+    this->extent = extent;
+    queued.clear();
+
+    for (uint32_t worker = 0; worker < workerCount; worker++) {
+        WorkerPool &workerPool = workerPools[frameIndex * workerCount + worker];
+        if (vkResetCommandPool(pveDevice.device(), workerPool.commandPool, 0) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to reset worker command pool");
+        }
+        workerPool.usedCount = 0;
+    }
+}
+
+VkCommandBuffer PveParallelRecorder::beginSecondary(uint32_t worker) {
+    assert(worker < workerCount && "Worker index out of range");
+    WorkerPool &workerPool = workerPools[frameIndex * workerCount + worker];
+
+    if (workerPool.usedCount == workerPool.commandBuffers.size()) {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandPool = workerPool.commandPool;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(pveDevice.device(), &allocInfo, &commandBuffer) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate secondary command buffer");
+        }
+        workerPool.commandBuffers.push_back(commandBuffer);
+    }
+    VkCommandBuffer commandBuffer = workerPool.commandBuffers[workerPool.usedCount++];
+
+    // the render pass and framebuffer the buffer will be executed in
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = framebuffer;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT |
+                      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording secondary command buffer");
+    }
+
+    // dynamic state isn't inherited from the primary buffer
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(extent.width);
+    viewport.height = static_cast<float>(extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    VkRect2D scissor{{0, 0}, extent};
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    return commandBuffer;
+}
+
+void PveParallelRecorder::endSecondary(VkCommandBuffer commandBuffer) {
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record secondary command buffer");
+    }
+}
+
+void PveParallelRecorder::queue(VkCommandBuffer commandBuffer) { queued.push_back(commandBuffer); }
+
+void PveParallelRecorder::execute(VkCommandBuffer primaryCommandBuffer) {
+    if (queued.empty()) {
+        return;
+    }
+    vkCmdExecuteCommands(primaryCommandBuffer, static_cast<uint32_t>(queued.size()),
+                         queued.data());
+    queued.clear();
+}
+
+}  // namespace pve
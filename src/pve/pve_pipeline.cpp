@@ -5,12 +5,26 @@
 
 // std
 #include <cassert>
-#include <fstream>
-#include <iostream>
 #include <stdexcept>
+#include <type_traits>
 
 namespace pve {
 
+// the raw bytes of a plain value, only for types without padding
+template <typename T>
+static void appendKey(std::string &key, const T &value) {
+    static_assert(std::is_trivially_copyable<T>::value, "Only plain values go into a key");
+    key.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+static void appendKey(std::string &key, const T *values, uint32_t count) {
+    appendKey(key, count);
+    for (uint32_t i = 0; i < count; i++) {
+        appendKey(key, values[i]);
+    }
+}
+
 PvePipeline::PvePipeline(PveDevice &device, const std::string &vertFilepath,
                          const std::string &fragFilepath,
                          const PipelineConfigInfo &configInfo)
@@ -18,25 +32,73 @@ PvePipeline::PvePipeline(PveDevice &device, const std::string &vertFilepath,
     createGraphicsPipeline(vertFilepath, fragFilepath, configInfo);
 }
 
-PvePipeline::~PvePipeline() {
-    vkDestroyShaderModule(pveDevice.device(), vertShaderModule, nullptr);
-    vkDestroyShaderModule(pveDevice.device(), fragShaderModule, nullptr);
-    vkDestroyPipeline(pveDevice.device(), graphicsPipeline, nullptr);
+PvePipeline::PvePipeline(PveDevice &device, const std::string &compFilepath,
+                         VkPipelineLayout pipelineLayout)
+    : pveDevice{device}, bindPoint{VK_PIPELINE_BIND_POINT_COMPUTE} {
+    createComputePipeline(compFilepath, pipelineLayout);
 }
 
-std::vector<char> PvePipeline::readFile(const std::string &filepath) {
-    std::ifstream file{filepath, std::ios::ate | std::ios::binary};
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file: " + filepath);
-    }
-    size_t fileSize = static_cast<size_t>(file.tellg());
-    std::vector<char> buffer(fileSize);
-
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
-
-    file.close();
-    return buffer;
+// the shared pipeline is destroyed with its last user
+PvePipeline::~PvePipeline() {}
+
+std::string PvePipeline::graphicsPipelineKey(uint64_t vertHash, uint64_t fragHash,
+                                             const PipelineConfigInfo &configInfo) {
+    std::string key = "graphics";
+    appendKey(key, vertHash);
+    appendKey(key, fragHash);
+    appendKey(key, configInfo.bindingDescriptions.data(),
+              static_cast<uint32_t>(configInfo.bindingDescriptions.size()));
+    appendKey(key, configInfo.attributeDescriptions.data(),
+              static_cast<uint32_t>(configInfo.attributeDescriptions.size()));
+
+    // the create infos hold pointers and sTypes, so only their values go in
+    appendKey(key, configInfo.viewportInfo.viewportCount);
+    appendKey(key, configInfo.viewportInfo.scissorCount);
+    appendKey(key, configInfo.inputAssemblyInfo.topology);
+    appendKey(key, configInfo.inputAssemblyInfo.primitiveRestartEnable);
+
+    const auto &rasterization = configInfo.rasterizationInfo;
+    appendKey(key, rasterization.depthClampEnable);
+    appendKey(key, rasterization.rasterizerDiscardEnable);
+    appendKey(key, rasterization.polygonMode);
+    appendKey(key, rasterization.cullMode);
+    appendKey(key, rasterization.frontFace);
+    appendKey(key, rasterization.depthBiasEnable);
+    appendKey(key, rasterization.depthBiasConstantFactor);
+    appendKey(key, rasterization.depthBiasClamp);
+    appendKey(key, rasterization.depthBiasSlopeFactor);
+    appendKey(key, rasterization.lineWidth);
+
+    const auto &multisample = configInfo.multisampleInfo;
+    appendKey(key, multisample.rasterizationSamples);
+    appendKey(key, multisample.sampleShadingEnable);
+    appendKey(key, multisample.minSampleShading);
+    appendKey(key, multisample.alphaToCoverageEnable);
+    appendKey(key, multisample.alphaToOneEnable);
+
+    const auto &colorBlend = configInfo.colorBlendInfo;
+    appendKey(key, colorBlend.logicOpEnable);
+    appendKey(key, colorBlend.logicOp);
+    appendKey(key, colorBlend.pAttachments, colorBlend.attachmentCount);
+    appendKey(key, colorBlend.blendConstants);
+
+    const auto &depthStencil = configInfo.depthStencilInfo;
+    appendKey(key, depthStencil.depthTestEnable);
+    appendKey(key, depthStencil.depthWriteEnable);
+    appendKey(key, depthStencil.depthCompareOp);
+    appendKey(key, depthStencil.depthBoundsTestEnable);
+    appendKey(key, depthStencil.stencilTestEnable);
+    appendKey(key, depthStencil.front);
+    appendKey(key, depthStencil.back);
+    appendKey(key, depthStencil.minDepthBounds);
+    appendKey(key, depthStencil.maxDepthBounds);
+
+    appendKey(key, configInfo.dynamicStateInfo.pDynamicStates,
+              configInfo.dynamicStateInfo.dynamicStateCount);
+    appendKey(key, configInfo.pipelineLayout);
+    appendKey(key, configInfo.renderPass);
+    appendKey(key, configInfo.subpass);
+    return key;
 }
 
 void PvePipeline::createGraphicsPipeline(const std::string &vertFilepath,
@@ -46,11 +108,12 @@ void PvePipeline::createGraphicsPipeline(const std::string &vertFilepath,
            "Cannot create graphics pipeline: no pipelineLayout provided in configInfo");
     assert(configInfo.renderPass != VK_NULL_HANDLE &&
            "Cannot create graphics pipeline: no renderPass provided in configInfo");
-    auto vertCode = readFile(vertFilepath);
-    auto fragCode = readFile(fragFilepath);
-
-    createShaderModule(vertCode, &vertShaderModule);
-    createShaderModule(fragCode, &fragShaderModule);
+    // the registry reads each file once and shares modules with the same code
+    PvePipelineRegistry &registry = pveDevice.getPipelineRegistry();
+    uint64_t vertHash;
+    uint64_t fragHash;
+    VkShaderModule vertShaderModule = registry.getShaderModule(vertFilepath, vertHash);
+    VkShaderModule fragShaderModule = registry.getShaderModule(fragFilepath, fragHash);
 
     // vertex shader stage and fragment shader stage
     VkPipelineShaderStageCreateInfo shaderStages[2];
@@ -107,27 +170,56 @@ void PvePipeline::createGraphicsPipeline(const std::string &vertFilepath,
     pipelineInfo.basePipelineIndex = -1;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-    if (vkCreateGraphicsPipelines(pveDevice.device(), VK_NULL_HANDLE, 1, &pipelineInfo,
-                                  nullptr, &graphicsPipeline) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create graphics pipeline");
-    }
+    // only compiled if no live pipeline has the same key, and then mostly out of the cache
+    sharedPipeline = registry.getPipeline(
+        graphicsPipelineKey(vertHash, fragHash, configInfo), [&](VkPipelineCache cache) {
+            VkPipeline created;
+            if (vkCreateGraphicsPipelines(pveDevice.device(), cache, 1, &pipelineInfo, nullptr,
+                                          &created) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create graphics pipeline");
+            }
+            return created;
+        });
+    pipeline = sharedPipeline->pipeline;
 }
 
-void PvePipeline::createShaderModule(const std::vector<char> &code,
-                                     VkShaderModule *shaderModule) {
-    VkShaderModuleCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+void PvePipeline::createComputePipeline(const std::string &compFilepath,
+                                        VkPipelineLayout pipelineLayout) {
+    assert(pipelineLayout != VK_NULL_HANDLE &&
+           "Cannot create compute pipeline: no pipelineLayout provided");
+    PvePipelineRegistry &registry = pveDevice.getPipelineRegistry();
+    uint64_t compHash;
+    VkShaderModule compShaderModule = registry.getShaderModule(compFilepath, compHash);
+
+    VkPipelineShaderStageCreateInfo shaderStage{};
+    shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    shaderStage.module = compShaderModule;
+    shaderStage.pName = "main";
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = shaderStage;
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.basePipelineIndex = -1;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-    if (vkCreateShaderModule(pveDevice.device(), &createInfo, nullptr, shaderModule) !=
-        VK_SUCCESS) {
-        throw std::runtime_error("Failed to create shader module");
-    }
+    std::string key = "compute";
+    appendKey(key, compHash);
+    appendKey(key, pipelineLayout);
+    sharedPipeline = registry.getPipeline(key, [&](VkPipelineCache cache) {
+        VkPipeline created;
+        if (vkCreateComputePipelines(pveDevice.device(), cache, 1, &pipelineInfo, nullptr,
+                                     &created) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create compute pipeline");
+        }
+        return created;
+    });
+    pipeline = sharedPipeline->pipeline;
 }
 
 void PvePipeline::bind(VkCommandBuffer commandBuffer) {
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    vkCmdBindPipeline(commandBuffer, bindPoint, pipeline);
 }
 
 void PvePipeline::defaultPipelineConfigInfo(PipelineConfigInfo &configInfo) {
@@ -248,8 +340,8 @@ void PvePipeline::defaultPipelineConfigInfo(PipelineConfigInfo &configInfo) {
         static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
     configInfo.dynamicStateInfo.flags = 0;
 
-    configInfo.bindingDescriptions = PveModel::Vertex::getBindingDescriptions();
-    configInfo.attributeDescriptions = PveModel::Vertex::getAttributeDescriptions();
+    configInfo.bindingDescriptions = PveModel::getBindingDescriptions();
+    configInfo.attributeDescriptions = PveModel::getAttributeDescriptions();
 }
 
 void PvePipeline::enableAlphaBlending(PipelineConfigInfo &configInfo) {
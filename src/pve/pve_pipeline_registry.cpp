@@ -0,0 +1,202 @@
+#include "pve/pve_pipeline_registry.hpp"
+
+#include "pve/pve_device.hpp"
+
+// std
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace pve {
+
+// FNV-1a
+static uint64_t hashBytes(const char *data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static std::vector<char> readFile(const std::string &filepath) {
+    std::ifstream file{filepath, std::ios::ate | std::ios::binary};
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file: " + filepath);
+    }
+    size_t fileSize = static_cast<size_t>(file.tellg());
+    std::vector<char> buffer(fileSize);
+
+    file.seekg(0);
+    file.read(buffer.data(), fileSize);
+    return buffer;
+}
+
+PvePipelineRegistry::SharedPipeline::~SharedPipeline() {
+    vkDestroyPipeline(device, pipeline, nullptr);
+}
+
+PvePipelineRegistry::PvePipelineRegistry(PveDevice &device, const std::string &cacheFilepath)
+    : pveDevice{device}, cacheFilepath{cacheFilepath} {
+    loadCache();
+}
+
+PvePipelineRegistry::~PvePipelineRegistry() {
+    // failing to write the cache only costs the next launch its compiles
+    save();
+    for (auto &keyvalue : shaderModulesByHash) {
+        vkDestroyShaderModule(pveDevice.device(), keyvalue.second, nullptr);
+    }
+    vkDestroyPipelineCache(pveDevice.device(), pipelineCache, nullptr);
+}
+
+void PvePipelineRegistry::loadCache() {
+    const VkPhysicalDeviceProperties &properties = pveDevice.properties;
+    std::vector<char> data;
+    std::ifstream file{cacheFilepath, std::ios::ate | std::ios::binary};
+    if (file.is_open()) {
+        size_t fileSize = static_cast<size_t>(file.tellg());
+        PvePipelineCacheHeader header{};
+        if (fileSize >= sizeof(header)) {
+            file.seekg(0);
+            file.read(reinterpret_cast<char *>(&header), sizeof(header));
+        }
+        // anything written by another driver, or another version of it, would be rejected by
+        // the driver anyway, or worse
+        bool matches = fileSize >= sizeof(header) && header.magic == MAGIC &&
+                       header.version == VERSION && header.vendorID == properties.vendorID &&
+                       header.deviceID == properties.deviceID &&
+                       header.driverVersion == properties.driverVersion &&
+                       std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID,
+                                   VK_UUID_SIZE) == 0 &&
+                       header.dataSize == fileSize - sizeof(header);
+        if (matches) {
+            data.resize(header.dataSize);
+            file.read(data.data(), data.size());
+            if (!file) {
+                data.clear();
+            }
+        }
+    }
+
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+    if (vkCreatePipelineCache(pveDevice.device(), &cacheInfo, nullptr, &pipelineCache) ==
+        VK_SUCCESS) {
+        return;
+    }
+    // a driver may still refuse data it wrote itself, start over without it
+    cacheInfo.initialDataSize = 0;
+    cacheInfo.pInitialData = nullptr;
+    if (vkCreatePipelineCache(pveDevice.device(), &cacheInfo, nullptr, &pipelineCache) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline cache");
+    }
+}
+
+bool PvePipelineRegistry::save() {
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(pveDevice.device(), pipelineCache, &dataSize, nullptr) !=
+        VK_SUCCESS) {
+        return false;
+    }
+    std::vector<char> data(dataSize);
+    if (vkGetPipelineCacheData(pveDevice.device(), pipelineCache, &dataSize, data.data()) !=
+        VK_SUCCESS) {
+        return false;
+    }
+
+    const VkPhysicalDeviceProperties &properties = pveDevice.properties;
+    PvePipelineCacheHeader header{};
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.vendorID = properties.vendorID;
+    header.deviceID = properties.deviceID;
+    header.driverVersion = properties.driverVersion;
+    std::memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+    header.dataSize = dataSize;
+
+    // write to a temporary file and rename it so a crash never leaves a half written cache
+    std::string tempPath = cacheFilepath + ".tmp";
+    {
+        std::ofstream file{tempPath, std::ios::binary | std::ios::trunc};
+        if (!file) {
+            return false;
+        }
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(data.data(), dataSize);
+        if (!file) {
+            file.close();
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+    return std::rename(tempPath.c_str(), cacheFilepath.c_str()) == 0;
+}
+
+VkShaderModule PvePipelineRegistry::getShaderModule(const std::string &filepath,
+                                                    uint64_t &contentHash) {
+    std::lock_guard<std::mutex> lock{mutex};
+    auto it = shaderModulesByPath.find(filepath);
+    if (it != shaderModulesByPath.end()) {
+        contentHash = it->second.contentHash;
+        return it->second.module;
+    }
+
+    auto code = readFile(filepath);
+    contentHash = hashBytes(code.data(), code.size());
+    VkShaderModule &module = shaderModulesByHash[contentHash];
+    if (module == VK_NULL_HANDLE) {
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = code.size();
+        createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+
+        if (vkCreateShaderModule(pveDevice.device(), &createInfo, nullptr, &module) !=
+            VK_SUCCESS) {
+            shaderModulesByHash.erase(contentHash);
+            throw std::runtime_error("Failed to create shader module");
+        }
+    }
+    shaderModulesByPath.emplace(filepath, ShaderModule{module, contentHash});
+    return module;
+}
+
+std::shared_ptr<PvePipelineRegistry::SharedPipeline> PvePipelineRegistry::getPipeline(
+    const std::string &key, const std::function<VkPipeline(VkPipelineCache)> &create) {
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto it = pipelines.find(key);
+        if (it != pipelines.end()) {
+            if (auto pipeline = it->second.lock()) {
+                sharedCount++;
+                return pipeline;
+            }
+        }
+    }
+
+    // the cache is internally synchronized, so threads compiling different pipelines don't
+    // wait on each other
+    auto pipeline = std::make_shared<SharedPipeline>(pveDevice.device(), create(pipelineCache));
+
+    std::lock_guard<std::mutex> lock{mutex};
+    // another thread may have compiled the same pipeline meanwhile, theirs wins
+    std::weak_ptr<SharedPipeline> &entry = pipelines[key];
+    if (auto existing = entry.lock()) {
+        sharedCount++;
+        return existing;
+    }
+    entry = pipeline;
+    compiledCount++;
+    // compiles are rare, so this is where pipelines nobody uses anymore are forgotten
+    for (auto it = pipelines.begin(); it != pipelines.end();) {
+        it = it->second.expired() ? pipelines.erase(it) : std::next(it);
+    }
+    return pipeline;
+}
+
+}  // namespace pve
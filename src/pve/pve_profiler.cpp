@@ -0,0 +1,273 @@
+#include "pve/pve_profiler.hpp"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <stdexcept>
+
+namespace pve {
+
+std::atomic<PveProfiler *> PveProfiler::current{nullptr};
+std::atomic<uint64_t> PveProfiler::nextId{1};
+
+// the calling thread's event list, so recording a zone never looks anything up
+static thread_local uint64_t cachedProfilerId = 0;
+static thread_local void *cachedThreadEvents = nullptr;
+
+int64_t PveProfiler::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+PveProfiler::CpuZone::CpuZone(const char *name)
+    : profiler{current.load(std::memory_order_acquire)}, name{name} {
+    startNs = profiler != nullptr ? now() : 0;
+}
+
+PveProfiler::CpuZone::~CpuZone() {
+    if (profiler != nullptr) {
+        profiler->recordCpuEvent(name, startNs, now());
+    }
+}
+
+PveProfiler::GpuZone::GpuZone(PveProfiler &profiler, VkCommandBuffer commandBuffer,
+                              const char *name)
+    : profiler{profiler}, commandBuffer{commandBuffer} {
+    zone = profiler.beginGpuZone(commandBuffer, name);
+}
+
+PveProfiler::GpuZone::~GpuZone() { end(); }
+
+void PveProfiler::GpuZone::end() {
+    profiler.endGpuZone(commandBuffer, zone);
+    zone = ~0u;
+}
+
+PveProfiler::PveProfiler(PveDevice &device)
+    : pveDevice{device}, id{nextId.fetch_add(1)}, records(FRAME_HISTORY) {
+    // every graphics and compute queue can write timestamps when this is set
+    gpuTimestamps = pveDevice.properties.limits.timestampComputeAndGraphics == VK_TRUE;
+    timestampPeriod = pveDevice.properties.limits.timestampPeriod;
+
+    gpuFrames.resize(PveSwapChain::MAX_FRAMES_IN_FLIGHT);
+    if (gpuTimestamps) {
+        for (auto &gpuFrame : gpuFrames) {
+            VkQueryPoolCreateInfo queryPoolInfo{};
+            queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            queryPoolInfo.queryCount = MAX_GPU_ZONES * 2;
+            if (vkCreateQueryPool(pveDevice.device(), &queryPoolInfo, nullptr,
+                                  &gpuFrame.queryPool) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create timestamp query pool");
+            }
+        }
+    }
+
+    frameStartNs = now();
+    current.store(this, std::memory_order_release);
+}
+
+PveProfiler::~PveProfiler() {
+    PveProfiler *self = this;
+    current.compare_exchange_strong(self, nullptr);
+    for (auto &gpuFrame : gpuFrames) {
+        vkDestroyQueryPool(pveDevice.device(), gpuFrame.queryPool, nullptr);
+    }
+}
+
+PveProfiler::ThreadEvents &PveProfiler::threadEvents() {
+    if (cachedProfilerId != id) {
+        std::lock_guard<std::mutex> lock{threadsMutex};
+        threads.push_back(std::make_unique<ThreadEvents>());
+        threads.back()->thread = static_cast<uint32_t>(threads.size() - 1);
+        cachedThreadEvents = threads.back().get();
+        cachedProfilerId = id;
+    }
+    return *static_cast<ThreadEvents *>(cachedThreadEvents);
+}
+
+void PveProfiler::recordCpuEvent(const char *name, int64_t startNs, int64_t endNs) {
+    ThreadEvents &events = threadEvents();
+    // only endFrame() ever takes it from another thread
+    std::lock_guard<std::mutex> lock{events.mutex};
+    events.events.push_back({name, events.thread, startNs, endNs});
+}
+
+PveProfiler::FrameRecord *PveProfiler::findRecord(uint64_t number) {
+    FrameRecord &record = records[number % FRAME_HISTORY];
+    return record.frameNumber == number ? &record : nullptr;
+}
+
+void PveProfiler::collectGpuTimes(GpuFrame &gpuFrame) {
+    uint32_t zoneCount = static_cast<uint32_t>(gpuFrame.zoneNames.size());
+    FrameRecord *record = findRecord(gpuFrame.frameNumber);
+    if (zoneCount == 0 || record == nullptr) return;
+
+    // the frame's fence has signaled, so this doesn't wait. A zone that was never ended
+    // leaves its query unavailable, and the whole frame is dropped
+    uint64_t timestamps[MAX_GPU_ZONES * 2];
+    if (vkGetQueryPoolResults(pveDevice.device(), gpuFrame.queryPool, 0, zoneCount * 2,
+                              sizeof(timestamps), timestamps, sizeof(uint64_t),
+                              VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        return;
+    }
+
+    // the GPU clock has no relation to the CPU one, so the frame's first timestamp is put at
+    // the time the frame was submitted
+    uint64_t first = timestamps[0];
+    for (uint32_t i = 1; i < zoneCount * 2; i++) {
+        first = std::min(first, timestamps[i]);
+    }
+    for (uint32_t zone = 0; zone < zoneCount; zone++) {
+        auto toNs = [&](uint64_t timestamp) {
+            return gpuFrame.submitNs +
+                   static_cast<int64_t>(static_cast<double>(timestamp - first) * timestampPeriod);
+        };
+        record->gpuEvents.push_back({gpuFrame.zoneNames[zone], toNs(timestamps[zone * 2]),
+                                     toNs(timestamps[zone * 2 + 1])});
+    }
+}
+
+void PveProfiler::beginFrame(int frameIndex, VkCommandBuffer commandBuffer) {
+    if (!gpuTimestamps) return;
+
+    GpuFrame &gpuFrame = gpuFrames[frameIndex];
+    collectGpuTimes(gpuFrame);
+    vkCmdResetQueryPool(commandBuffer, gpuFrame.queryPool, 0, MAX_GPU_ZONES * 2);
+    gpuFrame.zoneNames.clear();
+    gpuFrame.frameNumber = frameNumber;
+    currentGpuFrame = frameIndex;
+}
+
+uint32_t PveProfiler::beginGpuZone(VkCommandBuffer commandBuffer, const char *name) {
+    if (currentGpuFrame < 0) return ~0u;
+    GpuFrame &gpuFrame = gpuFrames[currentGpuFrame];
+    uint32_t zone = static_cast<uint32_t>(gpuFrame.zoneNames.size());
+    if (zone == MAX_GPU_ZONES) return ~0u;
+
+    gpuFrame.zoneNames.push_back(name);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, gpuFrame.queryPool,
+                        zone * 2);
+    return zone;
+}
+
+void PveProfiler::endGpuZone(VkCommandBuffer commandBuffer, uint32_t zone) {
+    if (currentGpuFrame < 0 || zone == ~0u) return;
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        gpuFrames[currentGpuFrame].queryPool, zone * 2 + 1);
+}
+
+void PveProfiler::endFrame() {
+    int64_t endNs = now();
+    FrameRecord &record = records[frameNumber % FRAME_HISTORY];
+    record.frameNumber = frameNumber;
+    record.startNs = frameStartNs;
+    record.endNs = endNs;
+    record.cpuEvents.clear();
+    record.gpuEvents.clear();
+    {
+        std::lock_guard<std::mutex> lock{threadsMutex};
+        for (auto &thread : threads) {
+            std::lock_guard<std::mutex> eventsLock{thread->mutex};
+            record.cpuEvents.insert(record.cpuEvents.end(), thread->events.begin(),
+                                    thread->events.end());
+            thread->events.clear();
+        }
+    }
+
+    if (currentGpuFrame >= 0) {
+        gpuFrames[currentGpuFrame].submitNs = endNs;
+        currentGpuFrame = -1;
+    }
+    frameNumber++;
+    frameStartNs = endNs;
+}
+
+bool PveProfiler::writeChromeTrace(const std::string &filepath) const {
+    std::FILE *file = std::fopen(filepath.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+
+    int64_t originNs = -1;
+    for (auto &record : records) {
+        if (record.frameNumber == ~0ull) continue;
+        if (originNs < 0 || record.startNs < originNs) originNs = record.startNs;
+    }
+    // complete events, timestamps in microseconds. The CPU threads are process 0 and the GPU
+    // is process 1
+    bool first = true;
+    auto writeEvent = [&](const char *name, int pid, uint32_t tid, int64_t startNs,
+                          int64_t endNs) {
+        std::fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+                           "\"ts\":%.3f,\"dur\":%.3f}",
+                     first ? "" : ",", name, pid, tid, (startNs - originNs) * 1e-3,
+                     (endNs - startNs) * 1e-3);
+        first = false;
+    };
+
+    std::fprintf(file, "{\"traceEvents\":[");
+    std::fprintf(file, "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+                       "\"args\":{\"name\":\"CPU\"}},");
+    std::fprintf(file, "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                       "\"args\":{\"name\":\"GPU\"}}");
+    first = false;
+    for (auto &record : records) {
+        if (record.frameNumber == ~0ull) continue;
+        writeEvent("frame", 0, 0, record.startNs, record.endNs);
+        for (auto &event : record.cpuEvents) {
+            writeEvent(event.name, 0, event.thread, event.startNs, event.endNs);
+        }
+        for (auto &event : record.gpuEvents) {
+            writeEvent(event.name, 1, 0, event.startNs, event.endNs);
+        }
+    }
+    std::fprintf(file, "\n]}\n");
+    bool written = std::ferror(file) == 0;
+    return std::fclose(file) == 0 && written;
+}
+
+void PveProfiler::printSummary(std::ostream &out) const {
+    // each zone's total time in every frame it appears in, CPU and GPU zones kept apart
+    std::map<std::string, std::vector<double>> zoneTimes;
+    std::map<std::string, double> frameTotals;
+    uint32_t frameCount = 0;
+    for (auto &record : records) {
+        if (record.frameNumber == ~0ull) continue;
+        frameCount++;
+        zoneTimes["frame"].push_back((record.endNs - record.startNs) * 1e-6);
+        frameTotals.clear();
+        for (auto &event : record.cpuEvents) {
+            frameTotals[std::string{"cpu "} + event.name] += (event.endNs - event.startNs) * 1e-6;
+        }
+        for (auto &event : record.gpuEvents) {
+            frameTotals[std::string{"gpu "} + event.name] += (event.endNs - event.startNs) * 1e-6;
+        }
+        for (auto &keyvalue : frameTotals) {
+            zoneTimes[keyvalue.first].push_back(keyvalue.second);
+        }
+    }
+    if (frameCount == 0) return;
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "profile of the last %u frames (ms)%14s%9s%9s\n",
+                  frameCount, "p50", "p95", "p99");
+    out << line;
+    for (auto &keyvalue : zoneTimes) {
+        std::vector<double> &times = keyvalue.second;
+        std::sort(times.begin(), times.end());
+        // nearest rank
+        auto percentile = [&](double p) {
+            size_t rank = static_cast<size_t>(p * times.size() + .999999);
+            return times[std::min(std::max(rank, size_t{1}), times.size()) - 1];
+        };
+        std::snprintf(line, sizeof(line), "  %-40s%9.3f%9.3f%9.3f\n", keyvalue.first.c_str(),
+                      percentile(.50), percentile(.95), percentile(.99));
+        out << line;
+    }
+}
+
+}  // namespace pve
@@ -31,6 +31,7 @@ void PveRenderer::recreateSwapChain() {
             throw std::runtime_error("Swap chain image(or depth) format has changed");
         }
     }
+    pveSwapChain->setReadbackCallback(frameReadback);
 }
 
 void PveRenderer::createCommandBuffers() {
@@ -85,6 +86,7 @@ VkCommandBuffer PveRenderer::beginFrame() {
 void PveRenderer::endFrame() {
     assert(isFrameStarted && "Can't call endFrame while frame not in progress");
     auto commandBuffer = getCurrentCommandBuffer();
+    pveSwapChain->recordReadback(commandBuffer, currentImageIndex);
     if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
         throw std::runtime_error("Failed to record command buffer");
     }
@@ -102,7 +104,18 @@ void PveRenderer::endFrame() {
     currentFrameIndex = (currentFrameIndex + 1) % PveSwapChain::MAX_FRAMES_IN_FLIGHT;
 }
 
-void PveRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
+void PveRenderer::setFrameReadback(PveSwapChain::ReadbackCallback callback) {
+    frameReadback = std::move(callback);
+    pveSwapChain->setReadbackCallback(frameReadback);
+}
+
+void PveRenderer::flushPendingReadbacks() {
+    assert(!isFrameStarted && "Can't flush readbacks while frame in progress");
+    pveSwapChain->flushReadbacks();
+}
+
+void PveRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer,
+                                           VkSubpassContents contents) {
     assert(isFrameStarted &&
            "Can't call beginSwapChainRenderPass while frame not in progress");
     assert(commandBuffer == getCurrentCommandBuffer() &&
@@ -122,7 +135,10 @@ void PveRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
     renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
     renderPassInfo.pClearValues = clearValues.data();
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+    if (contents != VK_SUBPASS_CONTENTS_INLINE) {
+        return;
+    }
 
     // every frame we record a command buffer and dynamically set the viewport just before submittig the buffer to be executed
     // this way, we'll always be using the correct window size even if the swap chain changes
@@ -0,0 +1,194 @@
+#include "pve/pve_scene_graph.hpp"
+
+#include "pve/pve_profiler.hpp"
+
+// std
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace pve {
+
+// below this many nodes spawning jobs costs more than the propagation itself
+static constexpr uint32_t PARALLEL_NODE_THRESHOLD = 16384;
+
+void PveSceneGraph::setParent(PveRegistry &registry, PveEntity child, PveEntity parent) {
+    assert(child != parent && "An entity can't be its own parent");
+    // removed and added again rather than edited in place, so the pool's version changes
+    // and the graph gets rebuilt
+    registry.remove<ParentComponent>(child);
+    if (parent != PVE_NULL_ENTITY) {
+        registry.emplace<ParentComponent>(child, parent);
+    }
+}
+
+void PveSceneGraph::rebuild(PveRegistry &registry) {
+    auto &transformPool = registry.pool<TransformComponent>();
+    auto &parentPool = registry.pool<ParentComponent>();
+
+    // any transform may gain or lose its parent here, so all of their world matrices count
+    // as changed
+    for (auto &transform : transformPool.getComponents()) {
+        transform.parented = false;
+        transform.worldVersion++;
+    }
+
+    // every valid child to parent edge, with the nodes numbered in the order they're found
+    std::unordered_map<PveEntity, uint32_t> nodeIndices;
+    std::vector<PveEntity> nodeEntities;
+    std::vector<int32_t> nodeParents;
+    auto nodeFor = [&](PveEntity entity) {
+        auto it = nodeIndices.find(entity);
+        if (it != nodeIndices.end()) return it->second;
+        uint32_t index = static_cast<uint32_t>(nodeEntities.size());
+        nodeIndices.emplace(entity, index);
+        nodeEntities.push_back(entity);
+        nodeParents.push_back(-1);
+        return index;
+    };
+    auto &children = parentPool.getEntities();
+    auto &parentComponents = parentPool.getComponents();
+    for (size_t i = 0; i < children.size(); i++) {
+        PveEntity child = children[i];
+        PveEntity parent = parentComponents[i].parent;
+        // a parent that's gone, or has no transform, leaves the child as a root
+        if (!transformPool.contains(child)) continue;
+        if (!registry.valid(parent) || !transformPool.contains(parent)) continue;
+        uint32_t parentNode = nodeFor(parent);
+        uint32_t childNode = nodeFor(child);
+        nodeParents[childNode] = static_cast<int32_t>(parentNode);
+    }
+
+    // children of each node, packed one after the other
+    const uint32_t nodeCount = static_cast<uint32_t>(nodeEntities.size());
+    std::vector<uint32_t> childOffsets(nodeCount + 1, 0);
+    for (uint32_t node = 0; node < nodeCount; node++) {
+        if (nodeParents[node] >= 0) childOffsets[nodeParents[node] + 1]++;
+    }
+    for (uint32_t node = 0; node < nodeCount; node++) {
+        childOffsets[node + 1] += childOffsets[node];
+    }
+    std::vector<uint32_t> childNodes(childOffsets[nodeCount]);
+    std::vector<uint32_t> childCursor(childOffsets.begin(), childOffsets.end() - 1);
+    for (uint32_t node = 0; node < nodeCount; node++) {
+        if (nodeParents[node] >= 0) childNodes[childCursor[nodeParents[node]]++] = node;
+    }
+
+    transforms.clear();
+    parents.clear();
+    rootOffsets.clear();
+    transforms.reserve(nodeCount);
+    parents.reserve(nodeCount);
+
+    // depth first with an explicit stack, a 100k deep chain would overflow a recursive one
+    std::vector<std::pair<uint32_t, int32_t>> stack;
+    for (uint32_t root = 0; root < nodeCount; root++) {
+        if (nodeParents[root] >= 0) continue;
+        rootOffsets.push_back(static_cast<uint32_t>(transforms.size()));
+        stack.push_back({root, -1});
+        while (!stack.empty()) {
+            auto [node, sortedParent] = stack.back();
+            stack.pop_back();
+            uint32_t sorted = static_cast<uint32_t>(transforms.size());
+            TransformComponent &transform = transformPool.get(nodeEntities[node]);
+            transform.parented = sortedParent >= 0;
+            transforms.push_back(&transform);
+            parents.push_back(sortedParent);
+            // pushed in reverse so the children come out in their original order
+            for (uint32_t c = childOffsets[node + 1]; c > childOffsets[node]; c--) {
+                stack.push_back({childNodes[c - 1], static_cast<int32_t>(sorted)});
+            }
+        }
+    }
+    rootOffsets.push_back(static_cast<uint32_t>(transforms.size()));
+
+    // a node that no root reaches is part of a cycle
+    if (transforms.size() != nodeCount) {
+        for (auto &transform : transformPool.getComponents()) {
+            transform.parented = false;
+        }
+        transforms.clear();
+        parents.clear();
+        rootOffsets.assign(1, 0);
+        throw std::runtime_error("Scene graph contains a cycle");
+    }
+
+    seenVersions.assign(nodeCount, 0);
+    changed.assign(nodeCount, 0);
+    transformPoolVersion = transformPool.getVersion();
+    parentPoolVersion = parentPool.getVersion();
+    forceUpdate = true;
+}
+
+uint32_t PveSceneGraph::propagateRange(uint32_t begin, uint32_t end) {
+    uint32_t updated = 0;
+    for (uint32_t i = begin; i < end; i++) {
+        TransformComponent &transform = *transforms[i];
+        const glm::mat4 &localMatrix = transform.localMatrix();
+        const glm::mat3 &localNormalMatrix = transform.localNormalMatrix();
+
+        // parents were visited first, so their flag already covers the whole chain above
+        int32_t parent = parents[i];
+        bool nodeChanged = forceUpdate || transform.version != seenVersions[i] ||
+                           (parent >= 0 && changed[parent]);
+        seenVersions[i] = transform.version;
+        changed[i] = nodeChanged;
+        if (!nodeChanged || parent < 0) continue;
+
+        TransformComponent &parentTransform = *transforms[parent];
+        transform.worldMatrix = parentTransform.mat4() * localMatrix;
+        // the inverse transpose of a product is the product of the inverse transposes
+        transform.worldNormalMatrix = parentTransform.normalMatrix() * localNormalMatrix;
+        transform.worldVersion++;
+        updated++;
+    }
+    return updated;
+}
+
+void PveSceneGraph::propagate(PveRegistry &registry, PveJobSystem *jobSystem) {
+    PVE_PROFILE_ZONE("PveSceneGraph::propagate");
+    if (registry.pool<TransformComponent>().getVersion() != transformPoolVersion ||
+        registry.pool<ParentComponent>().getVersion() != parentPoolVersion) {
+        rebuild(registry);
+    }
+
+    const uint32_t nodeCount = getNodeCount();
+    const uint32_t rootCount = static_cast<uint32_t>(rootOffsets.size() - 1);
+    // a few chunks per worker, so stealing can even out subtrees of different depths
+    uint32_t chunkCount =
+        jobSystem != nullptr ? std::min(jobSystem->getWorkerCount() * 4, rootCount) : 1;
+    if (nodeCount < PARALLEL_NODE_THRESHOLD || chunkCount < 2) {
+        updatedCount = propagateRange(0, nodeCount);
+        forceUpdate = false;
+        return;
+    }
+
+    // subtrees never share nodes, so whole roots are split between the chunks by node count
+    chunks.clear();
+    uint32_t rootBegin = 0;
+    for (uint32_t c = 0; c < chunkCount && rootBegin < rootCount; c++) {
+        uint32_t targetEnd = static_cast<uint32_t>(
+            static_cast<uint64_t>(nodeCount) * (c + 1) / chunkCount);
+        uint32_t rootEnd = rootBegin + 1;
+        while (rootEnd < rootCount && rootOffsets[rootEnd] < targetEnd) {
+            rootEnd++;
+        }
+        chunks.push_back({rootOffsets[rootBegin], rootOffsets[rootEnd]});
+        rootBegin = rootEnd;
+    }
+    chunkUpdatedCounts.assign(chunks.size(), 0);
+    jobSystem->parallelFor(static_cast<uint32_t>(chunks.size()), 1,
+                           [this](uint32_t begin, uint32_t end) {
+                               for (uint32_t c = begin; c < end; c++) {
+                                   chunkUpdatedCounts[c] =
+                                       propagateRange(chunks[c].first, chunks[c].second);
+                               }
+                           });
+    updatedCount = 0;
+    for (uint32_t chunkUpdated : chunkUpdatedCounts) {
+        updatedCount += chunkUpdated;
+    }
+    forceUpdate = false;
+}
+
+}  // namespace pve
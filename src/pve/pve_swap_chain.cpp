@@ -26,12 +26,19 @@ PveSwapChain::PveSwapChain(PveDevice &deviceRef, VkExtent2D extent,
 }
 
 void PveSwapChain::init() {
-    createSwapChain();
+    if (isHeadless()) {
+        createOffscreenImages();
+    } else {
+        createSwapChain();
+    }
     createImageViews();
     createRenderPass();
     createDepthResources();
     createFramebuffers();
     createSyncObjects();
+    if (isHeadless()) {
+        createReadbackBuffers();
+    }
 }
 
 PveSwapChain::~PveSwapChain() {
@@ -45,10 +52,16 @@ PveSwapChain::~PveSwapChain() {
         swapChain = nullptr;
     }
 
+    // offscreen images are owned by us, swap chain images are owned by the swap chain
+    for (size_t i = 0; i < offscreenImageMemorys.size(); i++) {
+        vkDestroyImage(device.device(), swapChainImages[i], nullptr);
+        device.getAllocator().free(offscreenImageMemorys[i]);
+    }
+
     for (int i = 0; i < depthImages.size(); i++) {
         vkDestroyImageView(device.device(), depthImageViews[i], nullptr);
         vkDestroyImage(device.device(), depthImages[i], nullptr);
-        vkFreeMemory(device.device(), depthImageMemorys[i], nullptr);
+        device.getAllocator().free(depthImageMemorys[i]);
     }
 
     for (auto framebuffer : swapChainFramebuffers) {
@@ -69,6 +82,14 @@ VkResult PveSwapChain::acquireNextImage(uint32_t *imageIndex) {
     vkWaitForFences(device.device(), 1, &inFlightFences[currentFrame], VK_TRUE,
                     std::numeric_limits<uint64_t>::max());
 
+    if (isHeadless()) {
+        // the fence guarantees the frame that last used this slot has finished rendering and
+        // copying, so its readback can be handed out and the image reused right away
+        deliverReadback(currentFrame);
+        *imageIndex = static_cast<uint32_t>(currentFrame);
+        return VK_SUCCESS;
+    }
+
     VkResult result = vkAcquireNextImageKHR(
         device.device(), swapChain, std::numeric_limits<uint64_t>::max(),
         imageAvailableSemaphores[currentFrame],  // must be a not signaled semaphore
@@ -90,7 +111,8 @@ VkResult PveSwapChain::submitCommandBuffers(const VkCommandBuffer *buffers,
 
     VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
     VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
+    // offscreen images are never acquired nor presented, so there is nothing to wait on or signal
+    submitInfo.waitSemaphoreCount = isHeadless() ? 0 : 1;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
 
@@ -98,7 +120,7 @@ VkResult PveSwapChain::submitCommandBuffers(const VkCommandBuffer *buffers,
     submitInfo.pCommandBuffers = buffers;
 
     VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.signalSemaphoreCount = isHeadless() ? 0 : 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
     vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
@@ -107,6 +129,11 @@ VkResult PveSwapChain::submitCommandBuffers(const VkCommandBuffer *buffers,
         throw std::runtime_error("failed to submit draw command buffer!");
     }
 
+    if (isHeadless()) {
+        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        return VK_SUCCESS;
+    }
+
     VkPresentInfoKHR presentInfo = {};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
@@ -190,6 +217,109 @@ void PveSwapChain::createSwapChain() {
     swapChainExtent = extent;
 }
 
+void PveSwapChain::createOffscreenImages() {
+    swapChainImageFormat = device.findSupportedFormat(
+        {VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_SRGB}, VK_IMAGE_TILING_OPTIMAL,
+        VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT);
+    swapChainExtent = windowExtent;
+
+    // one image per frame in flight: frame N always renders into image N, so the
+    // in flight fences alone keep the ring from being overwritten while in use
+    swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+    offscreenImageMemorys.resize(MAX_FRAMES_IN_FLIGHT);
+    for (size_t i = 0; i < swapChainImages.size(); i++) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = swapChainExtent.width;
+        imageInfo.extent.height = swapChainExtent.height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = swapChainImageFormat;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage =
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.flags = 0;
+
+        device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                   swapChainImages[i], offscreenImageMemorys[i]);
+    }
+}
+
+void PveSwapChain::createReadbackBuffers() {
+    // every supported offscreen format is 4 bytes per pixel
+    readbackBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    readbackPending.assign(MAX_FRAMES_IN_FLIGHT, false);
+    for (size_t i = 0; i < readbackBuffers.size(); i++) {
+        readbackBuffers[i] = std::make_unique<PveBuffer>(
+            device, 4, swapChainExtent.width * swapChainExtent.height,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        readbackBuffers[i]->map();
+    }
+}
+
+void PveSwapChain::recordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    if (!isHeadless() || !readbackCallback) {
+        return;
+    }
+
+    // the render pass already left the image in TRANSFER_SRC_OPTIMAL
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {swapChainExtent.width, swapChainExtent.height, 1};
+    vkCmdCopyImageToBuffer(commandBuffer, swapChainImages[imageIndex],
+                           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           readbackBuffers[imageIndex]->getBuffer(), 1, &region);
+
+    // make the copy visible to the host once the frame's fence signals
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = readbackBuffers[imageIndex]->getBuffer();
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    readbackPending[imageIndex] = true;
+}
+
+void PveSwapChain::deliverReadback(size_t frameIndex) {
+    if (readbackPending.empty() || !readbackPending[frameIndex]) {
+        return;
+    }
+    readbackPending[frameIndex] = false;
+    if (readbackCallback) {
+        readbackCallback(readbackBuffers[frameIndex]->getMappedMemory(), swapChainExtent,
+                         swapChainImageFormat);
+    }
+}
+
+void PveSwapChain::flushReadbacks() {
+    // currentFrame holds the oldest submission, so this hands frames out in order
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        size_t frameIndex = (currentFrame + i) % MAX_FRAMES_IN_FLIGHT;
+        vkWaitForFences(device.device(), 1, &inFlightFences[frameIndex], VK_TRUE,
+                        std::numeric_limits<uint64_t>::max());
+        deliverReadback(frameIndex);
+    }
+}
+
 void PveSwapChain::createImageViews() {
     swapChainImageViews.resize(swapChainImages.size());
     for (size_t i = 0; i < swapChainImages.size(); i++) {
@@ -234,7 +364,9 @@ void PveSwapChain::createRenderPass() {
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // headless frames are never presented, they are left ready to be copied out
+    colorAttachment.finalLayout =
+        isHeadless() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference colorAttachmentRef = {};
     colorAttachmentRef.attachment = 0;
@@ -257,6 +389,19 @@ void PveSwapChain::createRenderPass() {
     dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
                                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
+    std::vector<VkSubpassDependency> dependencies{dependency};
+    if (isHeadless()) {
+        // the color writes have to land before the readback copy reads the image
+        VkSubpassDependency readbackDependency = {};
+        readbackDependency.srcSubpass = 0;
+        readbackDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        readbackDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        readbackDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+        readbackDependency.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        readbackDependency.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        dependencies.push_back(readbackDependency);
+    }
+
     std::array<VkAttachmentDescription, 2> attachments = {colorAttachment,
                                                           depthAttachment};
     VkRenderPassCreateInfo renderPassInfo = {};
@@ -265,8 +410,8 @@ void PveSwapChain::createRenderPass() {
     renderPassInfo.pAttachments = attachments.data();
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
 
     if (vkCreateRenderPass(device.device(), &renderPassInfo, nullptr, &renderPass) !=
         VK_SUCCESS) {
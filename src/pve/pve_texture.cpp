@@ -0,0 +1,183 @@
+#include "pve/pve_texture.hpp"
+
+#include "pve/pve_buffer.hpp"
+#include "pve/pve_texture_file.hpp"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace pve {
+
+// every level starts on a multiple of the largest texel block, copies need at least that
+static constexpr VkDeviceSize LEVEL_ALIGNMENT = 16;
+
+static std::vector<PveTextureLevel> levelsOf(const PveCookedTexture &texture) {
+    std::vector<PveTextureLevel> levels;
+    for (auto &level : texture.levels) {
+        levels.push_back({level.data(), level.size()});
+    }
+    return levels;
+}
+
+PveTexture::PveTexture(PveDevice &device, uint32_t width, uint32_t height, const void *pixels,
+                       VkFormat format)
+    : PveTexture{device, width, height, format,
+                 {{pixels, static_cast<VkDeviceSize>(width) * height * 4}}} {}
+
+PveTexture::PveTexture(PveDevice &device, uint32_t width, uint32_t height, VkFormat format,
+                       const std::vector<PveTextureLevel> &levels)
+    : pveDevice{device},
+      width{width},
+      height{height},
+      mipLevels{static_cast<uint32_t>(levels.size())},
+      format{format} {
+    if (mipLevels == 0 || mipLevels > PveTextureCooker::mipLevelCount(width, height)) {
+        throw std::runtime_error("Texture has an invalid number of mip levels");
+    }
+    createImage();
+    upload(levels);
+    createImageView();
+}
+
+PveTexture::PveTexture(PveDevice &device, const PveCookedTexture &texture)
+    : PveTexture{device, texture.width, texture.height, texture.format, levelsOf(texture)} {}
+
+PveTexture::~PveTexture() {
+    vkDestroyImageView(pveDevice.device(), imageView, nullptr);
+    vkDestroyImage(pveDevice.device(), image, nullptr);
+    pveDevice.getAllocator().free(allocation);
+}
+
+void PveTexture::createImage() {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {width, height, 1};
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = format;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    pveDevice.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image,
+                                  allocation);
+}
+
+void PveTexture::upload(const std::vector<PveTextureLevel> &levels) {
+    std::vector<VkDeviceSize> offsets;
+    VkDeviceSize size = 0;
+    for (auto &level : levels) {
+        size = (size + LEVEL_ALIGNMENT - 1) / LEVEL_ALIGNMENT * LEVEL_ALIGNMENT;
+        offsets.push_back(size);
+        size += level.size;
+    }
+    PveBuffer stagingBuffer{pveDevice, size, 1, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
+    stagingBuffer.map();
+    for (size_t i = 0; i < levels.size(); i++) {
+        std::memcpy(static_cast<char *>(stagingBuffer.getMappedMemory()) + offsets[i],
+                    levels[i].data, levels[i].size);
+    }
+
+    // the layout transitions and the copies of every level go in one submission
+    VkCommandBuffer commandBuffer = pveDevice.beginSingleTimeCommands();
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1};
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    // block compressed levels smaller than a block still give their size in texels
+    std::vector<VkBufferImageCopy> regions(mipLevels);
+    for (uint32_t level = 0; level < mipLevels; level++) {
+        regions[level].bufferOffset = offsets[level];
+        regions[level].imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+        regions[level].imageExtent = {std::max(width >> level, 1u), std::max(height >> level, 1u),
+                                      1};
+    }
+    vkCmdCopyBufferToImage(commandBuffer, stagingBuffer.getBuffer(), image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, regions.data());
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                         &barrier);
+
+    pveDevice.endSingleTimeCommands(commandBuffer);
+}
+
+void PveTexture::createImageView() {
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1};
+    if (vkCreateImageView(pveDevice.device(), &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture image view");
+    }
+}
+
+std::unique_ptr<PveTexture> PveTexture::createTextureFromFile(
+    PveDevice &device, const std::string &filepath, const PveTextureCooker::Options &options,
+    PveJobSystem *jobSystem) {
+    static const std::string KTX2_EXTENSION = ".ktx2";
+    bool precooked = filepath.size() >= KTX2_EXTENSION.size() &&
+                     filepath.compare(filepath.size() - KTX2_EXTENSION.size(),
+                                      KTX2_EXTENSION.size(), KTX2_EXTENSION) == 0;
+    PveTextureCooker::Options deviceOptions = supportedOptions(device, options);
+    std::string cachePath = precooked ? filepath : PveTextureFile::cachePathFor(filepath);
+    {
+        // the levels are copied to the staging buffer straight from the mapping
+        PveTextureFile file{cachePath};
+        if (file.isValid() && (precooked || file.isCookedFrom(filepath, deviceOptions))) {
+            if (PveTextureCooker::isBlockCompressed(file.getFormat()) &&
+                !device.getEnabledFeatures().textureCompressionBC) {
+                throw std::runtime_error("Device can't sample block compressed texture: " +
+                                         filepath);
+            }
+            std::vector<PveTextureLevel> levels;
+            for (uint32_t level = 0; level < file.getLevelCount(); level++) {
+                levels.push_back({file.getLevelData(level), file.getLevelSize(level)});
+            }
+            return std::make_unique<PveTexture>(device, file.getWidth(), file.getHeight(),
+                                                file.getFormat(), levels);
+        }
+        if (precooked) {
+            throw std::runtime_error("Failed to load texture: " + filepath);
+        }
+    }
+
+    PveCookedTexture texture = PveTextureCooker::cook(PveTextureCooker::loadImage(filepath),
+                                                      deviceOptions, jobSystem);
+    // failing to write the cache only costs the next run the cook
+    PveTextureFile::write(cachePath, texture, filepath, deviceOptions);
+    return std::make_unique<PveTexture>(device, texture);
+}
+
+PveTextureCooker::Options PveTexture::supportedOptions(
+    const PveDevice &device, const PveTextureCooker::Options &options) {
+    PveTextureCooker::Options result = options;
+    if (!device.getEnabledFeatures().textureCompressionBC) {
+        result.encoding = PveTextureEncoding::Rgba8;
+    }
+    return result;
+}
+
+}  // namespace pve
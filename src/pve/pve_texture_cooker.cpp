@@ -0,0 +1,559 @@
+#include "pve/pve_texture_cooker.hpp"
+
+#include "pve/pve_job_system.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+namespace pve {
+
+// rows of a level a job filters, and rows of 4x4 blocks a job encodes
+static constexpr uint32_t MIP_ROW_GRAIN = 16;
+static constexpr uint32_t BLOCK_ROW_GRAIN = 4;
+// anything larger is more likely a corrupt header than a texture
+static constexpr uint32_t MAX_IMAGE_SIZE = 16384;
+
+template <typename Func>
+static void forEachRange(PveJobSystem *jobSystem, uint32_t count, uint32_t grainSize,
+                         Func &&func) {
+    if (jobSystem != nullptr) {
+        jobSystem->parallelFor(count, grainSize, func);
+    } else {
+        func(0u, count);
+    }
+}
+
+static std::vector<uint8_t> readFile(const std::string &filepath) {
+    std::ifstream file{filepath, std::ios::ate | std::ios::binary};
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file: " + filepath);
+    }
+    size_t fileSize = static_cast<size_t>(file.tellg());
+    std::vector<uint8_t> buffer(fileSize);
+
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(buffer.data()), fileSize);
+    return buffer;
+}
+
+static void checkImageSize(uint32_t width, uint32_t height, const std::string &filepath) {
+    if (width == 0 || height == 0 || width > MAX_IMAGE_SIZE || height > MAX_IMAGE_SIZE) {
+        throw std::runtime_error("Unsupported image size: " + filepath);
+    }
+}
+
+static PveImage decodePpm(const std::vector<uint8_t> &data, const std::string &filepath) {
+    size_t pos = 2;
+    auto nextNumber = [&]() {
+        while (pos < data.size()) {
+            if (data[pos] == '#') {
+                while (pos < data.size() && data[pos] != '\n') pos++;
+            } else if (data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\r' ||
+                       data[pos] == '\n') {
+                pos++;
+            } else {
+                break;
+            }
+        }
+        uint32_t value = 0;
+        size_t start = pos;
+        while (pos < data.size() && data[pos] >= '0' && data[pos] <= '9' && value <= 1u << 20) {
+            value = value * 10 + (data[pos++] - '0');
+        }
+        if (pos == start) {
+            throw std::runtime_error("Malformed PPM header: " + filepath);
+        }
+        return value;
+    };
+    PveImage image;
+    image.width = nextNumber();
+    image.height = nextNumber();
+    uint32_t maxValue = nextNumber();
+    checkImageSize(image.width, image.height, filepath);
+    if (maxValue == 0 || maxValue > 255) {
+        throw std::runtime_error("Only 8 bit PPM images are supported: " + filepath);
+    }
+    // a single whitespace character separates the header from the texels
+    pos++;
+    size_t texelCount = static_cast<size_t>(image.width) * image.height;
+    if (pos + texelCount * 3 > data.size()) {
+        throw std::runtime_error("Truncated PPM image: " + filepath);
+    }
+
+    image.pixels.resize(texelCount * 4);
+    for (size_t i = 0; i < texelCount; i++) {
+        for (int c = 0; c < 3; c++) {
+            image.pixels[i * 4 + c] =
+                static_cast<uint8_t>(data[pos + i * 3 + c] * 255u / maxValue);
+        }
+        image.pixels[i * 4 + 3] = 255;
+    }
+    return image;
+}
+
+static PveImage decodeTga(const std::vector<uint8_t> &data, const std::string &filepath) {
+    if (data.size() < 18) {
+        throw std::runtime_error("Truncated TGA image: " + filepath);
+    }
+    uint8_t imageType = data[2];
+    bool rle = imageType == 10 || imageType == 11;
+    bool gray = imageType == 3 || imageType == 11;
+    if (imageType != 2 && imageType != 3 && !rle) {
+        throw std::runtime_error("Only true color and grayscale TGA images are supported: " +
+                                 filepath);
+    }
+    uint32_t colorMapLength = data[5] | data[6] << 8;
+    uint32_t colorMapEntryBytes = (data[7] + 7) / 8;
+    PveImage image;
+    image.width = data[12] | data[13] << 8;
+    image.height = data[14] | data[15] << 8;
+    uint32_t texelBytes = data[16] / 8;
+    bool topDown = (data[17] & 0x20) != 0;
+    checkImageSize(image.width, image.height, filepath);
+    if (gray ? texelBytes != 1 : texelBytes != 3 && texelBytes != 4) {
+        throw std::runtime_error("Unsupported TGA pixel depth: " + filepath);
+    }
+
+    // a color map may be present even when the image doesn't use it
+    size_t pos = 18 + data[0] + (data[1] == 1 ? colorMapLength * colorMapEntryBytes : 0);
+    size_t texelCount = static_cast<size_t>(image.width) * image.height;
+    image.pixels.resize(texelCount * 4);
+    auto readTexel = [&](size_t texel) {
+        if (pos + texelBytes > data.size()) {
+            throw std::runtime_error("Truncated TGA image: " + filepath);
+        }
+        // rows are stored bottom up unless the descriptor says otherwise
+        size_t x = texel % image.width;
+        size_t y = texel / image.width;
+        uint8_t *out = &image.pixels[((topDown ? y : image.height - 1 - y) * image.width + x) * 4];
+        if (gray) {
+            out[0] = out[1] = out[2] = data[pos];
+            out[3] = 255;
+        } else {
+            out[0] = data[pos + 2];
+            out[1] = data[pos + 1];
+            out[2] = data[pos];
+            out[3] = texelBytes == 4 ? data[pos + 3] : 255;
+        }
+        pos += texelBytes;
+        return out;
+    };
+
+    size_t texel = 0;
+    while (texel < texelCount) {
+        if (!rle) {
+            readTexel(texel++);
+            continue;
+        }
+        if (pos >= data.size()) {
+            throw std::runtime_error("Truncated TGA image: " + filepath);
+        }
+        // a packet is either one texel repeated or a run of raw texels
+        uint8_t packet = data[pos++];
+        size_t count = std::min<size_t>((packet & 0x7f) + 1, texelCount - texel);
+        if (packet & 0x80) {
+            const uint8_t *first = readTexel(texel++);
+            for (size_t i = 1; i < count; i++, texel++) {
+                size_t x = texel % image.width;
+                size_t y = texel / image.width;
+                std::memcpy(
+                    &image.pixels[((topDown ? y : image.height - 1 - y) * image.width + x) * 4],
+                    first, 4);
+            }
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                readTexel(texel++);
+            }
+        }
+    }
+    return image;
+}
+
+PveImage PveTextureCooker::loadImage(const std::string &filepath) {
+    std::vector<uint8_t> data = readFile(filepath);
+    // TGA has no magic number, anything that isn't a PPM is read as one
+    if (data.size() >= 2 && data[0] == 'P' && data[1] == '6') {
+        return decodePpm(data, filepath);
+    }
+    return decodeTga(data, filepath);
+}
+
+struct SrgbTables {
+    float toLinear[256];
+    // indexed by the linear value scaled to 0..4095
+    uint8_t fromLinear[4096];
+};
+
+static const SrgbTables &srgbTables() {
+    static const SrgbTables tables = [] {
+        SrgbTables result{};
+        for (int i = 0; i < 256; i++) {
+            float c = i / 255.f;
+            result.toLinear[i] = c <= .04045f ? c / 12.92f : std::pow((c + .055f) / 1.055f, 2.4f);
+        }
+        for (int i = 0; i < 4096; i++) {
+            float l = i / 4095.f;
+            float c = l <= .0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.f / 2.4f) - .055f;
+            result.fromLinear[i] = static_cast<uint8_t>(std::min(c * 255.f + .5f, 255.f));
+        }
+        return result;
+    }();
+    return tables;
+}
+
+// one row of the next level from two rows of this one. An odd last column is dropped, and a
+// level one texel wide repeats its only column
+static void downsampleRow(const uint8_t *row0, const uint8_t *row1, uint32_t srcWidth,
+                          uint8_t *dst, uint32_t dstWidth) {
+    uint32_t x = 0;
+#ifdef __SSE2__
+    // two texels of the next level per iteration, the four texels under them widened to
+    // 16 bits so the sums don't overflow
+    if (srcWidth > 1) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i rounding = _mm_set1_epi16(2);
+        for (; x + 2 <= dstWidth; x += 2) {
+            __m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 8));
+            __m128i bottom = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 8));
+            __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(top, zero),
+                                        _mm_unpacklo_epi8(bottom, zero));
+            __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(top, zero),
+                                         _mm_unpackhi_epi8(bottom, zero));
+            low = _mm_add_epi16(low, _mm_srli_si128(low, 8));
+            high = _mm_add_epi16(high, _mm_srli_si128(high, 8));
+            __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(low, high), rounding);
+            sum = _mm_srli_epi16(sum, 2);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + x * 4), _mm_packus_epi16(sum, sum));
+        }
+    }
+#endif
+    // whatever doesn't fill a whole register, or everything without SSE2
+    for (; x < dstWidth; x++) {
+        uint32_t x0 = x * 2 * 4;
+        uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1) * 4;
+        for (uint32_t c = 0; c < 4; c++) {
+            dst[x * 4 + c] =
+                static_cast<uint8_t>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] +
+                                      2) >> 2);
+        }
+    }
+}
+
+// the same with color averaged in linear space, a plain average of sRGB values darkens
+// every level. Alpha is linear already
+static void downsampleRowSrgb(const uint8_t *row0, const uint8_t *row1, uint32_t srcWidth,
+                              uint8_t *dst, uint32_t dstWidth) {
+    const SrgbTables &tables = srgbTables();
+    for (uint32_t x = 0; x < dstWidth; x++) {
+        uint32_t x0 = x * 2 * 4;
+        uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1) * 4;
+        for (uint32_t c = 0; c < 3; c++) {
+            float sum = tables.toLinear[row0[x0 + c]] + tables.toLinear[row0[x1 + c]] +
+                        tables.toLinear[row1[x0 + c]] + tables.toLinear[row1[x1 + c]];
+            dst[x * 4 + c] = tables.fromLinear[static_cast<uint32_t>(sum * (4095.f / 4.f) + .5f)];
+        }
+        dst[x * 4 + 3] =
+            static_cast<uint8_t>((row0[x0 + 3] + row0[x1 + 3] + row1[x0 + 3] + row1[x1 + 3] + 2) >>
+                                 2);
+    }
+}
+
+std::vector<PveImage> PveTextureCooker::buildMipChain(const PveImage &image, bool srgb,
+                                                      PveJobSystem *jobSystem) {
+    uint32_t levelCount = mipLevelCount(image.width, image.height);
+    std::vector<PveImage> levels;
+    // so the previous level stays where it is while the next one is added
+    levels.reserve(levelCount);
+    levels.push_back(image);
+    for (uint32_t level = 1; level < levelCount; level++) {
+        const PveImage &src = levels[level - 1];
+        PveImage dst;
+        dst.width = std::max(src.width / 2, 1u);
+        dst.height = std::max(src.height / 2, 1u);
+        dst.pixels.resize(static_cast<size_t>(dst.width) * dst.height * 4);
+
+        forEachRange(jobSystem, dst.height, MIP_ROW_GRAIN, [&](uint32_t begin, uint32_t end) {
+            size_t srcPitch = static_cast<size_t>(src.width) * 4;
+            for (uint32_t y = begin; y < end; y++) {
+                const uint8_t *row0 = src.pixels.data() + y * 2 * srcPitch;
+                const uint8_t *row1 =
+                    src.pixels.data() + std::min(y * 2 + 1, src.height - 1) * srcPitch;
+                uint8_t *out = dst.pixels.data() + static_cast<size_t>(y) * dst.width * 4;
+                if (srgb) {
+                    downsampleRowSrgb(row0, row1, src.width, out, dst.width);
+                } else {
+                    downsampleRow(row0, row1, src.width, out, dst.width);
+                }
+            }
+        });
+        levels.push_back(std::move(dst));
+    }
+    return levels;
+}
+
+// the 4x4 texels of a block, edge texels repeated where the block hangs over the image
+static void gatherBlock(const PveImage &image, uint32_t blockX, uint32_t blockY,
+                        uint8_t texels[64]) {
+    for (uint32_t y = 0; y < 4; y++) {
+        uint32_t sy = std::min(blockY * 4 + y, image.height - 1);
+        for (uint32_t x = 0; x < 4; x++) {
+            uint32_t sx = std::min(blockX * 4 + x, image.width - 1);
+            std::memcpy(texels + (y * 4 + x) * 4,
+                        &image.pixels[(static_cast<size_t>(sy) * image.width + sx) * 4], 4);
+        }
+    }
+}
+
+static uint16_t packRgb565(const int rgb[3]) {
+    return static_cast<uint16_t>(((rgb[0] * 31 + 127) / 255) << 11 |
+                                 ((rgb[1] * 63 + 127) / 255) << 5 | (rgb[2] * 31 + 127) / 255);
+}
+
+static void unpackRgb565(uint16_t color, int rgb[3]) {
+    int r = color >> 11 & 31;
+    int g = color >> 5 & 63;
+    int b = color & 31;
+    rgb[0] = r << 3 | r >> 2;
+    rgb[1] = g << 2 | g >> 4;
+    rgb[2] = b << 3 | b >> 2;
+}
+
+static void writeLittleEndian(uint8_t *out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+// endpoints from the corners of the block's color bounding box, as in van Waveren's real
+// time DXT compression, then the nearest of the four palette colors for each texel
+static void encodeBc1Block(const uint8_t texels[64], uint8_t *block) {
+    int minColor[3] = {255, 255, 255};
+    int maxColor[3] = {0, 0, 0};
+    int sum[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            int value = texels[i * 4 + c];
+            minColor[c] = std::min(minColor[c], value);
+            maxColor[c] = std::max(maxColor[c], value);
+            sum[c] += value;
+        }
+    }
+    // the box's main diagonal only follows the colors if every channel rises with the widest
+    // one. The channels that fall instead swap their ends
+    int widest = 0;
+    for (int c = 1; c < 3; c++) {
+        if (maxColor[c] - minColor[c] > maxColor[widest] - minColor[widest]) widest = c;
+    }
+    for (int c = 0; c < 3; c++) {
+        if (c == widest) continue;
+        int covariance = 0;
+        for (int i = 0; i < 16; i++) {
+            covariance += (texels[i * 4 + widest] * 16 - sum[widest]) *
+                          (texels[i * 4 + c] * 16 - sum[c]) / 256;
+        }
+        if (covariance < 0) std::swap(minColor[c], maxColor[c]);
+    }
+    // pulled in by 1/16 of the box, so the endpoints land on colors rather than past them
+    for (int c = 0; c < 3; c++) {
+        int inset = (maxColor[c] - minColor[c]) / 16;
+        maxColor[c] -= inset;
+        minColor[c] += inset;
+    }
+
+    uint16_t color0 = packRgb565(maxColor);
+    uint16_t color1 = packRgb565(minColor);
+    // color0 > color1 selects the four color mode, equal endpoints leave every index at 0
+    if (color0 < color1) std::swap(color0, color1);
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        int palette[4][3];
+        unpackRgb565(color0, palette[0]);
+        unpackRgb565(color1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0;
+            int bestDistance = 1 << 30;
+            for (int p = 0; p < 4; p++) {
+                int distance = 0;
+                for (int c = 0; c < 3; c++) {
+                    int d = texels[i * 4 + c] - palette[p][c];
+                    distance += d * d;
+                }
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (2 * i);
+        }
+    }
+    writeLittleEndian(block, color0, 2);
+    writeLittleEndian(block + 2, color1, 2);
+    writeLittleEndian(block + 4, indices, 4);
+}
+
+// one channel: the block's maximum and minimum as endpoints in the eight value mode, each
+// texel rounded to the nearest of the six values between them
+static void encodeBc4Block(const uint8_t texels[64], int channel, uint8_t *block) {
+    int minValue = 255;
+    int maxValue = 0;
+    for (int i = 0; i < 16; i++) {
+        minValue = std::min(minValue, static_cast<int>(texels[i * 4 + channel]));
+        maxValue = std::max(maxValue, static_cast<int>(texels[i * 4 + channel]));
+    }
+    uint64_t indices = 0;
+    if (maxValue > minValue) {
+        int range = maxValue - minValue;
+        for (int i = 0; i < 16; i++) {
+            // steps from the maximum (0) to the minimum (7), which the format numbers 0, 2..7, 1
+            int step = ((maxValue - texels[i * 4 + channel]) * 14 + range) / (2 * range);
+            int index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+            indices |= static_cast<uint64_t>(index) << (3 * i);
+        }
+    }
+    block[0] = static_cast<uint8_t>(maxValue);
+    block[1] = static_cast<uint8_t>(minValue);
+    writeLittleEndian(block + 2, indices, 6);
+}
+
+static std::vector<uint8_t> encodeLevel(const PveImage &level, PveTextureEncoding encoding,
+                                        PveJobSystem *jobSystem) {
+    if (encoding == PveTextureEncoding::Rgba8) {
+        return level.pixels;
+    }
+    uint32_t blocksX = (level.width + 3) / 4;
+    uint32_t blocksY = (level.height + 3) / 4;
+    size_t blockBytes = encoding == PveTextureEncoding::Bc1 ? 8 : 16;
+    std::vector<uint8_t> encoded(static_cast<size_t>(blocksX) * blocksY * blockBytes);
+
+    forEachRange(jobSystem, blocksY, BLOCK_ROW_GRAIN, [&](uint32_t begin, uint32_t end) {
+        uint8_t texels[64];
+        for (uint32_t blockY = begin; blockY < end; blockY++) {
+            for (uint32_t blockX = 0; blockX < blocksX; blockX++) {
+                gatherBlock(level, blockX, blockY, texels);
+                uint8_t *block =
+                    encoded.data() + (static_cast<size_t>(blockY) * blocksX + blockX) * blockBytes;
+                switch (encoding) {
+                    case PveTextureEncoding::Bc1:
+                        encodeBc1Block(texels, block);
+                        break;
+                    case PveTextureEncoding::Bc3:
+                        encodeBc4Block(texels, 3, block);
+                        encodeBc1Block(texels, block + 8);
+                        break;
+                    default:
+                        encodeBc4Block(texels, 0, block);
+                        encodeBc4Block(texels, 1, block + 8);
+                        break;
+                }
+            }
+        }
+    });
+    return encoded;
+}
+
+static bool isOpaque(const PveImage &image) {
+    for (size_t i = 3; i < image.pixels.size(); i += 4) {
+        if (image.pixels[i] != 255) return false;
+    }
+    return true;
+}
+
+PveCookedTexture PveTextureCooker::cook(const PveImage &image, const Options &options,
+                                        PveJobSystem *jobSystem) {
+    if (image.width == 0 || image.height == 0 ||
+        image.pixels.size() != static_cast<size_t>(image.width) * image.height * 4) {
+        throw std::runtime_error("Can't cook an empty or malformed image");
+    }
+    PveTextureEncoding encoding = options.encoding;
+    if (encoding == PveTextureEncoding::Auto) {
+        encoding = isOpaque(image) ? PveTextureEncoding::Bc1 : PveTextureEncoding::Bc3;
+    }
+    // BC5 has no sRGB format, it's meant for data
+    bool srgb = options.srgb && encoding != PveTextureEncoding::Bc5;
+
+    std::vector<PveImage> levels;
+    if (options.mipmaps) {
+        levels = buildMipChain(image, srgb, jobSystem);
+    } else {
+        levels.push_back(image);
+    }
+
+    PveCookedTexture cooked;
+    cooked.format = formatFor(encoding, srgb);
+    cooked.width = image.width;
+    cooked.height = image.height;
+    for (auto &level : levels) {
+        cooked.levels.push_back(encodeLevel(level, encoding, jobSystem));
+    }
+    return cooked;
+}
+
+VkFormat PveTextureCooker::formatFor(PveTextureEncoding encoding, bool srgb) {
+    switch (encoding) {
+        case PveTextureEncoding::Rgba8:
+            return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+        case PveTextureEncoding::Bc1:
+            return srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+        case PveTextureEncoding::Bc3:
+            return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+        case PveTextureEncoding::Bc5:
+            return VK_FORMAT_BC5_UNORM_BLOCK;
+        default:
+            throw std::runtime_error("Texture encoding has no format");
+    }
+}
+
+bool PveTextureCooker::isBlockCompressed(VkFormat format) {
+    return blockBytes(format) != 0 && format != VK_FORMAT_R8G8B8A8_SRGB &&
+           format != VK_FORMAT_R8G8B8A8_UNORM;
+}
+
+uint32_t PveTextureCooker::blockBytes(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_R8G8B8A8_UNORM:
+            return 4;
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+            return 8;
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+VkDeviceSize PveTextureCooker::levelSize(VkFormat format, uint32_t width, uint32_t height) {
+    if (isBlockCompressed(format)) {
+        return static_cast<VkDeviceSize>((width + 3) / 4) * ((height + 3) / 4) *
+               blockBytes(format);
+    }
+    return static_cast<VkDeviceSize>(width) * height * blockBytes(format);
+}
+
+uint32_t PveTextureCooker::mipLevelCount(uint32_t width, uint32_t height) {
+    uint32_t levelCount = 1;
+    while (width > 1 || height > 1) {
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+        levelCount++;
+    }
+    return levelCount;
+}
+
+}  // namespace pve
@@ -0,0 +1,289 @@
+#include "pve/pve_texture_file.hpp"
+
+// std
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+// posix
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace pve {
+
+static_assert(sizeof(PveKtx2Header) == 80, "KTX2 header must match the file layout");
+static_assert(sizeof(PveKtx2Level) == 24, "KTX2 level index must match the file layout");
+
+static const uint8_t KTX2_IDENTIFIER[12] = {0xab, 'K',  'T',  'X',  ' ',  '2',
+                                            '0',  0xbb, '\r', '\n', 0x1a, '\n'};
+static const char SOURCE_KEY[] = "PVEsource";
+
+// the parts of the Khronos data format descriptor the cooker's formats need
+static constexpr uint32_t DF_MODEL_RGBSDA = 1;
+static constexpr uint32_t DF_MODEL_BC1A = 128;
+static constexpr uint32_t DF_MODEL_BC3 = 130;
+static constexpr uint32_t DF_MODEL_BC5 = 132;
+static constexpr uint32_t DF_PRIMARIES_BT709 = 1;
+static constexpr uint32_t DF_TRANSFER_LINEAR = 1;
+static constexpr uint32_t DF_TRANSFER_SRGB = 2;
+static constexpr uint32_t DF_CHANNEL_ALPHA = 15;
+static constexpr uint32_t DF_SAMPLE_LINEAR = 0x10;
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool sourceFingerprint(const std::string &sourcePath, uint64_t &size,
+                              int64_t &modifiedTimeNs) {
+    struct stat sourceStat {};
+    if (stat(sourcePath.c_str(), &sourceStat) != 0) {
+        return false;
+    }
+    size = static_cast<uint64_t>(sourceStat.st_size);
+    modifiedTimeNs = static_cast<int64_t>(sourceStat.st_mtim.tv_sec) * 1000000000 +
+                     sourceStat.st_mtim.tv_nsec;
+    return true;
+}
+
+static bool isSrgb(VkFormat format) {
+    return format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK ||
+           format == VK_FORMAT_BC3_SRGB_BLOCK;
+}
+
+// dfdTotalSize followed by a single basic descriptor block
+static std::vector<uint32_t> dataFormatDescriptor(VkFormat format) {
+    struct Sample {
+        uint32_t bitOffset;
+        uint32_t bitLength;
+        uint32_t channel;
+        uint32_t upper;
+    };
+    uint32_t model;
+    std::vector<Sample> samples;
+    switch (format) {
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+            model = DF_MODEL_BC1A;
+            samples = {{0, 64, 0, ~0u}};
+            break;
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+            model = DF_MODEL_BC3;
+            samples = {{0, 64, DF_CHANNEL_ALPHA, ~0u}, {64, 64, 0, ~0u}};
+            break;
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+            model = DF_MODEL_BC5;
+            samples = {{0, 64, 0, ~0u}, {64, 64, 1, ~0u}};
+            break;
+        default:
+            model = DF_MODEL_RGBSDA;
+            samples = {{0, 8, 0, 255},
+                       {8, 8, 1, 255},
+                       {16, 8, 2, 255},
+                       {24, 8, DF_CHANNEL_ALPHA, 255}};
+            break;
+    }
+    bool srgb = isSrgb(format);
+    uint32_t blockDimension = PveTextureCooker::isBlockCompressed(format) ? 3 : 0;
+    uint32_t blockSize = 24 + 16 * static_cast<uint32_t>(samples.size());
+
+    std::vector<uint32_t> words;
+    words.push_back(4 + blockSize);
+    words.push_back(0);  // Khronos vendor, basic descriptor type
+    words.push_back(2 | blockSize << 16);
+    words.push_back(model | DF_PRIMARIES_BT709 << 8 |
+                    (srgb ? DF_TRANSFER_SRGB : DF_TRANSFER_LINEAR) << 16);
+    words.push_back(blockDimension | blockDimension << 8);
+    words.push_back(PveTextureCooker::blockBytes(format));
+    words.push_back(0);
+    for (auto &sample : samples) {
+        // alpha stays linear in an sRGB format
+        uint32_t channelType =
+            sample.channel | (srgb && sample.channel == DF_CHANNEL_ALPHA ? DF_SAMPLE_LINEAR : 0);
+        words.push_back(sample.bitOffset | (sample.bitLength - 1) << 16 | channelType << 24);
+        words.push_back(0);  // sample position
+        words.push_back(0);  // lower
+        words.push_back(sample.upper);
+    }
+    return words;
+}
+
+PveTextureFile::PveTextureFile(const std::string &filepath) {
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat fileStat {};
+    if (fstat(fd, &fileStat) != 0 ||
+        static_cast<size_t>(fileStat.st_size) < sizeof(PveKtx2Header)) {
+        close(fd);
+        return;
+    }
+    mappedSize = static_cast<size_t>(fileStat.st_size);
+    mapped = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        mapped = nullptr;
+        return;
+    }
+
+    auto candidate = static_cast<const PveKtx2Header *>(mapped);
+    auto candidateLevels = reinterpret_cast<const PveKtx2Level *>(candidate + 1);
+    VkFormat format = static_cast<VkFormat>(candidate->vkFormat);
+    bool matches =
+        std::memcmp(candidate->identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0 &&
+        PveTextureCooker::blockBytes(format) != 0 && candidate->pixelWidth > 0 &&
+        candidate->pixelHeight > 0 && candidate->pixelDepth == 0 && candidate->layerCount == 0 &&
+        candidate->faceCount == 1 && candidate->supercompressionScheme == 0 &&
+        candidate->levelCount > 0 &&
+        candidate->levelCount <=
+            PveTextureCooker::mipLevelCount(candidate->pixelWidth, candidate->pixelHeight) &&
+        sizeof(PveKtx2Header) + candidate->levelCount * sizeof(PveKtx2Level) <= mappedSize &&
+        static_cast<uint64_t>(candidate->kvdByteOffset) + candidate->kvdByteLength <= mappedSize;
+    for (uint32_t level = 0; matches && level < candidate->levelCount; level++) {
+        uint32_t width = std::max(candidate->pixelWidth >> level, 1u);
+        uint32_t height = std::max(candidate->pixelHeight >> level, 1u);
+        const PveKtx2Level &entry = candidateLevels[level];
+        matches = entry.byteLength == PveTextureCooker::levelSize(format, width, height) &&
+                  entry.byteOffset + entry.byteLength <= mappedSize;
+    }
+    if (!matches) {
+        munmap(mapped, mappedSize);
+        mapped = nullptr;
+        return;
+    }
+    header = candidate;
+    levels = candidateLevels;
+
+    // each entry is its length, a null terminated key and the value, padded to 4 bytes
+    const uint8_t *kvd = static_cast<const uint8_t *>(mapped) + header->kvdByteOffset;
+    uint32_t pos = 0;
+    while (pos + 4 <= header->kvdByteLength) {
+        uint32_t length;
+        std::memcpy(&length, kvd + pos, 4);
+        if (length > header->kvdByteLength - pos - 4) break;
+        const uint8_t *entry = kvd + pos + 4;
+        if (length == sizeof(SOURCE_KEY) + sizeof(PveTextureSource) &&
+            std::memcmp(entry, SOURCE_KEY, sizeof(SOURCE_KEY)) == 0) {
+            std::memcpy(&source, entry + sizeof(SOURCE_KEY), sizeof(source));
+            hasSource = true;
+        }
+        pos += 4 + static_cast<uint32_t>(alignUp(length, 4));
+    }
+}
+
+PveTextureFile::~PveTextureFile() {
+    if (mapped != nullptr) {
+        munmap(mapped, mappedSize);
+    }
+}
+
+bool PveTextureFile::isCookedFrom(const std::string &sourcePath,
+                                  const PveTextureCooker::Options &options) const {
+    uint64_t sourceSize;
+    int64_t sourceModifiedTimeNs;
+    return hasSource && sourceFingerprint(sourcePath, sourceSize, sourceModifiedTimeNs) &&
+           source.sourceSize == sourceSize &&
+           source.sourceModifiedTimeNs == sourceModifiedTimeNs &&
+           source.cookerVersion == PveTextureCooker::VERSION &&
+           source.encoding == static_cast<uint32_t>(options.encoding) &&
+           source.srgb == static_cast<uint32_t>(options.srgb) &&
+           source.mipmaps == static_cast<uint32_t>(options.mipmaps);
+}
+
+const void *PveTextureFile::getLevelData(uint32_t level) const {
+    return static_cast<const char *>(mapped) + levels[level].byteOffset;
+}
+
+std::string PveTextureFile::cachePathFor(const std::string &sourcePath) {
+    return sourcePath + ".ktx2";
+}
+
+bool PveTextureFile::write(const std::string &filepath, const PveCookedTexture &texture,
+                           const std::string &sourcePath,
+                           const PveTextureCooker::Options &options) {
+    std::vector<uint8_t> keyValueData;
+    if (!sourcePath.empty()) {
+        PveTextureSource textureSource{};
+        if (!sourceFingerprint(sourcePath, textureSource.sourceSize,
+                               textureSource.sourceModifiedTimeNs)) {
+            return false;
+        }
+        textureSource.cookerVersion = PveTextureCooker::VERSION;
+        textureSource.encoding = static_cast<uint32_t>(options.encoding);
+        textureSource.srgb = options.srgb;
+        textureSource.mipmaps = options.mipmaps;
+
+        uint32_t length = sizeof(SOURCE_KEY) + sizeof(textureSource);
+        keyValueData.resize(alignUp(4 + length, 4));
+        std::memcpy(keyValueData.data(), &length, 4);
+        std::memcpy(keyValueData.data() + 4, SOURCE_KEY, sizeof(SOURCE_KEY));
+        std::memcpy(keyValueData.data() + 4 + sizeof(SOURCE_KEY), &textureSource,
+                    sizeof(textureSource));
+    }
+    std::vector<uint32_t> dfd = dataFormatDescriptor(texture.format);
+
+    uint32_t levelCount = static_cast<uint32_t>(texture.levels.size());
+    PveKtx2Header fileHeader{};
+    std::memcpy(fileHeader.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+    fileHeader.vkFormat = static_cast<uint32_t>(texture.format);
+    fileHeader.typeSize = 1;
+    fileHeader.pixelWidth = texture.width;
+    fileHeader.pixelHeight = texture.height;
+    fileHeader.faceCount = 1;
+    fileHeader.levelCount = levelCount;
+    fileHeader.dfdByteOffset =
+        static_cast<uint32_t>(sizeof(PveKtx2Header) + levelCount * sizeof(PveKtx2Level));
+    fileHeader.dfdByteLength = static_cast<uint32_t>(dfd.size() * 4);
+    fileHeader.kvdByteOffset = fileHeader.dfdByteOffset + fileHeader.dfdByteLength;
+    fileHeader.kvdByteLength = static_cast<uint32_t>(keyValueData.size());
+
+    // levels are stored smallest first, each aligned to its texel block, so a reader that
+    // streams the file gets a usable low resolution texture early
+    uint64_t alignment = std::max(PveTextureCooker::blockBytes(texture.format), 4u);
+    std::vector<PveKtx2Level> levelIndex(levelCount);
+    uint64_t offset = fileHeader.kvdByteOffset + fileHeader.kvdByteLength;
+    for (uint32_t level = levelCount; level-- > 0;) {
+        offset = alignUp(offset, alignment);
+        levelIndex[level] = {offset, texture.levels[level].size(), texture.levels[level].size()};
+        offset += texture.levels[level].size();
+    }
+
+    std::vector<uint8_t> data(offset, 0);
+    std::memcpy(data.data(), &fileHeader, sizeof(fileHeader));
+    std::memcpy(data.data() + sizeof(fileHeader), levelIndex.data(),
+                levelIndex.size() * sizeof(PveKtx2Level));
+    std::memcpy(data.data() + fileHeader.dfdByteOffset, dfd.data(), fileHeader.dfdByteLength);
+    if (!keyValueData.empty()) {
+        std::memcpy(data.data() + fileHeader.kvdByteOffset, keyValueData.data(),
+                    keyValueData.size());
+    }
+    for (uint32_t level = 0; level < levelCount; level++) {
+        std::memcpy(data.data() + levelIndex[level].byteOffset, texture.levels[level].data(),
+                    texture.levels[level].size());
+    }
+
+    // write to a temporary file and rename it so a concurrent reader never maps a half
+    // written file
+    std::string tempPath = filepath + ".tmp";
+    {
+        std::ofstream file{tempPath, std::ios::binary | std::ios::trunc};
+        if (!file) {
+            return false;
+        }
+        file.write(reinterpret_cast<const char *>(data.data()), data.size());
+        if (!file) {
+            file.close();
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+    return std::rename(tempPath.c_str(), filepath.c_str()) == 0;
+}
+
+}  // namespace pve
@@ -0,0 +1,283 @@
+#include "pve/pve_upload_manager.hpp"
+
+#include "pve/pve_profiler.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <tuple>
+
+namespace pve {
+
+// staging offsets are kept aligned, so copies never straddle odd addresses
+static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+// everything an upload can end up being read as
+static constexpr VkAccessFlags UPLOAD_READ_ACCESS = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+                                                    VK_ACCESS_INDEX_READ_BIT |
+                                                    VK_ACCESS_SHADER_READ_BIT;
+static constexpr VkPipelineStageFlags UPLOAD_READ_STAGES =
+    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+PveUploadManager::PveUploadManager(PveDevice &device, VkDeviceSize ringSize)
+    : pveDevice{device}, ringSize{ringSize} {
+    QueueFamilyIndices queueFamilies = pveDevice.findPhysicalQueueFamilies();
+    graphicsFamily = queueFamilies.graphicsFamily;
+    transferFamily = queueFamilies.transferFamily;
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = transferFamily;
+    poolInfo.flags =
+        VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    if (vkCreateCommandPool(pveDevice.device(), &poolInfo, nullptr, &commandPool) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upload command pool");
+    }
+
+    // coherent, so the writes into the ring never need flushing
+    stagingRing = std::make_unique<PveBuffer>(
+        pveDevice, ringSize, 1, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    stagingRing->map();
+}
+
+PveUploadManager::~PveUploadManager() {
+    std::vector<VkFence> fences;
+    for (auto &batch : submittedBatches) {
+        fences.push_back(batch.fence);
+    }
+    if (!fences.empty()) {
+        vkWaitForFences(pveDevice.device(), static_cast<uint32_t>(fences.size()), fences.data(),
+                        VK_TRUE, UINT64_MAX);
+    }
+    if (pendingBatch.fence != VK_NULL_HANDLE) {
+        fences.push_back(pendingBatch.fence);
+    }
+    for (auto &resources : freeBatchResources) {
+        fences.push_back(resources.second);
+    }
+    for (VkFence fence : fences) {
+        vkDestroyFence(pveDevice.device(), fence, nullptr);
+    }
+    // destroying the pool frees every command buffer allocated from it
+    vkDestroyCommandPool(pveDevice.device(), commandPool, nullptr);
+}
+
+bool PveUploadManager::tryAllocate(VkDeviceSize size, VkDeviceSize &offset) {
+    size = (size + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+    if (pendingBatch.commandBuffer == VK_NULL_HANDLE && submittedBatches.empty()) {
+        ringHead = 0;
+        ringTail = 0;
+    }
+
+    if (ringHead >= ringTail) {
+        if (ringSize - ringHead >= size) {
+            offset = ringHead;
+            ringHead += size;
+            return true;
+        }
+        // wrap around. The head has to stay strictly below the tail, or a full ring would
+        // look empty
+        if (size < ringTail) {
+            offset = 0;
+            ringHead = size;
+            return true;
+        }
+        return false;
+    }
+    if (ringTail - ringHead > size) {
+        offset = ringHead;
+        ringHead += size;
+        return true;
+    }
+    return false;
+}
+
+VkDeviceSize PveUploadManager::allocate(VkDeviceSize size) {
+    VkDeviceSize offset;
+    while (!tryAllocate(size, offset)) {
+        retireBatches(false);
+        if (tryAllocate(size, offset)) break;
+
+        // the copies still being recorded hold ring space too
+        submit();
+        if (submittedBatches.empty()) {
+            throw std::runtime_error("Upload chunk is larger than the staging ring");
+        }
+        retireBatches(true);
+    }
+    return offset;
+}
+
+void PveUploadManager::beginBatch() {
+    if (!freeBatchResources.empty()) {
+        std::tie(pendingBatch.commandBuffer, pendingBatch.fence) = freeBatchResources.back();
+        freeBatchResources.pop_back();
+        vkResetCommandBuffer(pendingBatch.commandBuffer, 0);
+        vkResetFences(pveDevice.device(), 1, &pendingBatch.fence);
+    } else {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(pveDevice.device(), &allocInfo,
+                                     &pendingBatch.commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate upload command buffer");
+        }
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if (vkCreateFence(pveDevice.device(), &fenceInfo, nullptr, &pendingBatch.fence) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create upload fence");
+        }
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(pendingBatch.commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording upload command buffer");
+    }
+}
+
+std::shared_future<void> PveUploadManager::uploadBuffer(
+    VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data, VkDeviceSize size) {
+    assert(size > 0 && "Upload size must be greater than 0");
+
+    // half the ring, so one chunk can be copied into while the other is in flight
+    const VkDeviceSize maxChunkSize = ringSize / 2;
+    auto ring = static_cast<char *>(stagingRing->getMappedMemory());
+    auto source = static_cast<const char *>(data);
+    for (VkDeviceSize copied = 0; copied < size;) {
+        VkDeviceSize chunkSize = std::min(size - copied, maxChunkSize);
+        // may submit the pending batch to make room, so it comes before beginBatch
+        VkDeviceSize ringOffset = allocate(chunkSize);
+        if (pendingBatch.commandBuffer == VK_NULL_HANDLE) {
+            beginBatch();
+        }
+
+        std::memcpy(ring + ringOffset, source + copied, chunkSize);
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = ringOffset;
+        copyRegion.dstOffset = dstOffset + copied;
+        copyRegion.size = chunkSize;
+        vkCmdCopyBuffer(pendingBatch.commandBuffer, stagingRing->getBuffer(), dstBuffer, 1,
+                        &copyRegion);
+
+        // buffers are exclusive to one queue family, so the written range has to be released
+        // by the transfer family and acquired by the graphics one
+        if (hasDedicatedTransferQueue()) {
+            VkBufferMemoryBarrier acquireBarrier{};
+            acquireBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            acquireBarrier.srcAccessMask = 0;
+            acquireBarrier.dstAccessMask = UPLOAD_READ_ACCESS;
+            acquireBarrier.srcQueueFamilyIndex = transferFamily;
+            acquireBarrier.dstQueueFamilyIndex = graphicsFamily;
+            acquireBarrier.buffer = dstBuffer;
+            acquireBarrier.offset = copyRegion.dstOffset;
+            acquireBarrier.size = chunkSize;
+            pendingBatch.acquireBarriers.push_back(acquireBarrier);
+        }
+        copied += chunkSize;
+    }
+
+    pendingBatch.promises.emplace_back();
+    return pendingBatch.promises.back().get_future().share();
+}
+
+void PveUploadManager::submit() {
+    if (pendingBatch.commandBuffer == VK_NULL_HANDLE) {
+        return;
+    }
+
+    // the release half of the ownership transfer, with the same ranges as the acquire half
+    if (!pendingBatch.acquireBarriers.empty()) {
+        std::vector<VkBufferMemoryBarrier> releaseBarriers = pendingBatch.acquireBarriers;
+        for (auto &barrier : releaseBarriers) {
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+        }
+        vkCmdPipelineBarrier(pendingBatch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+                             static_cast<uint32_t>(releaseBarriers.size()),
+                             releaseBarriers.data(), 0, nullptr);
+    }
+
+    if (vkEndCommandBuffer(pendingBatch.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record upload command buffer");
+    }
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &pendingBatch.commandBuffer;
+    if (vkQueueSubmit(pveDevice.transferQueue(), 1, &submitInfo, pendingBatch.fence) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit upload command buffer");
+    }
+
+    pendingBatch.ringEnd = ringHead;
+    submittedBatches.push_back(std::move(pendingBatch));
+    pendingBatch = Batch{};
+}
+
+void PveUploadManager::retireBatches(bool wait) {
+    // one queue runs the batches in order, so the first unfinished one ends the scan
+    while (!submittedBatches.empty()) {
+        Batch &batch = submittedBatches.front();
+        if (wait) {
+            vkWaitForFences(pveDevice.device(), 1, &batch.fence, VK_TRUE, UINT64_MAX);
+            wait = false;
+        } else if (vkGetFenceStatus(pveDevice.device(), batch.fence) != VK_SUCCESS) {
+            break;
+        }
+
+        ringTail = batch.ringEnd;
+        freeBatchResources.push_back({batch.commandBuffer, batch.fence});
+        finishedBatches.push_back(std::move(batch));
+        submittedBatches.pop_front();
+    }
+}
+
+void PveUploadManager::update(VkCommandBuffer graphicsCommandBuffer) {
+    PVE_PROFILE_ZONE("PveUploadManager::update");
+    submit();
+    retireBatches(false);
+    if (finishedBatches.empty()) {
+        return;
+    }
+
+    if (hasDedicatedTransferQueue()) {
+        std::vector<VkBufferMemoryBarrier> acquireBarriers;
+        for (auto &batch : finishedBatches) {
+            acquireBarriers.insert(acquireBarriers.end(), batch.acquireBarriers.begin(),
+                                   batch.acquireBarriers.end());
+        }
+        // the fence already ordered the transfer before this, there's nothing to wait on
+        vkCmdPipelineBarrier(graphicsCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                             UPLOAD_READ_STAGES, 0, 0, nullptr,
+                             static_cast<uint32_t>(acquireBarriers.size()),
+                             acquireBarriers.data(), 0, nullptr);
+    } else {
+        VkMemoryBarrier uploadBarrier{};
+        uploadBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        uploadBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        uploadBarrier.dstAccessMask = UPLOAD_READ_ACCESS;
+        vkCmdPipelineBarrier(graphicsCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             UPLOAD_READ_STAGES, 0, 1, &uploadBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    for (auto &batch : finishedBatches) {
+        for (auto &promise : batch.promises) {
+            promise.set_value();
+        }
+    }
+    finishedBatches.clear();
+}
+
+}  // namespace pve
@@ -0,0 +1,66 @@
+#include "pve/pve_vertex.hpp"
+
+// libs
+#include <glm/gtc/packing.hpp>
+
+namespace pve {
+
+static_assert(sizeof(PveCompactVertex) == 20, "PveCompactVertex must stay tightly packed");
+
+// the octahedron |x| + |y| + |z| = 1 unfolded onto the square [-1, 1]^2, the lower half is
+// folded over the corners. Matches octDecode in the vertex shaders
+static glm::vec2 octEncode(const glm::vec3 &normal) {
+    float length = glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z);
+    // a mesh without normals gets +z rather than a NaN
+    if (length == 0.f) {
+        return glm::vec2{0.f};
+    }
+    glm::vec2 encoded = glm::vec2{normal} / length;
+    if (normal.z < 0.f) {
+        glm::vec2 sign{encoded.x >= 0.f ? 1.f : -1.f, encoded.y >= 0.f ? 1.f : -1.f};
+        encoded = (1.f - glm::abs(glm::vec2{encoded.y, encoded.x})) * sign;
+    }
+    return encoded;
+}
+
+static uint16_t quantizeUnorm16(float value) {
+    return static_cast<uint16_t>(glm::round(glm::clamp(value, 0.f, 1.f) * 65535.f));
+}
+
+static int16_t quantizeSnorm16(float value) {
+    return static_cast<int16_t>(glm::round(glm::clamp(value, -1.f, 1.f) * 32767.f));
+}
+
+PveCompactVertex PveVertexTraits<PveCompactVertex>::pack(const PveVertex &vertex,
+                                                         const PveBounds &bounds) {
+    PveCompactVertex packed{};
+    glm::vec3 extent = bounds.aabbMax - bounds.aabbMin;
+    for (int axis = 0; axis < 3; axis++) {
+        // a flat axis stores 0, its scale is 0 anyway
+        float fraction = extent[axis] > 0.f
+                             ? (vertex.position[axis] - bounds.aabbMin[axis]) / extent[axis]
+                             : 0.f;
+        packed.position[axis] = quantizeUnorm16(fraction);
+    }
+    for (int channel = 0; channel < 3; channel++) {
+        packed.color[channel] = static_cast<uint8_t>(
+            glm::round(glm::clamp(vertex.color[channel], 0.f, 1.f) * 255.f));
+    }
+    packed.color[3] = 255;
+    glm::vec2 normal = octEncode(vertex.normal);
+    packed.normal[0] = quantizeSnorm16(normal.x);
+    packed.normal[1] = quantizeSnorm16(normal.y);
+    packed.uv[0] = glm::packHalf1x16(vertex.uv.x);
+    packed.uv[1] = glm::packHalf1x16(vertex.uv.y);
+    return packed;
+}
+
+PvePositionDequantization PveVertexTraits<PveCompactVertex>::dequantization(
+    const PveBounds &bounds) {
+    PvePositionDequantization dequantization{};
+    dequantization.offset = glm::vec4{bounds.aabbMin, 0.f};
+    dequantization.scale = glm::vec4{bounds.aabbMax - bounds.aabbMin, 1.f};
+    return dequantization;
+}
+
+}  // namespace pve
@@ -4,11 +4,17 @@
 
 namespace pve {
 
-PveWindow::PveWindow(int w, int h, std::string name) : width{w}, height{h}, windowName{name} {
-    initWindow();
+PveWindow::PveWindow(int w, int h, std::string name, bool headless)
+    : width{w}, height{h}, headless{headless}, windowName{name} {
+    if (!headless) {
+        initWindow();
+    }
 }
 
 PveWindow::~PveWindow() {
+    if (headless) {
+        return;
+    }
     glfwDestroyWindow(window);
     glfwTerminate();
 }
@@ -31,6 +37,9 @@ void PveWindow::initWindow() {
 }
 
 void PveWindow::createWindowSurface(VkInstance instance, VkSurfaceKHR *surface) {
+    if (headless) {
+        throw std::runtime_error("headless window has no surface");
+    }
     if (glfwCreateWindowSurface(instance, window, nullptr, surface) != VK_SUCCESS) {
         throw std::runtime_error("failed to create window surface");
     }
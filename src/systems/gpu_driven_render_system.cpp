@@ -0,0 +1,334 @@
+#include "systems/gpu_driven_render_system.hpp"
+
+#include "pve/pve_frustum.hpp"
+#include "pve/pve_profiler.hpp"
+#include "pve/pve_swap_chain.hpp"
+
+#define GLM_FORCE_RADIANS            // No matter what system i'm in, angles are in radians, not degrees
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE  // Forces GLM to expect depth buffer values to range from 0 to 1 instead of -1 to 1 (the opengl standard)
+#include <cassert>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <stdexcept>
+
+namespace pve {
+
+// these mirror the std430 structs in cull.comp and gpu_driven.vert
+struct GpuObjectData {
+    glm::mat4 modelMatrix{1.f};
+    glm::mat4 normalMatrix{1.f};
+    glm::vec4 boundingSphere{};
+    PvePositionDequantization dequantization;
+    uint32_t meshIndex;
+    uint32_t materialIndex;
+    uint32_t padding[2];
+};
+
+struct GpuMeshData {
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t padding;
+};
+
+struct CullPushConstants {
+    glm::vec4 frustumPlanes[PveFrustum::PLANE_COUNT];
+    uint32_t objectCount;
+    uint32_t compactDraws;
+};
+
+static constexpr uint32_t CULL_WORKGROUP_SIZE = 64;
+
+GpuDrivenRenderSystem::GpuDrivenRenderSystem(
+    PveDevice &device,
+    VkRenderPass renderPass,
+    VkDescriptorSetLayout globalSetLayout,
+    PveMaterialLibrary &materialLibrary,
+    uint32_t maxObjects)
+    : pveDevice{device}, materialLibrary{materialLibrary}, maxObjects{maxObjects} {
+    // each draw finds its object through firstInstance
+    if (!pveDevice.getEnabledFeatures().drawIndirectFirstInstance) {
+        throw std::runtime_error("GPU driven rendering needs drawIndirectFirstInstance");
+    }
+    if (pveDevice.isExtensionEnabled(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+        cmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+            vkGetDeviceProcAddr(pveDevice.device(), "vkCmdDrawIndexedIndirectCountKHR"));
+    }
+
+    createDescriptors();
+    createPipelineLayouts(globalSetLayout);
+    createPipelines(renderPass);
+}
+
+GpuDrivenRenderSystem::~GpuDrivenRenderSystem() {
+    vkDestroyPipelineLayout(pveDevice.device(), cullPipelineLayout, nullptr);
+    vkDestroyPipelineLayout(pveDevice.device(), renderPipelineLayout, nullptr);
+}
+
+void GpuDrivenRenderSystem::createDescriptors() {
+    const uint32_t frameCount = PveSwapChain::MAX_FRAMES_IN_FLIGHT;
+
+    // a cull set and an object set per frame
+    descriptorAllocator = std::make_unique<PveDescriptorAllocator>(
+        pveDevice, frameCount * 2,
+        std::vector<PveDescriptorAllocator::PoolSizeRatio>{
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.5f}});
+
+    cullSetLayout = PveDescriptorSetLayout::Builder(pveDevice)
+                        .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+                        .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+                        .addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+                        .addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+                        .build();
+
+    objectSetLayout = PveDescriptorSetLayout::Builder(pveDevice)
+                          .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+                          .build();
+
+    objectBuffers.resize(frameCount);
+    meshBuffers.resize(frameCount);
+    drawCommandBuffers.resize(frameCount);
+    drawCountBuffers.resize(frameCount);
+    cullDescriptorSets.resize(frameCount);
+    objectDescriptorSets.resize(frameCount);
+    objectCounts.assign(frameCount, 0);
+
+    for (uint32_t i = 0; i < frameCount; i++) {
+        // objects and meshes are written by the CPU every frame
+        objectBuffers[i] = std::make_unique<PveBuffer>(
+            pveDevice, sizeof(GpuObjectData), maxObjects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        objectBuffers[i]->map();
+        meshBuffers[i] = std::make_unique<PveBuffer>(
+            pveDevice, sizeof(GpuMeshData), maxObjects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        meshBuffers[i]->map();
+
+        // the draws never leave the GPU
+        drawCommandBuffers[i] = std::make_unique<PveBuffer>(
+            pveDevice, sizeof(VkDrawIndexedIndirectCommand), maxObjects,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        // the count is read back for the visible and culled stats
+        drawCountBuffers[i] = std::make_unique<PveBuffer>(
+            pveDevice, sizeof(uint32_t), 1,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        drawCountBuffers[i]->map();
+        *static_cast<uint32_t *>(drawCountBuffers[i]->getMappedMemory()) = 0;
+
+        auto objectInfo = objectBuffers[i]->descriptorInfo();
+        auto meshInfo = meshBuffers[i]->descriptorInfo();
+        auto drawCommandInfo = drawCommandBuffers[i]->descriptorInfo();
+        auto drawCountInfo = drawCountBuffers[i]->descriptorInfo();
+        PveDescriptorWriter(*cullSetLayout, *descriptorAllocator)
+            .writeBuffer(0, &objectInfo)
+            .writeBuffer(1, &meshInfo)
+            .writeBuffer(2, &drawCommandInfo)
+            .writeBuffer(3, &drawCountInfo)
+            .build(cullDescriptorSets[i]);
+        PveDescriptorWriter(*objectSetLayout, *descriptorAllocator)
+            .writeBuffer(0, &objectInfo)
+            .build(objectDescriptorSets[i]);
+    }
+}
+
+void GpuDrivenRenderSystem::createPipelineLayouts(VkDescriptorSetLayout globalSetLayout) {
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullPushConstants);
+
+    VkDescriptorSetLayout cullLayouts[] = {cullSetLayout->getDescriptorSetLayout()};
+    VkPipelineLayoutCreateInfo cullLayoutInfo{};
+    cullLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    cullLayoutInfo.setLayoutCount = 1;
+    cullLayoutInfo.pSetLayouts = cullLayouts;
+    cullLayoutInfo.pushConstantRangeCount = 1;
+    cullLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(pveDevice.device(), &cullLayoutInfo, nullptr,
+                               &cullPipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout");
+    }
+
+    // the materials sit between the global set and the objects, where simple_shader.frag
+    // expects them
+    std::vector<VkDescriptorSetLayout> descriptorSetLayouts{
+        globalSetLayout, materialLibrary.getSetLayout(),
+        objectSetLayout->getDescriptorSetLayout()};
+    VkPipelineLayoutCreateInfo renderLayoutInfo{};
+    renderLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    renderLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
+    renderLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
+    renderLayoutInfo.pushConstantRangeCount = 0;
+    renderLayoutInfo.pPushConstantRanges = nullptr;
+
+    if (vkCreatePipelineLayout(pveDevice.device(), &renderLayoutInfo, nullptr,
+                               &renderPipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout");
+    }
+}
+
+void GpuDrivenRenderSystem::createPipelines(VkRenderPass renderPass) {
+    assert(renderPipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
+
+    cullPipeline = std::make_unique<PvePipeline>(pveDevice, "shaders/compiled/cull.comp.spv",
+                                                 cullPipelineLayout);
+
+    PipelineConfigInfo pipelineConfig{};
+    PvePipeline::defaultPipelineConfigInfo(pipelineConfig);
+    pipelineConfig.renderPass = renderPass;
+    pipelineConfig.pipelineLayout = renderPipelineLayout;
+    renderPipeline =
+        std::make_unique<PvePipeline>(pveDevice, "shaders/compiled/gpu_driven.vert.spv",
+                                      "shaders/compiled/simple_shader.frag.spv", pipelineConfig);
+}
+
+void GpuDrivenRenderSystem::update(FrameInfo &frameInfo) {
+    PVE_PROFILE_ZONE("GpuDrivenRenderSystem::update");
+    int frameIndex = frameInfo.frameIndex;
+
+    // this frame's fence has signaled, so the count written the last time these buffers were
+    // used is complete
+    visibleCount = *static_cast<uint32_t *>(drawCountBuffers[frameIndex]->getMappedMemory());
+    culledCount = objectCounts[frameIndex] - visibleCount;
+
+    // the mesh table is rebuilt from the models in use, streamed models come and go and a
+    // stale pointer could even be reused by a new one
+    meshes.clear();
+    meshIndices.clear();
+    auto objects = static_cast<GpuObjectData *>(objectBuffers[frameIndex]->getMappedMemory());
+    uint32_t objectCount = 0;
+    skippedCount = 0;
+    frameInfo.registry.view<ModelComponent, TransformComponent>().each(
+        [&](PveEntity entity, ModelComponent &modelComponent, TransformComponent &transform) {
+            PveModel *model = modelComponent.model.get();
+            if (model == nullptr || !model->isReady()) return;
+
+            // models that didn't fit in the arena have buffers of their own, and the buffers
+            // only hold maxObjects. Whatever can't be drawn indirectly is left out and counted
+            if (objectCount == maxObjects) {
+                skippedCount++;
+                return;
+            }
+            auto mesh = meshIndices.find(model);
+            if (mesh == meshIndices.end()) {
+                if (model->getGeometryArena() == nullptr ||
+                    (geometryArena != nullptr && model->getGeometryArena() != geometryArena)) {
+                    skippedCount++;
+                    return;
+                }
+                geometryArena = model->getGeometryArena();
+                mesh = meshIndices.emplace(model, static_cast<uint32_t>(meshes.size())).first;
+                meshes.push_back(model);
+            }
+
+            auto &bounds = model->getBounds();
+            GpuObjectData &object = objects[objectCount++];
+            object.modelMatrix = transform.mat4();
+            object.normalMatrix = transform.normalMatrix();
+            object.boundingSphere = glm::vec4(bounds.sphereCenter, bounds.sphereRadius);
+            object.dequantization = model->getDequantization();
+            object.meshIndex = mesh->second;
+            auto material = frameInfo.registry.tryGet<MaterialComponent>(entity);
+            object.materialIndex = material != nullptr ? material->materialIndex
+                                                       : PveMaterialLibrary::DEFAULT_MATERIAL;
+        });
+    objectCounts[frameIndex] = objectCount;
+
+    // one entry per distinct model, so rewriting the whole table is cheap
+    auto meshData = static_cast<GpuMeshData *>(meshBuffers[frameIndex]->getMappedMemory());
+    for (size_t i = 0; i < meshes.size(); i++) {
+        auto &range = meshes[i]->getGeometryRange();
+        meshData[i].indexCount = range.indexCount;
+        meshData[i].firstIndex = range.firstIndex;
+        meshData[i].vertexOffset = static_cast<int32_t>(range.firstVertex);
+    }
+}
+
+void GpuDrivenRenderSystem::cull(FrameInfo &frameInfo) {
+    int frameIndex = frameInfo.frameIndex;
+    VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+
+    vkCmdFillBuffer(commandBuffer, drawCountBuffers[frameIndex]->getBuffer(), 0,
+                    sizeof(uint32_t), 0);
+
+    VkMemoryBarrier resetBarrier{};
+    resetBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &resetBarrier, 0, nullptr,
+                         0, nullptr);
+
+    uint32_t objectCount = objectCounts[frameIndex];
+    if (objectCount > 0) {
+        PveFrustum frustum = PveFrustum::fromCamera(frameInfo.camera);
+        CullPushConstants push{};
+        for (int i = 0; i < PveFrustum::PLANE_COUNT; i++) {
+            push.frustumPlanes[i] = frustum.planes[i];
+        }
+        push.objectCount = objectCount;
+        push.compactDraws = cmdDrawIndexedIndirectCount != nullptr ? 1 : 0;
+
+        cullPipeline->bind(commandBuffer);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout,
+                                0, 1, &cullDescriptorSets[frameIndex], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(CullPushConstants), &push);
+        vkCmdDispatch(commandBuffer, (objectCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE,
+                      1, 1);
+    }
+
+    // the draws are consumed by the render pass, the count is also read back by the host
+    VkMemoryBarrier cullBarrier{};
+    cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+                         &cullBarrier, 0, nullptr, 0, nullptr);
+}
+
+void GpuDrivenRenderSystem::render(FrameInfo &frameInfo) {
+    int frameIndex = frameInfo.frameIndex;
+    uint32_t objectCount = objectCounts[frameIndex];
+    if (objectCount == 0) {
+        return;
+    }
+
+    renderPipeline->bind(frameInfo.commandBuffer);
+    VkDescriptorSet descriptorSets[] = {frameInfo.globalDescriptorSet,
+                                        materialLibrary.getDescriptorSet(),
+                                        objectDescriptorSets[frameIndex]};
+    vkCmdBindDescriptorSets(
+        frameInfo.commandBuffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        renderPipelineLayout,
+        0,
+        3,
+        descriptorSets,
+        1,
+        &frameInfo.globalUboOffset);
+    geometryArena->bind(frameInfo.commandBuffer);
+
+    VkBuffer drawCommands = drawCommandBuffers[frameIndex]->getBuffer();
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    if (cmdDrawIndexedIndirectCount != nullptr) {
+        cmdDrawIndexedIndirectCount(frameInfo.commandBuffer, drawCommands, 0,
+                                    drawCountBuffers[frameIndex]->getBuffer(), 0, objectCount,
+                                    stride);
+    } else if (pveDevice.getEnabledFeatures().multiDrawIndirect) {
+        vkCmdDrawIndexedIndirect(frameInfo.commandBuffer, drawCommands, 0, objectCount, stride);
+    } else {
+        // without multiDrawIndirect each indirect draw can only read one command
+        for (uint32_t i = 0; i < objectCount; i++) {
+            vkCmdDrawIndexedIndirect(frameInfo.commandBuffer, drawCommands, i * stride, 1, stride);
+        }
+    }
+}
+
+}  // namespace pve
@@ -0,0 +1,101 @@
+#include "systems/light_cluster_system.hpp"
+
+#include "pve/pve_swap_chain.hpp"
+
+#define GLM_FORCE_RADIANS            // No matter what system i'm in, angles are in radians, not degrees
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE  // Forces GLM to expect depth buffer values to range from 0 to 1 instead of -1 to 1 (the opengl standard)
+#include <cassert>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <stdexcept>
+
+namespace pve {
+
+static constexpr uint32_t CLUSTER_WORKGROUP_SIZE = 64;
+
+LightClusterSystem::LightClusterSystem(PveDevice &device, VkDescriptorSetLayout globalSetLayout)
+    : pveDevice{device} {
+    clusterLightCountBuffers.resize(PveSwapChain::MAX_FRAMES_IN_FLIGHT);
+    clusterLightIndexBuffers.resize(PveSwapChain::MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < PveSwapChain::MAX_FRAMES_IN_FLIGHT; i++) {
+        clusterLightCountBuffers[i] = std::make_unique<PveBuffer>(
+            pveDevice, sizeof(uint32_t), CLUSTER_COUNT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        clusterLightIndexBuffers[i] = std::make_unique<PveBuffer>(
+            pveDevice, sizeof(uint32_t), CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+
+    createPipelineLayout(globalSetLayout);
+    createPipeline();
+}
+
+LightClusterSystem::~LightClusterSystem() {
+    vkDestroyPipelineLayout(pveDevice.device(), pipelineLayout, nullptr);
+}
+
+void LightClusterSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
+    // everything the pass needs is in the global set
+    std::vector<VkDescriptorSetLayout> descriptorSetLayouts{globalSetLayout};
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = nullptr;
+
+    if (vkCreatePipelineLayout(pveDevice.device(), &pipelineLayoutInfo, nullptr,
+                               &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout");
+    }
+}
+
+void LightClusterSystem::createPipeline() {
+    assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
+    pvePipeline = std::make_unique<PvePipeline>(
+        pveDevice, "shaders/compiled/cluster_lights.comp.spv", pipelineLayout);
+}
+
+void LightClusterSystem::update(const PveCamera &camera, VkExtent2D extent, GlobalUbo &ubo) {
+    // recovered from PveCamera::setPerspectiveProjection's matrix:
+    // [2][2] = far / (far - near) and [3][2] = -(far * near) / (far - near)
+    const glm::mat4 &projection = camera.getProjection();
+    assert(projection[2][3] == 1.f && "Light clusters need a perspective projection");
+    float near = -projection[3][2] / projection[2][2];
+    float far = projection[3][2] / (1.f - projection[2][2]);
+
+    ubo.clusterCounts.x = CLUSTER_COUNT_X;
+    ubo.clusterCounts.y = CLUSTER_COUNT_Y;
+    ubo.clusterCounts.z = CLUSTER_COUNT_Z;
+    ubo.clusterParams.x = std::ceil(static_cast<float>(extent.width) / CLUSTER_COUNT_X);
+    ubo.clusterParams.y = std::ceil(static_cast<float>(extent.height) / CLUSTER_COUNT_Y);
+    ubo.framebufferSize.x = static_cast<float>(extent.width);
+    ubo.framebufferSize.y = static_cast<float>(extent.height);
+    // slice = log(depth) * scale - bias puts slice 0 at the near plane and the last one
+    // ending at the far plane, each one deeper than the last by the same ratio
+    float logDepthRange = std::log(far / near);
+    ubo.clusterParams.z = CLUSTER_COUNT_Z / logDepthRange;
+    ubo.clusterParams.w = CLUSTER_COUNT_Z * std::log(near) / logDepthRange;
+}
+
+void LightClusterSystem::assignLights(FrameInfo &frameInfo) {
+    VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+
+    pvePipeline->bind(commandBuffer);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1,
+                            &frameInfo.globalDescriptorSet, 1, &frameInfo.globalUboOffset);
+    vkCmdDispatch(commandBuffer,
+                  (CLUSTER_COUNT + CLUSTER_WORKGROUP_SIZE - 1) / CLUSTER_WORKGROUP_SIZE, 1, 1);
+
+    // the lists are read by the fragment shaders in the render pass that follows
+    VkMemoryBarrier assignBarrier{};
+    assignBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    assignBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    assignBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &assignBarrier, 0, nullptr,
+                         0, nullptr);
+}
+
+}  // namespace pve
@@ -1,27 +1,66 @@
 #include "systems/point_light_system.hpp"
 
+#include "pve/pve_profiler.hpp"
+#include "pve/pve_swap_chain.hpp"
+
 #define GLM_FORCE_RADIANS  // No matter what system i'm in, angles are in radians, not degrees
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE  // Forces GLM to expect depth buffer values to range from 0 to 1 instead of -1 to 1 (the opengl standard)
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cstring>
+#include <functional>
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
-#include <map>
 #include <stdexcept>
 
 namespace pve {
 
-struct PointLightPushConstants {
-    glm::vec4 position{};
-    glm::vec4 color{};
-    float radius;
+// one billboard, fed to the vertex shader through an instance rate vertex binding
+struct PointLightInstanceData {
+    glm::vec4 position{};  // w is the billboard's radius
+    glm::vec4 color{};     // w is intensity
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(PointLightInstanceData);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+        return bindingDescription;
+    }
+
+    static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions() {
+        return {
+            {0, 0, VK_FORMAT_R32G32B32A32_SFLOAT,
+             static_cast<uint32_t>(offsetof(PointLightInstanceData, position))},
+            {1, 0, VK_FORMAT_R32G32B32A32_SFLOAT,
+             static_cast<uint32_t>(offsetof(PointLightInstanceData, color))},
+        };
+    }
 };
 
+// a light's reach is where its unwindowed attenuation falls below this
+static constexpr float LIGHT_CUTOFF = 0.005f;
+
 PointLightSystem::PointLightSystem(PveDevice &device, VkRenderPass renderPass,
-                                   VkDescriptorSetLayout globalSetLayout)
-    : pveDevice{device} {
+                                   VkDescriptorSetLayout globalSetLayout, uint32_t maxLights)
+    : pveDevice{device}, maxLights{maxLights} {
     createPipelineLayout(globalSetLayout);
     createPipeline(renderPass);
+
+    lightBuffer = std::make_unique<PveBuffer>(
+        pveDevice, sizeof(PointLight), maxLights,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    // big enough for every light to change in the same frame
+    stagingBuffers.resize(PveSwapChain::MAX_FRAMES_IN_FLIGHT);
+    for (auto &stagingBuffer : stagingBuffers) {
+        stagingBuffer = std::make_unique<PveBuffer>(pveDevice, sizeof(PointLight), maxLights,
+                                                    VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+        stagingBuffer->map();
+    }
 }
 
 PointLightSystem::~PointLightSystem() {
@@ -29,12 +68,7 @@ PointLightSystem::~PointLightSystem() {
 }
 
 void PointLightSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
-    VkPushConstantRange pushConstantRange{};
-    pushConstantRange.stageFlags =
-        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-    pushConstantRange.offset = 0;
-    pushConstantRange.size = sizeof(PointLightPushConstants);
-
+    // every billboard comes in through the instance buffer, so there are no push constants
     std::vector<VkDescriptorSetLayout> descriptorSetLayouts{globalSetLayout};
 
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
@@ -42,8 +76,8 @@ void PointLightSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayou
     pipelineLayoutInfo.setLayoutCount =
         static_cast<uint32_t>(descriptorSetLayouts.size());
     pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
     if (vkCreatePipelineLayout(pveDevice.device(), &pipelineLayoutInfo, nullptr,
                                &pipelineLayout) != VK_SUCCESS) {
@@ -58,9 +92,9 @@ void PointLightSystem::createPipeline(VkRenderPass renderPass) {
     PvePipeline::defaultPipelineConfigInfo(pipelineConfig);
     PvePipeline::enableAlphaBlending(pipelineConfig);
 
-    // Point light system doesn't need vertex data
-    pipelineConfig.attributeDescriptions.clear();
-    pipelineConfig.bindingDescriptions.clear();
+    // the quad's corners come from the vertex index, the only vertex data is per instance
+    pipelineConfig.bindingDescriptions = {PointLightInstanceData::getBindingDescription()};
+    pipelineConfig.attributeDescriptions = PointLightInstanceData::getAttributeDescriptions();
 
     // a render pass describes the structure and format of our frame buffer objects and their attachments
     // it's a blueprint that tells a graphics pipeline object what layout to expect from the output frame buffer
@@ -74,58 +108,249 @@ void PointLightSystem::createPipeline(VkRenderPass renderPass) {
         "shaders/compiled/point_light.frag.spv", pipelineConfig);
 }
 
+void PointLightSystem::releaseSlots(PveRegistry &registry) {
+    auto &lightPool = registry.pool<PointLightComponent>();
+    auto &transformPool = registry.pool<TransformComponent>();
+    auto &colorPool = registry.pool<ColorComponent>();
+    // slots only go stale when a component is added or removed somewhere in these pools
+    if (lightPool.getVersion() == lightPoolVersion &&
+        transformPool.getVersion() == transformPoolVersion &&
+        colorPool.getVersion() == colorPoolVersion) {
+        return;
+    }
+    lightPoolVersion = lightPool.getVersion();
+    transformPoolVersion = transformPool.getVersion();
+    colorPoolVersion = colorPool.getVersion();
+
+    for (uint32_t slot = 0; slot < slots.size(); slot++) {
+        PveEntity entity = slots[slot].entity;
+        if (entity == PVE_NULL_ENTITY) continue;
+        if (lightPool.contains(entity) && transformPool.contains(entity) &&
+            colorPool.contains(entity)) {
+            continue;
+        }
+        // the hole is uploaded with a negative reach so the clusters skip it
+        slots[slot] = LightSlot{};
+        freeSlots.push_back(slot);
+        dirtyLights.push_back({slot, {glm::vec4(0.f, 0.f, 0.f, -1.f), glm::vec4(0.f)}});
+    }
+
+    // free slots at the end are dropped so the shaders don't loop over them
+    while (!slots.empty() && slots.back().entity == PVE_NULL_ENTITY) {
+        slots.pop_back();
+    }
+    uint32_t slotCount = static_cast<uint32_t>(slots.size());
+    freeSlots.erase(std::remove_if(freeSlots.begin(), freeSlots.end(),
+                                   [slotCount](uint32_t slot) { return slot >= slotCount; }),
+                    freeSlots.end());
+    // highest first, so the lowest free slot is handed out next and the list stays dense
+    std::sort(freeSlots.begin(), freeSlots.end(), std::greater<uint32_t>());
+}
+
+uint32_t PointLightSystem::acquireSlot(PveEntity entity) {
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        slot = static_cast<uint32_t>(slots.size());
+        slots.emplace_back();
+    }
+    slots[slot].entity = entity;
+
+    uint32_t index = entityIndex(entity);
+    if (index >= entitySlots.size()) {
+        entitySlots.resize(index + 1, ~0u);
+    }
+    entitySlots[index] = slot;
+    return slot;
+}
+
 void PointLightSystem::update(FrameInfo &frameInfo, GlobalUbo &ubo) {
-    auto rotateLight =
-        glm::rotate(glm::mat4(1.f), frameInfo.frameTime, glm::vec3(0.f, -1.f, 0.f));
-    int lightIndex = 0;
-    for (auto &kv : frameInfo.gameObjects) {
-        auto &obj = kv.second;
-        if (obj.pointLight == nullptr) continue;
-        assert(lightIndex < MAX_LIGHTS && "Point light index out of bounds");
-
-        // update light position
-        // obj.transform.translation =
-        //     glm::vec3(rotateLight * glm::vec4(obj.transform.translation, 1.f));
-
-        // copy light data to ubo
-        ubo.pointLights[lightIndex].position = glm::vec4(obj.transform.translation, 1.f);
-        ubo.pointLights[lightIndex].color =
-            glm::vec4(obj.color, obj.pointLight->lightIntensity);
-        lightIndex++;
+    PVE_PROFILE_ZONE("PointLightSystem::update");
+    releaseSlots(frameInfo.registry);
+
+    frameInfo.registry.view<PointLightComponent, TransformComponent, ColorComponent>().each(
+        [&](PveEntity entity, PointLightComponent &pointLight, TransformComponent &transform,
+            ColorComponent &color) {
+            uint32_t index = entityIndex(entity);
+            bool hasSlot = index < entitySlots.size() && entitySlots[index] < slots.size() &&
+                           slots[entitySlots[index]].entity == entity;
+            if (!hasSlot && slots.size() - freeSlots.size() == maxLights) {
+                assert(false && "Point light index out of bounds");
+                return;
+            }
+            uint32_t slot = hasSlot ? entitySlots[index] : acquireSlot(entity);
+
+            // mat4() first, so a transform that's still dirty bumps its version now
+            const glm::mat4 &worldMatrix = transform.mat4();
+            glm::vec4 lightColor{color.color, pointLight.lightIntensity};
+            LightSlot &lightSlot = slots[slot];
+            if (hasSlot && lightSlot.worldVersion == transform.getWorldVersion() &&
+                lightSlot.color == lightColor) {
+                return;
+            }
+            lightSlot.worldVersion = transform.getWorldVersion();
+            lightSlot.color = lightColor;
+
+            // the clusters need a finite reach, intensity / distance^2 never reaches zero
+            const glm::vec3 &rgb = color.color;
+            float brightest = pointLight.lightIntensity * glm::max(rgb.x, glm::max(rgb.y, rgb.z));
+            float reach = glm::sqrt(brightest / LIGHT_CUTOFF);
+            dirtyLights.push_back(
+                {slot, {glm::vec4(glm::vec3(worldMatrix[3]), reach), lightColor}});
+        });
+    ubo.clusterCounts.w = static_cast<uint32_t>(slots.size());
+
+    recordUploads(frameInfo);
+}
+
+void PointLightSystem::recordUploads(FrameInfo &frameInfo) {
+    uploadedCount = static_cast<uint32_t>(dirtyLights.size());
+    if (dirtyLights.empty()) {
+        return;
+    }
+
+    // a slot freed and taken again in the same frame shows up twice, the later entry wins
+    std::stable_sort(dirtyLights.begin(), dirtyLights.end(),
+                     [](const DirtyLight &a, const DirtyLight &b) { return a.slot < b.slot; });
+
+    // the changed lights are packed into the staging buffer, with one copy per run of
+    // neighbouring slots
+    auto &stagingBuffer = stagingBuffers[frameInfo.frameIndex];
+    auto staged = static_cast<PointLight *>(stagingBuffer->getMappedMemory());
+    uint32_t stagedCount = 0;
+    copyRegions.clear();
+    for (size_t i = 0; i < dirtyLights.size(); i++) {
+        if (i + 1 < dirtyLights.size() && dirtyLights[i + 1].slot == dirtyLights[i].slot) {
+            continue;
+        }
+        uint32_t slot = dirtyLights[i].slot;
+        VkDeviceSize dstOffset = static_cast<VkDeviceSize>(slot) * sizeof(PointLight);
+        if (!copyRegions.empty() &&
+            copyRegions.back().dstOffset + copyRegions.back().size == dstOffset) {
+            copyRegions.back().size += sizeof(PointLight);
+        } else {
+            copyRegions.push_back({static_cast<VkDeviceSize>(stagedCount) * sizeof(PointLight),
+                                   dstOffset, sizeof(PointLight)});
+        }
+        staged[stagedCount++] = dirtyLights[i].light;
+    }
+    dirtyLights.clear();
+    uploadedCount = stagedCount;
+
+    // only the written part is flushed, rounded out to what the device can flush
+    VkDeviceSize atomSize = pveDevice.properties.limits.nonCoherentAtomSize;
+    VkDeviceSize stagedSize = stagedCount * sizeof(PointLight);
+    VkDeviceSize flushSize = (stagedSize + atomSize - 1) / atomSize * atomSize;
+    stagingBuffer->flush(flushSize < stagingBuffer->getBufferSize() ? flushSize : VK_WHOLE_SIZE);
+
+    // earlier frames may still be reading the slots that are about to be overwritten
+    VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+    const VkPipelineStageFlags shaderStages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                                              VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    vkCmdPipelineBarrier(commandBuffer, shaderStages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                         nullptr, 0, nullptr, 0, nullptr);
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer->getBuffer(), lightBuffer->getBuffer(),
+                    static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+
+    VkMemoryBarrier uploadBarrier{};
+    uploadBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    uploadBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    uploadBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, shaderStages, 0, 1,
+                         &uploadBarrier, 0, nullptr, 0, nullptr);
+}
+
+void PointLightSystem::sortBackToFront() {
+    const uint32_t count = static_cast<uint32_t>(sortKeys.size());
+    sortKeysScratch.resize(count);
+    sortOrderScratch.resize(count);
+
+    // LSD radix sort, 8 bits per pass. A pass where every key has the same digit doesn't
+    // move anything and is skipped, which drops most of the high byte passes in practice
+    uint32_t *keys = sortKeys.data();
+    uint32_t *order = sortOrder.data();
+    uint32_t *keysOut = sortKeysScratch.data();
+    uint32_t *orderOut = sortOrderScratch.data();
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+        std::array<uint32_t, 256> counts{};
+        for (uint32_t i = 0; i < count; i++) {
+            counts[(keys[i] >> shift) & 0xff]++;
+        }
+        if (counts[(keys[0] >> shift) & 0xff] == count) continue;
+
+        uint32_t offset = 0;
+        for (auto &bucket : counts) {
+            uint32_t bucketCount = bucket;
+            bucket = offset;
+            offset += bucketCount;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t destination = counts[(keys[i] >> shift) & 0xff]++;
+            keysOut[destination] = keys[i];
+            orderOut[destination] = order[i];
+        }
+        std::swap(keys, keysOut);
+        std::swap(order, orderOut);
+    }
+
+    // an odd number of passes leaves the result in the scratch arrays
+    if (order != sortOrder.data()) {
+        sortOrder.swap(sortOrderScratch);
     }
-    ubo.numLights = lightIndex;
 }
 
 void PointLightSystem::render(FrameInfo &frameInfo) {
-    // sort lights by distance to camera to make transparency work
-    std::map<float, PveGameObject::id_t> sorted;
-    for (auto &kv : frameInfo.gameObjects) {
-        auto &obj = kv.second;
-        if (obj.pointLight == nullptr) continue;
-        auto offset = frameInfo.camera.getPosition() - obj.transform.translation;
-        float disSquared = glm::dot(offset, offset);
-        sorted[disSquared] = obj.getId();
+    billboards.clear();
+    sortKeys.clear();
+    sortOrder.clear();
+    const glm::vec3 cameraPosition = frameInfo.camera.getPosition();
+    frameInfo.registry.view<PointLightComponent, TransformComponent, ColorComponent>().each(
+        [&](PveEntity, PointLightComponent &pointLight, TransformComponent &transform,
+            ColorComponent &color) {
+            glm::vec3 position{transform.mat4()[3]};
+            auto offset = cameraPosition - position;
+            float disSquared = glm::dot(offset, offset);
+
+            // a non negative float's bits sort in the same order as its value, they're
+            // inverted so the farthest light comes first
+            uint32_t key;
+            std::memcpy(&key, &disSquared, sizeof(key));
+            sortKeys.push_back(~key);
+            sortOrder.push_back(static_cast<uint32_t>(billboards.size()));
+            billboards.push_back({glm::vec4(position, transform.getScale().x),
+                                  glm::vec4(color.color, pointLight.lightIntensity)});
+        });
+    if (billboards.empty()) {
+        return;
+    }
+
+    // back to front to make transparency work. Lights at the same distance just end up
+    // next to each other
+    sortBackToFront();
+
+    const uint32_t billboardCount = static_cast<uint32_t>(billboards.size());
+    // only read by this frame's draw, so it goes in the frame's transient memory
+    auto allocation = frameInfo.frameAllocator->allocate(
+        sizeof(PointLightInstanceData) * billboardCount, alignof(PointLightInstanceData));
+    auto instances = static_cast<PointLightInstanceData *>(allocation.mapped);
+    for (uint32_t i = 0; i < billboardCount; i++) {
+        const Billboard &billboard = billboards[sortOrder[i]];
+        instances[i].position = billboard.position;
+        instances[i].color = billboard.color;
     }
 
     pvePipeline->bind(frameInfo.commandBuffer);
     vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            pipelineLayout, 0, 1, &frameInfo.globalDescriptorSet, 0,
-                            nullptr);
-    // iterate through sorted lights in reverse order since we render from back to front
-    for (auto it = sorted.rbegin(); it != sorted.rend(); it++) {
-        auto &obj = frameInfo.gameObjects.at(it->second);
-
-        PointLightPushConstants pushConstantData{};
-        pushConstantData.position = glm::vec4(obj.transform.translation, 1.f);
-        pushConstantData.color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
-        pushConstantData.radius = obj.transform.scale.x;
-
-        vkCmdPushConstants(frameInfo.commandBuffer, pipelineLayout,
-                           VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
-                           sizeof(PointLightPushConstants), &pushConstantData);
-
-        vkCmdDraw(frameInfo.commandBuffer, 6, 1, 0, 0);
-    }
+                            pipelineLayout, 0, 1, &frameInfo.globalDescriptorSet, 1,
+                            &frameInfo.globalUboOffset);
+    VkBuffer buffers[] = {frameInfo.frameAllocator->getBuffer()};
+    VkDeviceSize offsets[] = {allocation.offset};
+    vkCmdBindVertexBuffers(frameInfo.commandBuffer, 0, 1, buffers, offsets);
+    // six vertices make a quad, every light is one instance of it
+    vkCmdDraw(frameInfo.commandBuffer, 6, billboardCount, 0, 0);
 }
 
 }  // namespace pve
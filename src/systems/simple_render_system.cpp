@@ -1,7 +1,11 @@
 #include "systems/simple_render_system.hpp"
 
+#include "pve/pve_swap_chain.hpp"
+#include "pve/pve_profiler.hpp"
+
 #define GLM_FORCE_RADIANS            // No matter what system i'm in, angles are in radians, not degrees
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE  // Forces GLM to expect depth buffer values to range from 0 to 1 instead of -1 to 1 (the opengl standard)
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <glm/glm.hpp>
@@ -10,15 +14,52 @@
 
 namespace pve {
 
-struct SimplePushConstantData {
+// fed to the vertex shader through an instance rate vertex binding
+struct SimpleInstanceData {
     glm::mat4 modelMatrix{1.f};   // initialized as an identity matrix
     glm::mat4 normalMatrix{1.f};  // initialized as an identity matrix
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 1;
+        bindingDescription.stride = sizeof(SimpleInstanceData);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+        return bindingDescription;
+    }
+
+    // a mat4 attribute takes one location per column, locations 4 to 11
+    static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions() {
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
+        for (uint32_t column = 0; column < 4; column++) {
+            attributeDescriptions.push_back(
+                {4 + column, 1, VK_FORMAT_R32G32B32A32_SFLOAT,
+                 static_cast<uint32_t>(offsetof(SimpleInstanceData, modelMatrix) +
+                                       sizeof(glm::vec4) * column)});
+        }
+        for (uint32_t column = 0; column < 4; column++) {
+            attributeDescriptions.push_back(
+                {8 + column, 1, VK_FORMAT_R32G32B32A32_SFLOAT,
+                 static_cast<uint32_t>(offsetof(SimpleInstanceData, normalMatrix) +
+                                       sizeof(glm::vec4) * column)});
+        }
+        return attributeDescriptions;
+    }
+};
+
+// switches the model's position dequantization and the material between draws, everything
+// else is per instance
+struct SimplePushConstantData {
+    PvePositionDequantization dequantization;
+    uint32_t materialIndex;
 };
 
-SimpleRenderSystem::SimpleRenderSystem(PveDevice &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout)
-    : pveDevice{device} {
+SimpleRenderSystem::SimpleRenderSystem(PveDevice &device, VkRenderPass renderPass,
+                                       VkDescriptorSetLayout globalSetLayout,
+                                       PveMaterialLibrary &materialLibrary)
+    : pveDevice{device}, materialLibrary{materialLibrary} {
     createPipelineLayout(globalSetLayout);
     createPipeline(renderPass);
+    instanceBuffers.resize(PveSwapChain::MAX_FRAMES_IN_FLIGHT);
 }
 
 SimpleRenderSystem::~SimpleRenderSystem() {
@@ -26,13 +67,15 @@ SimpleRenderSystem::~SimpleRenderSystem() {
 }
 
 void SimpleRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
+    // per object data comes in through the instance buffer, the push constant only carries
+    // what changes with the model and the material
     VkPushConstantRange pushConstantRange{};
-    pushConstantRange.stageFlags =
-        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     pushConstantRange.offset = 0;
     pushConstantRange.size = sizeof(SimplePushConstantData);
 
-    std::vector<VkDescriptorSetLayout> descriptorSetLayouts{globalSetLayout};
+    std::vector<VkDescriptorSetLayout> descriptorSetLayouts{globalSetLayout,
+                                                            materialLibrary.getSetLayout()};
 
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -59,42 +102,190 @@ void SimpleRenderSystem::createPipeline(VkRenderPass renderPass) {
     // multiple subpasses can be grouped together into a single render pass
     pipelineConfig.renderPass = renderPass;
     pipelineConfig.pipelineLayout = pipelineLayout;
+    pipelineConfig.bindingDescriptions.push_back(SimpleInstanceData::getBindingDescription());
+    auto instanceAttributes = SimpleInstanceData::getAttributeDescriptions();
+    pipelineConfig.attributeDescriptions.insert(pipelineConfig.attributeDescriptions.end(),
+                                                instanceAttributes.begin(),
+                                                instanceAttributes.end());
     pvePipeline =
         std::make_unique<PvePipeline>(pveDevice, "shaders/compiled/simple_shader.vert.spv",
                                       "shaders/compiled/simple_shader.frag.spv", pipelineConfig);
 }
 
-void SimpleRenderSystem::renderGameObjects(FrameInfo &frameInfo) {
-    pvePipeline->bind(frameInfo.commandBuffer);
+void SimpleRenderSystem::reserveInstances(int frameIndex, uint32_t instanceCount) {
+    auto &instanceBuffer = instanceBuffers[frameIndex];
+    if (instanceBuffer != nullptr && instanceBuffer->getInstanceCount() >= instanceCount) {
+        return;
+    }
+
+    // grow geometrically so a growing scene doesn't reallocate every frame
+    uint32_t capacity = instanceBuffer != nullptr ? instanceBuffer->getInstanceCount() : 64;
+    while (capacity < instanceCount) {
+        capacity *= 2;
+    }
+    instanceBuffer = std::make_unique<PveBuffer>(
+        pveDevice, sizeof(SimpleInstanceData), capacity, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    instanceBuffer->map();
+}
+
+void SimpleRenderSystem::renderGameObjects(FrameInfo &frameInfo, PveParallelRecorder *recorder) {
+    PVE_PROFILE_ZONE("SimpleRenderSystem::renderGameObjects");
+    // first pass: gather the world space bounding sphere of every object with a model
+    candidates.clear();
+    frustumCuller.clear();
+    frameInfo.registry.view<ModelComponent, TransformComponent>().each(
+        [&](PveEntity entity, ModelComponent &modelComponent, TransformComponent &transform) {
+            if (modelComponent.model == nullptr || !modelComponent.model->isReady()) return;
+
+            glm::mat4 modelMatrix = transform.mat4();
+            auto &bounds = modelComponent.model->getBounds();
+            // the largest axis scale keeps the sphere conservative under non uniform scaling
+            float scale = glm::max(glm::length(glm::vec3(modelMatrix[0])),
+                                   glm::max(glm::length(glm::vec3(modelMatrix[1])),
+                                            glm::length(glm::vec3(modelMatrix[2]))));
+            glm::vec3 center{modelMatrix * glm::vec4(bounds.sphereCenter, 1.f)};
+            frustumCuller.addSphere(center, bounds.sphereRadius * scale);
+            auto material = frameInfo.registry.tryGet<MaterialComponent>(entity);
+            uint32_t materialIndex = material != nullptr ? material->materialIndex
+                                                         : PveMaterialLibrary::DEFAULT_MATERIAL;
+            candidates.push_back(
+                {{modelComponent.model.get(), materialIndex}, &transform, modelMatrix});
+        });
+
+    // second pass: reject everything outside the frustum in one batch
+    cullingStats = frustumCuller.cull(PveFrustum::fromCamera(frameInfo.camera));
+    if (cullingStats.visibleCount == 0) {
+        return;
+    }
+
+    // third pass: count the visible instances of every model and material pair
+    for (auto &group : instanceGroups) {
+        group.second.instanceCount = 0;
+    }
+    for (uint32_t i = 0; i < candidates.size(); i++) {
+        if (!frustumCuller.isVisible(i)) continue;
+        instanceGroups[candidates[i].key].instanceCount++;
+    }
+
+    // groups with nothing visible are dropped, the rest get a contiguous slice
+    uint32_t firstInstance = 0;
+    for (auto it = instanceGroups.begin(); it != instanceGroups.end();) {
+        if (it->second.instanceCount == 0) {
+            it = instanceGroups.erase(it);
+            continue;
+        }
+        it->second.firstInstance = firstInstance;
+        firstInstance += it->second.instanceCount;
+        it->second.instanceCount = 0;
+        it++;
+    }
+
+    // fourth pass: write every visible object's matrices into its group's slice
+    reserveInstances(frameInfo.frameIndex, cullingStats.visibleCount);
+    auto &instanceBuffer = instanceBuffers[frameInfo.frameIndex];
+    auto instances = static_cast<SimpleInstanceData *>(instanceBuffer->getMappedMemory());
+    for (uint32_t i = 0; i < candidates.size(); i++) {
+        if (!frustumCuller.isVisible(i)) continue;
+        auto &candidate = candidates[i];
+        auto &group = instanceGroups[candidate.key];
+        SimpleInstanceData &instance = instances[group.firstInstance + group.instanceCount++];
+        instance.modelMatrix = candidate.modelMatrix;
+        instance.normalMatrix = candidate.transform->normalMatrix();
+    }
+
+    drawGroups.clear();
+    for (auto &keyvalue : instanceGroups) {
+        drawGroups.push_back({keyvalue.first.model, keyvalue.first.materialIndex,
+                              keyvalue.second.firstInstance, keyvalue.second.instanceCount});
+    }
+    // a model's groups end up next to each other, so its buffers are bound once
+    std::sort(drawGroups.begin(), drawGroups.end(), [](const DrawGroup &a, const DrawGroup &b) {
+        return a.model != b.model ? std::less<PveModel *>{}(a.model, b.model)
+                                  : a.materialIndex < b.materialIndex;
+    });
+    const uint32_t groupCount = static_cast<uint32_t>(drawGroups.size());
+
+    if (recorder == nullptr) {
+        recordDraws(frameInfo, frameInfo.commandBuffer, 0, groupCount);
+        return;
+    }
+
+    // contiguous slices, so executing the buffers in order keeps the serial draw order. Each
+    // slice records with its own worker's pools, whichever thread ends up running it
+    uint32_t sliceCount = glm::min(recorder->getWorkerCount(), groupCount);
+    slices.resize(sliceCount);
+    auto recordSlice = [&](uint32_t slice) {
+        PVE_PROFILE_ZONE("SimpleRenderSystem::recordSlice");
+        uint32_t begin =
+            static_cast<uint32_t>(static_cast<uint64_t>(groupCount) * slice / sliceCount);
+        uint32_t end =
+            static_cast<uint32_t>(static_cast<uint64_t>(groupCount) * (slice + 1) / sliceCount);
+        VkCommandBuffer commandBuffer = recorder->beginSecondary(slice);
+        recordDraws(frameInfo, commandBuffer, begin, end);
+        recorder->endSecondary(commandBuffer);
+        slices[slice] = commandBuffer;
+    };
+    if (frameInfo.jobSystem != nullptr) {
+        frameInfo.jobSystem->parallelFor(sliceCount, 1, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t slice = begin; slice < end; slice++) {
+                recordSlice(slice);
+            }
+        });
+    } else {
+        for (uint32_t slice = 0; slice < sliceCount; slice++) {
+            recordSlice(slice);
+        }
+    }
+    for (VkCommandBuffer commandBuffer : slices) {
+        recorder->queue(commandBuffer);
+    }
+}
+
+void SimpleRenderSystem::recordDraws(FrameInfo &frameInfo, VkCommandBuffer commandBuffer,
+                                     uint32_t begin, uint32_t end) {
+    pvePipeline->bind(commandBuffer);
+    // the material set stays bound for every draw, the push constant indexes into it
+    VkDescriptorSet descriptorSets[] = {frameInfo.globalDescriptorSet,
+                                        materialLibrary.getDescriptorSet()};
     vkCmdBindDescriptorSets(
-        frameInfo.commandBuffer,
+        commandBuffer,
         VK_PIPELINE_BIND_POINT_GRAPHICS,
         pipelineLayout,
         0,
+        2,
+        descriptorSets,
         1,
-        &frameInfo.globalDescriptorSet,
-        0,
-        nullptr);
-
-    for (auto &keyvalue : frameInfo.gameObjects) {
-        auto &obj = keyvalue.second;
-        if (obj.model == nullptr) continue;
-        if (obj.name == "cube") {
-            obj.transform.rotation.y = glm::mod(obj.transform.rotation.y + 0.001f,
-                                                glm::two_pi<float>());
-            obj.transform.rotation.x = glm::mod(obj.transform.rotation.x + 0.005f,
-                                                glm::two_pi<float>());
-        }
+        &frameInfo.globalUboOffset);
 
-        SimplePushConstantData push{};
-        push.modelMatrix = obj.transform.mat4();
-        push.normalMatrix = obj.transform.normalMatrix();
+    // the instance buffer stays bound on binding 1, each draw picks its slice with firstInstance
+    VkBuffer buffers[] = {instanceBuffers[frameInfo.frameIndex]->getBuffer()};
+    VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(commandBuffer, 1, 1, buffers, offsets);
 
-        vkCmdPushConstants(frameInfo.commandBuffer, pipelineLayout,
-                           VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
-                           sizeof(SimplePushConstantData), &push);
-        obj.model->bind(frameInfo.commandBuffer);
-        obj.model->draw(frameInfo.commandBuffer);
+    // models in the same geometry arena share their buffers, so they're only bound once.
+    // A model with buffers of its own is bound once for all of its groups
+    PveGeometryArena *boundArena = nullptr;
+    PveModel *boundModel = nullptr;
+    PveModel *pushedModel = nullptr;
+    uint32_t pushedMaterial = ~0u;
+    for (uint32_t i = begin; i < end; i++) {
+        const DrawGroup &group = drawGroups[i];
+        PveGeometryArena *arena = group.model->getGeometryArena();
+        bool bound = arena != nullptr ? arena == boundArena : group.model == boundModel;
+        if (!bound) {
+            group.model->bind(commandBuffer);
+            boundArena = arena;
+            boundModel = arena != nullptr ? nullptr : group.model;
+        }
+        if (group.model != pushedModel || group.materialIndex != pushedMaterial) {
+            SimplePushConstantData push{group.model->getDequantization(), group.materialIndex};
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                               sizeof(SimplePushConstantData), &push);
+            pushedModel = group.model;
+            pushedMaterial = group.materialIndex;
+        }
+        group.model->draw(commandBuffer, group.instanceCount, group.firstInstance);
     }
 }
 
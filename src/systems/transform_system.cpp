@@ -0,0 +1,122 @@
+#include "systems/transform_system.hpp"
+
+#include "pve/pve_profiler.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace pve {
+
+#ifdef __SSE2__
+// sine and cosine of four angles at once, after the single precision Cephes sinf/cosf: the
+// angle is reduced to [-pi/4, pi/4] around the nearest multiple of pi/2 and each result
+// comes from whichever of the two minimax polynomials fits that octant
+static void sinCos4(__m128 x, __m128 &sines, __m128 &cosines) {
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(0x80000000)));
+    __m128 sinSign = _mm_and_ps(x, signMask);
+    x = _mm_andnot_ps(signMask, x);
+
+    // octant index rounded up to an even number, so the remainder is centered on zero
+    __m128i octant = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+    octant = _mm_and_si128(_mm_add_epi32(octant, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+    __m128 y = _mm_cvtepi32_ps(octant);
+
+    __m128 sinFlip = _mm_castsi128_ps(
+        _mm_slli_epi32(_mm_and_si128(octant, _mm_set1_epi32(4)), 29));
+    __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(
+        _mm_andnot_si128(_mm_sub_epi32(octant, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+    __m128 useCosPolynomial = _mm_castsi128_ps(
+        _mm_cmpeq_epi32(_mm_and_si128(octant, _mm_set1_epi32(2)), _mm_setzero_si128()));
+    sinSign = _mm_xor_ps(sinSign, sinFlip);
+
+    // pi/4 split in three parts so the subtraction stays exact
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(0.78515625f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(2.4187564849853515625e-4f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(3.77489497744594108e-8f)));
+    __m128 z = _mm_mul_ps(x, x);
+
+    __m128 cosPolynomial = _mm_set1_ps(2.443315711809948e-5f);
+    cosPolynomial = _mm_add_ps(_mm_mul_ps(cosPolynomial, z), _mm_set1_ps(-1.388731625493765e-3f));
+    cosPolynomial = _mm_add_ps(_mm_mul_ps(cosPolynomial, z), _mm_set1_ps(4.166664568298827e-2f));
+    cosPolynomial = _mm_mul_ps(_mm_mul_ps(cosPolynomial, z), z);
+    cosPolynomial = _mm_sub_ps(cosPolynomial, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+    cosPolynomial = _mm_add_ps(cosPolynomial, _mm_set1_ps(1.f));
+
+    __m128 sinPolynomial = _mm_set1_ps(-1.9515295891e-4f);
+    sinPolynomial = _mm_add_ps(_mm_mul_ps(sinPolynomial, z), _mm_set1_ps(8.3321608736e-3f));
+    sinPolynomial = _mm_add_ps(_mm_mul_ps(sinPolynomial, z), _mm_set1_ps(-1.6666654611e-1f));
+    sinPolynomial = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPolynomial, z), x), x);
+
+    // in odd quadrants sine and cosine swap polynomials
+    __m128 sinResult = _mm_or_ps(_mm_and_ps(useCosPolynomial, sinPolynomial),
+                                 _mm_andnot_ps(useCosPolynomial, cosPolynomial));
+    __m128 cosResult = _mm_or_ps(_mm_and_ps(useCosPolynomial, cosPolynomial),
+                                 _mm_andnot_ps(useCosPolynomial, sinPolynomial));
+    sines = _mm_xor_ps(sinResult, sinSign);
+    cosines = _mm_xor_ps(cosResult, cosSign);
+}
+#endif
+
+// below this many dirty transforms spawning jobs costs more than the update itself
+static constexpr uint32_t PARALLEL_TRANSFORM_THRESHOLD = 4096;
+static constexpr uint32_t TRANSFORM_GRAIN_SIZE = 1024;
+
+void TransformSystem::update(PveRegistry &registry, PveJobSystem *jobSystem) {
+    PVE_PROFILE_ZONE("TransformSystem::update");
+    dirtyTransforms.clear();
+    for (auto &transform : registry.pool<TransformComponent>().getComponents()) {
+        if (transform.isDirty()) {
+            dirtyTransforms.push_back(&transform);
+        }
+    }
+    updatedCount = static_cast<uint32_t>(dirtyTransforms.size());
+
+    if (jobSystem != nullptr && updatedCount >= PARALLEL_TRANSFORM_THRESHOLD) {
+        jobSystem->parallelFor(updatedCount, TRANSFORM_GRAIN_SIZE,
+                               [this](uint32_t begin, uint32_t end) { updateRange(begin, end); });
+    } else {
+        updateRange(0, updatedCount);
+    }
+
+    sceneGraph.propagate(registry, jobSystem);
+}
+
+void TransformSystem::updateRange(size_t begin, size_t end) {
+    size_t first = begin;
+
+#ifdef __SSE2__
+    // one register per rotation axis, one lane per transform
+    alignas(16) float angles[3][4];
+    alignas(16) float sines[3][4];
+    alignas(16) float cosines[3][4];
+    for (; first + 4 <= end; first += 4) {
+        for (int lane = 0; lane < 4; lane++) {
+            const glm::vec3 &rotation = dirtyTransforms[first + lane]->getRotation();
+            angles[0][lane] = rotation.x;
+            angles[1][lane] = rotation.y;
+            angles[2][lane] = rotation.z;
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            __m128 axisSines;
+            __m128 axisCosines;
+            sinCos4(_mm_load_ps(angles[axis]), axisSines, axisCosines);
+            _mm_store_ps(sines[axis], axisSines);
+            _mm_store_ps(cosines[axis], axisCosines);
+        }
+        for (int lane = 0; lane < 4; lane++) {
+            dirtyTransforms[first + lane]->updateMatrices(
+                {sines[0][lane], sines[1][lane], sines[2][lane]},
+                {cosines[0][lane], cosines[1][lane], cosines[2][lane]});
+        }
+    }
+#endif
+
+    // whatever doesn't fill a whole register, or everything without SSE2
+    for (size_t i = first; i < end; i++) {
+        const glm::vec3 &rotation = dirtyTransforms[i]->getRotation();
+        dirtyTransforms[i]->updateMatrices(glm::sin(rotation), glm::cos(rotation));
+    }
+}
+
+}  // namespace pve
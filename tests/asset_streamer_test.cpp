@@ -0,0 +1,44 @@
+// checks the asset streamer's memory budget math, which has to hold up when the resident
+// models already take more than the budget. Build and run with `make check`
+#include "pve/pve_asset_streamer.hpp"
+
+// std
+#include <cstdio>
+#include <cstdlib>
+
+using namespace pve;
+
+static int failures = 0;
+
+static void check(bool condition, const char *what) {
+    if (!condition) {
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+int main() {
+    constexpr VkDeviceSize MB = 1024 * 1024;
+    constexpr VkDeviceSize BUDGET = 256 * MB;
+
+    // under the budget
+    check(PveAssetStreamer::fitsBudget(100 * MB, 0, 156 * MB, BUDGET), "exactly fills the budget");
+    check(!PveAssetStreamer::fitsBudget(100 * MB, 0, 157 * MB, BUDGET),
+          "one past the budget without evictions");
+    check(PveAssetStreamer::fitsBudget(200 * MB, 50 * MB, 100 * MB, BUDGET),
+          "fits once farther assets are evicted");
+
+    // the resident set is over the budget, unsigned math that subtracts from the budget would
+    // wrap around and let everything in
+    check(!PveAssetStreamer::fitsBudget(300 * MB, 0, 1, BUDGET),
+          "nothing fits over the budget without evictions");
+    check(!PveAssetStreamer::fitsBudget(300 * MB, 40 * MB, 10 * MB, BUDGET),
+          "evicting less than the overshoot makes no room");
+    check(PveAssetStreamer::fitsBudget(300 * MB, 100 * MB, 10 * MB, BUDGET),
+          "evicting past the overshoot makes room");
+
+    if (failures == 0) {
+        std::printf("asset streamer: all checks passed\n");
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,133 @@
+// reports what PveMeshOptimizer does to the post transform vertex cache hit rate of a list of
+// .obj files, pass by pass. The engine runs the same passes when it loads a model, this only
+// measures them. Build with `make tools`
+#include "pve/pve_mesh_optimizer.hpp"
+
+// libs
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+// std
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace pve;
+
+// one vertex per distinct position, normal and uv index triple, like the engine's loader
+// ends up with for meshes without duplicated attributes
+static void loadObj(const std::string &filepath, std::vector<PveVertex> &vertices,
+                    std::vector<uint32_t> &indices) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.c_str())) {
+        throw std::runtime_error(warn + err);
+    }
+
+    std::map<std::tuple<int, int, int>, uint32_t> uniqueVertices;
+    for (const auto &shape : shapes) {
+        for (const auto &index : shape.mesh.indices) {
+            auto key = std::make_tuple(index.vertex_index, index.normal_index,
+                                       index.texcoord_index);
+            auto found = uniqueVertices.find(key);
+            if (found != uniqueVertices.end()) {
+                indices.push_back(found->second);
+                continue;
+            }
+            PveVertex vertex{};
+            if (index.vertex_index >= 0) {
+                vertex.position = {attrib.vertices[3 * index.vertex_index + 0],
+                                   attrib.vertices[3 * index.vertex_index + 1],
+                                   attrib.vertices[3 * index.vertex_index + 2]};
+            }
+            if (index.normal_index >= 0) {
+                vertex.normal = {attrib.normals[3 * index.normal_index + 0],
+                                 attrib.normals[3 * index.normal_index + 1],
+                                 attrib.normals[3 * index.normal_index + 2]};
+            }
+            if (index.texcoord_index >= 0) {
+                vertex.uv = {attrib.texcoords[2 * index.texcoord_index + 0],
+                             attrib.texcoords[2 * index.texcoord_index + 1]};
+            }
+            uint32_t vertexIndex = static_cast<uint32_t>(vertices.size());
+            uniqueVertices.emplace(key, vertexIndex);
+            vertices.push_back(vertex);
+            indices.push_back(vertexIndex);
+        }
+    }
+}
+
+static void printStats(const char *pass, const PveMeshOptimizer::CacheStats &stats) {
+    std::printf("  %-14s ACMR %.3f  ATVR %.3f\n", pass, stats.acmr, stats.atvr);
+}
+
+int main(int argc, char **argv) {
+    PveMeshOptimizer::Options options{};
+    std::vector<std::string> sourcePaths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--cache-size" && i + 1 < argc) {
+            options.cacheSize = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--threshold" && i + 1 < argc) {
+            options.overdrawThreshold = std::stof(argv[++i]);
+        } else if (arg == "--no-overdraw") {
+            options.overdraw = false;
+        } else if (arg[0] != '-') {
+            sourcePaths.push_back(arg);
+        } else {
+            sourcePaths.clear();
+            break;
+        }
+    }
+    if (sourcePaths.empty() || options.cacheSize == 0) {
+        std::fprintf(stderr,
+                     "usage: %s [--cache-size N] [--threshold F] [--no-overdraw] model.obj...\n",
+                     argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int failures = 0;
+    for (const std::string &sourcePath : sourcePaths) {
+        std::vector<PveVertex> vertices;
+        std::vector<uint32_t> indices;
+        try {
+            loadObj(sourcePath, vertices, indices);
+        } catch (const std::exception &e) {
+            std::fprintf(stderr, "%s: %s\n", sourcePath.c_str(), e.what());
+            failures++;
+            continue;
+        }
+        uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+        std::printf("%s: %zu triangles, %u vertices, %s indices\n", sourcePath.c_str(),
+                    indices.size() / 3, vertexCount,
+                    PveMeshOptimizer::fitsUint16(vertexCount) ? "16 bit" : "32 bit");
+        printStats("input",
+                   PveMeshOptimizer::analyzeVertexCache(indices, vertexCount, options.cacheSize));
+
+        // the passes one at a time, the same way optimize() runs them
+        auto start = std::chrono::steady_clock::now();
+        std::vector<uint32_t> clusters =
+            PveMeshOptimizer::optimizeVertexCache(indices, vertexCount, options.cacheSize);
+        printStats("vertex cache",
+                   PveMeshOptimizer::analyzeVertexCache(indices, vertexCount, options.cacheSize));
+        if (options.overdraw) {
+            PveMeshOptimizer::optimizeOverdraw(indices, clusters, vertices, options.cacheSize,
+                                               options.overdrawThreshold);
+            printStats("overdraw", PveMeshOptimizer::analyzeVertexCache(indices, vertexCount,
+                                                                        options.cacheSize));
+        }
+        PveMeshOptimizer::optimizeVertexFetch(vertices, indices);
+        auto end = std::chrono::steady_clock::now();
+        std::printf("  %zu cache clusters, %zu unused vertices dropped, optimized in %.1f ms\n",
+                    clusters.size(), vertexCount - vertices.size(),
+                    std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,111 @@
+// cooks source images into the .ktx2 files the engine loads, ahead of time. Each image is
+// decoded and cooked as its own job, and its levels are filtered and encoded in parallel
+// too. The output goes next to the source, where PveTexture::createTextureFromFile looks for
+// it, so the options have to match the ones the engine loads the texture with.
+// Build with `make tools`
+#include "pve/pve_job_system.hpp"
+#include "pve/pve_texture_cooker.hpp"
+#include "pve/pve_texture_file.hpp"
+
+// std
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <vector>
+
+using namespace pve;
+
+struct CookResult {
+    bool written = false;
+    uint64_t uncompressedBytes = 0;  // RGBA8 with the same mip levels
+    uint64_t cookedBytes = 0;
+    std::string error;
+};
+
+static void cookFile(const std::string &sourcePath, const PveTextureCooker::Options &options,
+                     PveJobSystem &jobSystem, CookResult &result) {
+    // an exception must not leave the job
+    try {
+        PveCookedTexture texture =
+            PveTextureCooker::cook(PveTextureCooker::loadImage(sourcePath), options, &jobSystem);
+        for (uint32_t level = 0; level < texture.levels.size(); level++) {
+            uint32_t width = std::max(texture.width >> level, 1u);
+            uint32_t height = std::max(texture.height >> level, 1u);
+            result.uncompressedBytes += static_cast<uint64_t>(width) * height * 4;
+            result.cookedBytes += texture.levels[level].size();
+        }
+        result.written = PveTextureFile::write(PveTextureFile::cachePathFor(sourcePath), texture,
+                                               sourcePath, options);
+        if (!result.written) {
+            result.error = "failed to write " + PveTextureFile::cachePathFor(sourcePath);
+        }
+    } catch (const std::exception &e) {
+        result.error = e.what();
+    }
+}
+
+int main(int argc, char **argv) {
+    PveTextureCooker::Options options{};
+    uint32_t jobThreads = 0;
+    std::vector<std::string> sourcePaths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--bc1") {
+            options.encoding = PveTextureEncoding::Bc1;
+        } else if (arg == "--bc3") {
+            options.encoding = PveTextureEncoding::Bc3;
+        } else if (arg == "--bc5") {
+            options.encoding = PveTextureEncoding::Bc5;
+        } else if (arg == "--rgba8") {
+            options.encoding = PveTextureEncoding::Rgba8;
+        } else if (arg == "--linear") {
+            options.srgb = false;
+        } else if (arg == "--no-mipmaps") {
+            options.mipmaps = false;
+        } else if (arg == "--job-threads" && i + 1 < argc) {
+            jobThreads = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg[0] != '-') {
+            sourcePaths.push_back(arg);
+        } else {
+            sourcePaths.clear();
+            break;
+        }
+    }
+    if (sourcePaths.empty()) {
+        std::fprintf(stderr,
+                     "usage: %s [--bc1 | --bc3 | --bc5 | --rgba8] [--linear] [--no-mipmaps]"
+                     " [--job-threads N] image.tga|image.ppm...\n",
+                     argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    PveJobSystem jobSystem{jobThreads};
+    std::vector<CookResult> results(sourcePaths.size());
+    auto start = std::chrono::steady_clock::now();
+    PveJobCounter counter;
+    for (size_t i = 0; i < sourcePaths.size(); i++) {
+        jobSystem.spawn([&, i] { cookFile(sourcePaths[i], options, jobSystem, results[i]); },
+                        &counter);
+    }
+    jobSystem.wait(counter);
+    auto end = std::chrono::steady_clock::now();
+
+    int failures = 0;
+    for (size_t i = 0; i < sourcePaths.size(); i++) {
+        const CookResult &result = results[i];
+        if (!result.written) {
+            std::fprintf(stderr, "%s: %s\n", sourcePaths[i].c_str(), result.error.c_str());
+            failures++;
+            continue;
+        }
+        std::printf("%s: %.1f KiB, %.1fx smaller than RGBA8\n", sourcePaths[i].c_str(),
+                    result.cookedBytes / 1024., static_cast<double>(result.uncompressedBytes) /
+                                                    static_cast<double>(result.cookedBytes));
+    }
+    std::printf("cooked %zu textures in %.1f ms on %u workers\n", sourcePaths.size() - failures,
+                std::chrono::duration<double, std::milli>(end - start).count(),
+                jobSystem.getWorkerCount());
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}